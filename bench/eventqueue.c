@@ -0,0 +1,174 @@
+/**
+ * Microbenchmark for src/eventqueue.c
+ *
+ * A number of producer threads push events as fast as they can, like the
+ * IMAP, SMTP, mvbox and sentbox threads do during a fetch burst, while the
+ * main thread drains the queue with eventqueue_pop_all() like the event
+ * wakeup in src/module.c. Run it with `npm run bench-eventqueue`.
+ *
+ * Usage: bench-eventqueue [producers] [events per producer] [capacity] [policy]
+ *
+ * `policy` is a combination of the EVENTQUEUE_* overflow flags, e.g. 2 to
+ * let the producers block instead of retrying. The bench fails if an event
+ * gets lost without being counted as dropped or coalesced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <deltachat.h>
+#include "../src/eventqueue.h"
+
+typedef struct producer_t {
+  pthread_t thread;
+  eventqueue_t* queue;
+  int policy;
+  size_t events;
+  size_t full;
+} producer_t;
+
+static atomic_int producers_running;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* With EVENTQUEUE_DROP_OLDEST_LOG or EVENTQUEUE_BLOCK, the queue decides
+ * what gets lost and eventqueue_push() is called once. Otherwise a full
+ * queue is retried so that every event is measured end to end;
+ * eventqueue_try_push() does not count the retries as dropped events. */
+static void push_event(producer_t* producer, int event, uintptr_t data1, uintptr_t data2)
+{
+  if (producer->policy & (EVENTQUEUE_DROP_OLDEST_LOG | EVENTQUEUE_BLOCK)) {
+    if (!eventqueue_push(producer->queue, event, data1, data2)) {
+      producer->full++;
+    }
+    return;
+  }
+
+  while (!eventqueue_try_push(producer->queue, event, data1, data2)) {
+    producer->full++;
+    sched_yield();
+  }
+}
+
+static void* producer_func(void* arg)
+{
+  producer_t* producer = (producer_t*)arg;
+
+  for (size_t i = 0; i < producer->events; i++) {
+    // every tenth event carries a string, like DC_EVENT_INFO log lines
+    if (i % 10 == 0) {
+      push_event(producer, DC_EVENT_INFO, 0, (uintptr_t)"IMAP-fetch: Got 1 message");
+    } else {
+      push_event(producer, DC_EVENT_MSGS_CHANGED, 12, i);
+    }
+  }
+
+  atomic_fetch_sub(&producers_running, 1);
+  return NULL;
+}
+
+static void bench_single_thread(size_t capacity, size_t rounds)
+{
+  eventqueue_t* queue = eventqueue_new(capacity, 0);
+  size_t batch = capacity / 2;
+  eventqueue_item_t* items = NULL;
+
+  double start = now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < batch; i++) {
+      eventqueue_push(queue, DC_EVENT_MSGS_CHANGED, 12, i);
+    }
+    size_t cnt = eventqueue_pop_all(queue, &items);
+    eventqueue_items_clear(queue, items, cnt);
+  }
+  double elapsed = now() - start;
+
+  printf("single thread:  %.1f ns per push+pop\n",
+         elapsed * 1e9 / (double)(rounds * batch));
+
+  eventqueue_unref(queue);
+}
+
+int main(int argc, char* argv[])
+{
+  int n_producers = argc > 1 ? atoi(argv[1]) : 4;
+  size_t events = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+  size_t capacity = argc > 3 ? strtoul(argv[3], NULL, 10) : EVENTQUEUE_DEFAULT_CAPACITY;
+  int policy = argc > 4 ? atoi(argv[4]) : 0;
+
+  bench_single_thread(capacity, 1000);
+
+  eventqueue_t* queue = eventqueue_new(capacity, policy);
+  producer_t* producers = calloc(n_producers, sizeof(producer_t));
+  atomic_store(&producers_running, n_producers);
+
+  double start = now();
+  for (int i = 0; i < n_producers; i++) {
+    producers[i].queue = queue;
+    producers[i].policy = policy;
+    producers[i].events = events;
+    pthread_create(&producers[i].thread, NULL, producer_func, &producers[i]);
+  }
+
+  size_t popped = 0;
+  size_t batches = 0;
+  eventqueue_item_t* items = NULL;
+  for (;;) {
+    int running = atomic_load(&producers_running);
+    size_t cnt = eventqueue_pop_all(queue, &items);
+    eventqueue_items_clear(queue, items, cnt);
+    popped += cnt;
+    if (cnt) {
+      batches++;
+    } else if (running == 0) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+  double elapsed = now() - start;
+
+  size_t full = 0;
+  for (int i = 0; i < n_producers; i++) {
+    pthread_join(producers[i].thread, NULL);
+    full += producers[i].full;
+  }
+
+  printf("%d producers:    %zu events each, capacity %zu, policy %d\n",
+         n_producers, events, capacity, policy);
+  printf("throughput:     %.2f M events/s in %zu batches (avg %.0f events)\n",
+         popped / elapsed / 1e6, batches, batches ? (double)popped / batches : 0);
+  printf("queue full:     %zu times\n", full);
+
+  eventqueue_stats_t stats;
+  eventqueue_get_stats(queue, &stats);
+  printf("dropped:        %llu, coalesced: %llu\n",
+         (unsigned long long)stats.dropped, (unsigned long long)stats.coalesced);
+  printf("strings:        %llu copied, %llu from free lists, %llu mallocs, %llu bytes in slabs\n",
+         (unsigned long long)stats.strings.allocs, (unsigned long long)stats.strings.reused,
+         (unsigned long long)stats.strings.mallocs, (unsigned long long)stats.strings.bytes);
+
+  free(producers);
+  eventqueue_unref(queue);
+
+  // every event must arrive, unless the overflow policy dropped it or it
+  // was merged into a pending one
+  size_t expected = (size_t)n_producers * events;
+  if (popped + stats.coalesced + stats.dropped != expected) {
+    fprintf(stderr, "lost events: %zu popped, %llu coalesced, %llu dropped of %zu\n",
+            popped, (unsigned long long)stats.coalesced,
+            (unsigned long long)stats.dropped, expected);
+    return 1;
+  }
+
+  return 0;
+}
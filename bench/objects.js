@@ -0,0 +1,49 @@
+/**
+ * Benchmark for building objects natively
+ *
+ * Compares the bulk getters, which build all objects in one call with
+ * cached property names and interned names and addresses, with fetching
+ * the same objects one by one through toJson(). Run it with
+ * `npm run bench-objects`.
+ *
+ * Usage: node bench/objects.js [objects] [rounds]
+ */
+
+const DeltaChat = require('..')
+const tempy = require('tempy')
+
+const count = Number(process.argv[2] || 1000)
+const rounds = Number(process.argv[3] || 20)
+
+function measure (name, fn) {
+  fn() // warm up
+  const start = process.hrtime()
+  for (let i = 0; i < rounds; i++) fn()
+  const elapsed = process.hrtime(start)
+  const usec = (elapsed[0] * 1e6 + elapsed[1] / 1e3) / (rounds * count)
+  console.log(`${name.padEnd(40)} ${usec.toFixed(2)} us/object`)
+}
+
+const dc = new DeltaChat()
+dc.open(tempy.directory(), err => {
+  if (err) throw err
+
+  // Few distinct names, like the members of a handful of groups
+  const contactIds = []
+  for (let i = 0; i < count; i++) {
+    contactIds.push(dc.createContact(`contact ${i % 50}`, `contact${i}@site.org`))
+  }
+  const chatId = dc.createChatByContactId(contactIds[0])
+  const msgIds = []
+  for (let i = 0; i < count; i++) {
+    msgIds.push(dc.sendMessage(chatId, `message ${i}`))
+  }
+
+  console.log(`${count} objects, ${rounds} rounds`)
+  measure('getContactsInfo()', () => dc.getContactsInfo(contactIds))
+  measure('getContact().toJson()', () => contactIds.map(id => dc.getContact(id).toJson()))
+  measure('getMessages()', () => dc.getMessages(msgIds))
+  measure('getMessage().toJson()', () => msgIds.map(id => dc.getMessage(id).toJson()))
+
+  dc.close()
+})
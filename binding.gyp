@@ -33,7 +33,14 @@
       "sources": [
         "./src/module.c",
         "./src/eventqueue.c",
-        "./src/strtable.c"
+        "./src/eventstats.c",
+        "./src/histogram.c",
+        "./src/httpcache.c",
+        "./src/httpwait.c",
+        "./src/journal.c",
+        "./src/strpool.c",
+        "./src/strtable.c",
+        "./src/workpool.c"
       ],
       "include_dirs": [
         "deltachat-core/src",
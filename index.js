@@ -7,73 +7,190 @@ const Chat = require('./chat')
 const ChatList = require('./chatlist')
 const Contact = require('./contact')
 const Message = require('./message')
+const MessageCursor = require('./messagecursor')
 const Lot = require('./lot')
+const StringTable = require('./stringtable')
 const EventEmitter = require('events').EventEmitter
 const mkdirp = require('mkdirp')
+const fs = require('fs')
 const path = require('path')
 const got = require('got')
 const pick = require('lodash.pick')
 const debug = require('debug')('deltachat:index')
 
+// Flags for the overflow policy of the native event queue,
+// see EVENTQUEUE_* in src/eventqueue.h
+const EVENT_QUEUE_OVERFLOW = {
+  'drop-oldest-log': 0x01,
+  'block-producer': 0x02,
+  'coalesce': 0x04
+}
+
+const ALL_EVENTS = Object.keys(events).map(Number)
+
+/**
+ * Passed instead of a callback to get a promise from the native async
+ * bindings, queued in the priority class it carries, see promiseMethods()
+ */
+class PromiseRequest {
+  constructor (priority) {
+    this.priority = priority
+    Object.freeze(this)
+  }
+}
+
+// Priority classes of the work pool, see dc.withPriority()
+const PRIORITIES = {
+  interactive: 0,
+  background: 1
+}
+
+// Methods taking a trailing callback, see dc.promises
+const PROMISE_METHODS = [
+  'addAddressBook',
+  'addContactToChat',
+  'archiveChat',
+  'blockContact',
+  'checkPassword',
+  'checkQrCode',
+  'continueKeyTransfer',
+  'createChatByContactId',
+  'createChatByMessageId',
+  'createContact',
+  'createUnverifiedGroupChat',
+  'createVerifiedGroupChat',
+  'deleteChat',
+  'deleteContact',
+  'deleteMessages',
+  'forwardMessages',
+  'getBlockedContacts',
+  'getBlockedCount',
+  'getChat',
+  'getChatContacts',
+  'getChatIdByContactId',
+  'getChatList',
+  'getChatListSnapshot',
+  'getChatMedia',
+  'getChatMessages',
+  'getChatMessagesCursor',
+  'getChatsInfo',
+  'getConfig',
+  'getContact',
+  'getContactEncryptionInfo',
+  'getContacts',
+  'getContactsInfo',
+  'getDraft',
+  'getFreshMessageCount',
+  'getFreshMessages',
+  'getInfo',
+  'getMessage',
+  'getMessageCount',
+  'getMessageInfo',
+  'getMessages',
+  'getMimeHeaders',
+  'getNextMediaMessage',
+  'getPreviousMediaMessage',
+  'getSecurejoinQrCode',
+  'getStarredMessages',
+  'importExport',
+  'importExportHasBackup',
+  'initiateKeyTransfer',
+  'isConfigured',
+  'isContactInChat',
+  'joinSecurejoin',
+  'lookupContactIdByAddr',
+  'markNoticedAllChats',
+  'markNoticedChat',
+  'markNoticedContact',
+  'markSeenMessages',
+  'removeContactFromChat',
+  'replayEventJournal',
+  'searchMessages',
+  'setChatName',
+  'setChatProfileImage',
+  'setConfig',
+  'starMessages'
+]
+
 /**
  * Wrapper around dcn_context_t*
  */
 class DeltaChat extends EventEmitter {
-  constructor () {
+  constructor (opts) {
     debug('DeltaChat constructor')
     super()
 
-    this._pollInterval = null
-    this.dcn_context = binding.dcn_context_new()
-    // TODO comment back in once polling is gone
-    // binding.dcn_set_event_handler(this.dcn_context, (event, data1, data2) => {
-    //   handleEvent(this, event, data1, data2)
-    // })
+    opts = opts || {}
+    this.dcn_context = binding.dcn_context_new(
+      Number(opts.eventQueueCapacity || 0),
+      eventQueuePolicy(opts.eventQueueOverflow || 'drop-oldest-log'),
+      Number(opts.httpGetTimeout === undefined ? 30000 : opts.httpGetTimeout),
+      opts.eventStats ? 1 : 0
+    )
+    this.typedArrays = Boolean(opts.typedArrays)
+    trackEventListeners(this)
   }
 
-  addAddressBook (addressBook) {
+  get promises () {
+    if (!this._promises) this._promises = promiseMethods(this)
+    return this._promises
+  }
+
+  withPriority (priority) {
+    if (typeof PRIORITIES[priority] !== 'number') {
+      throw new Error(`Unknown priority ${priority}`)
+    }
+    if (!this._priorities) this._priorities = {}
+    if (!this._priorities[priority]) {
+      this._priorities[priority] = promiseMethods(this, PRIORITIES[priority])
+    }
+    return this._priorities[priority]
+  }
+
+  addAddressBook (addressBook, cb) {
     debug(`addAddressBook ${addressBook}`)
-    return binding.dcn_add_address_book(this.dcn_context, addressBook)
+    return callBinding(this, 'add_address_book', [ addressBook ], cb)
   }
 
-  addContactToChat (chatId, contactId) {
+  addContactToChat (chatId, contactId, cb) {
     debug(`addContactToChat ${chatId} ${contactId}`)
-    return Boolean(
-      binding.dcn_add_contact_to_chat(
-        this.dcn_context,
-        Number(chatId),
-        Number(contactId)
-      )
-    )
+    return callBinding(this, 'add_contact_to_chat', [
+      Number(chatId),
+      Number(contactId)
+    ], cb, Boolean)
   }
 
-  archiveChat (chatId, archive) {
+  archiveChat (chatId, archive, cb) {
     debug(`archiveChat ${chatId} ${archive}`)
-    binding.dcn_archive_chat(
-      this.dcn_context,
+    return callBinding(this, 'archive_chat', [
       Number(chatId),
       archive ? 1 : 0
-    )
+    ], cb)
   }
 
-  blockContact (contactId, block) {
+  blockContact (contactId, block, cb) {
     debug(`blockContact ${contactId} ${block}`)
-    binding.dcn_block_contact(
-      this.dcn_context,
+    return callBinding(this, 'block_contact', [
       Number(contactId),
       block ? 1 : 0
-    )
+    ], cb)
   }
 
-  checkPassword (password) {
+  checkPassword (password, cb) {
     debug('checkPassword')
-    return Boolean(binding.dcn_check_password(this.dcn_context, password))
+    return callBinding(this, 'check_password', [ password ], cb, Boolean)
   }
 
-  checkQrCode (qrCode) {
+  checkQrCode (qrCode, cb) {
     debug(`checkQrCode ${qrCode}`)
-    const dc_lot = binding.dcn_check_qr(this.dcn_context, qrCode)
-    return dc_lot ? new Lot(dc_lot) : null
+    return callBinding(this, 'check_qr', [ qrCode ], cb, dc_lot => {
+      return dc_lot ? new Lot(dc_lot) : null
+    })
+  }
+
+  static clearHttpCache () {
+    debug('DeltaChat.clearHttpCache')
+    binding.dcn_clear_http_cache()
   }
 
   clearStringTable () {
@@ -84,15 +201,8 @@ class DeltaChat extends EventEmitter {
   close () {
     debug('close')
     this.removeAllListeners()
-
-    // TODO temporary polling interval
-    if (this._pollInterval) {
-      clearInterval(this._pollInterval)
-      this._pollInterval = null
-    }
-
-    // TODO comment back in once polling is gone
-    // binding.dcn_unset_event_handler(this.dcn_context)
+    trackEventListeners(this)
+    binding.dcn_unset_event_handler(this.dcn_context)
     binding.dcn_stop_threads(this.dcn_context)
   }
 
@@ -144,78 +254,95 @@ class DeltaChat extends EventEmitter {
     binding.dcn_configure(this.dcn_context)
   }
 
+  static configureHttpCache (opts) {
+    debug('DeltaChat.configureHttpCache')
+    opts = opts || {}
+    binding.dcn_configure_http_cache(
+      Number(opts.capacity === undefined ? 256 : opts.capacity),
+      Number(opts.ttl === undefined ? 60 * 60 * 1000 : opts.ttl),
+      Number(opts.negativeTtl === undefined ? 60 * 1000 : opts.negativeTtl),
+      opts.dir || ''
+    )
+  }
+
+  static configureWorkPool (opts) {
+    debug('DeltaChat.configureWorkPool')
+    opts = opts || {}
+    binding.dcn_configure_work_pool(
+      Number(opts.threads === undefined ? 4 : opts.threads),
+      Number(opts.aging === undefined ? 100 : opts.aging)
+    )
+  }
+
   continueKeyTransfer (messageId, setupCode, cb) {
     debug(`continueKeyTransfer ${messageId}`)
+    const error = () => new Error('Key transfer failed due to bad setup code')
+    if (typeof cb !== 'function') {
+      return binding.dcn_continue_key_transfer(this.dcn_context, Number(messageId), setupCode, undefined, priorityOf(cb))
+        .then(result => {
+          if (result === 0) throw error()
+        })
+    }
     binding.dcn_continue_key_transfer(this.dcn_context, Number(messageId), setupCode, result => {
+      if (result instanceof Error) return cb(result)
       if (result === 0) {
-        return cb(new Error('Key transfer failed due to bad setup code'))
+        return cb(error())
       }
       cb(null)
     })
   }
 
-  createChatByContactId (contactId) {
+  createChatByContactId (contactId, cb) {
     debug(`createChatByContactId ${contactId}`)
-    return binding.dcn_create_chat_by_contact_id(
-      this.dcn_context,
+    return callBinding(this, 'create_chat_by_contact_id', [
       Number(contactId)
-    )
+    ], cb)
   }
 
-  createChatByMessageId (messageId) {
+  createChatByMessageId (messageId, cb) {
     debug(`createChatByMessageId ${messageId}`)
-    return binding.dcn_create_chat_by_msg_id(
-      this.dcn_context,
+    return callBinding(this, 'create_chat_by_msg_id', [
       Number(messageId)
-    )
+    ], cb)
   }
 
-  createContact (name, addr) {
+  createContact (name, addr, cb) {
     debug(`createContact ${name} ${addr}`)
-    return binding.dcn_create_contact(this.dcn_context, name, addr)
+    return callBinding(this, 'create_contact', [ name, addr ], cb)
   }
 
-  createUnverifiedGroupChat (chatName) {
+  createUnverifiedGroupChat (chatName, cb) {
     debug(`createUnverifiedGroupChat ${chatName}`)
-    return binding.dcn_create_group_chat(this.dcn_context, 0, chatName)
+    return callBinding(this, 'create_group_chat', [ 0, chatName ], cb)
   }
 
-  createVerifiedGroupChat (chatName) {
+  createVerifiedGroupChat (chatName, cb) {
     debug(`createVerifiedGroupChat ${chatName}`)
-    return binding.dcn_create_group_chat(this.dcn_context, 1, chatName)
+    return callBinding(this, 'create_group_chat', [ 1, chatName ], cb)
   }
 
-  deleteChat (chatId) {
+  deleteChat (chatId, cb) {
     debug(`deleteChat ${chatId}`)
-    binding.dcn_delete_chat(this.dcn_context, Number(chatId))
+    return callBinding(this, 'delete_chat', [ Number(chatId) ], cb)
   }
 
-  deleteContact (contactId) {
+  deleteContact (contactId, cb) {
     debug(`deleteContact ${contactId}`)
-    return Boolean(
-      binding.dcn_delete_contact(
-        this.dcn_context,
-        Number(contactId)
-      )
-    )
+    return callBinding(this, 'delete_contact', [
+      Number(contactId)
+    ], cb, Boolean)
   }
 
-  deleteMessages (messageIds) {
-    if (!Array.isArray(messageIds)) {
-      messageIds = [ messageIds ]
-    }
-    messageIds = messageIds.map(id => Number(id))
-    debug('deleteMessages', messageIds)
-    binding.dcn_delete_msgs(this.dcn_context, messageIds)
+  deleteMessages (messageIds, cb) {
+    messageIds = toIds(messageIds)
+    debug('deleteMessages', messageIds.length)
+    return callBinding(this, 'delete_msgs', [ messageIds ], cb)
   }
 
-  forwardMessages (messageIds, chatId) {
-    if (!Array.isArray(messageIds)) {
-      messageIds = [ messageIds ]
-    }
-    messageIds = messageIds.map(id => Number(id))
-    debug('forwardMessages', messageIds)
-    binding.dcn_forward_msgs(this.dcn_context, messageIds, chatId)
+  forwardMessages (messageIds, chatId, cb) {
+    messageIds = toIds(messageIds)
+    debug('forwardMessages', messageIds.length)
+    return callBinding(this, 'forward_msgs', [ messageIds, Number(chatId) ], cb)
   }
 
   getBlobdir () {
@@ -223,56 +350,71 @@ class DeltaChat extends EventEmitter {
     return binding.dcn_get_blobdir(this.dcn_context)
   }
 
-  getBlockedCount () {
+  getBlockedCount (cb) {
     debug('getBlockedCount')
-    return binding.dcn_get_blocked_cnt(this.dcn_context)
+    return callBinding(this, 'get_blocked_cnt', [], cb)
   }
 
-  getBlockedContacts () {
+  getBlockedContacts (cb) {
     debug('getBlockedContacts')
-    return binding.dcn_get_blocked_contacts(this.dcn_context)
+    return callBinding(this, 'get_blocked_contacts', [], cb, ids => idArray(this, ids))
   }
 
-  getChat (chatId) {
+  getChat (chatId, cb) {
     debug(`getChat ${chatId}`)
-    const dc_chat = binding.dcn_get_chat(this.dcn_context, Number(chatId))
-    return dc_chat ? new Chat(dc_chat) : null
+    return callBinding(this, 'get_chat', [ Number(chatId) ], cb, dc_chat => {
+      return dc_chat ? new Chat(dc_chat) : null
+    })
   }
 
-  getChatContacts (chatId) {
+  getChatContacts (chatId, cb) {
     debug(`getChatContacts ${chatId}`)
-    return binding.dcn_get_chat_contacts(this.dcn_context, Number(chatId))
+    return callBinding(this, 'get_chat_contacts', [
+      Number(chatId)
+    ], cb, ids => idArray(this, ids))
   }
 
-  getChatIdByContactId (contactId) {
+  getChatIdByContactId (contactId, cb) {
     debug(`getChatIdByContactId ${contactId}`)
-    return binding.dcn_get_chat_id_by_contact_id(this.dcn_context, Number(contactId))
+    return callBinding(this, 'get_chat_id_by_contact_id', [
+      Number(contactId)
+    ], cb)
   }
 
-  getChatMedia (chatId, msgType1, msgType2, msgType3) {
+  getChatMedia (chatId, msgType1, msgType2, msgType3, cb) {
     debug(`getChatMedia ${chatId}`)
-    return binding.dcn_get_chat_media(
-      this.dcn_context,
+    return callBinding(this, 'get_chat_media', [
       Number(chatId),
       msgType1,
       msgType2 || 0,
       msgType3 || 0
-    )
+    ], cb, ids => idArray(this, ids))
   }
 
-  getMimeHeaders (messageId) {
+  getMimeHeaders (messageId, cb) {
     debug(`getMimeHeaders ${messageId}`)
-    return binding.dcn_get_mime_headers(this.dcn_context, Number(messageId))
+    return callBinding(this, 'get_mime_headers', [ Number(messageId) ], cb)
   }
 
-  getChatMessages (chatId, flags, marker1before) {
+  getChatMessages (chatId, flags, marker1before, cb) {
     debug(`getChatMessages ${chatId} ${flags} ${marker1before}`)
-    return binding.dcn_get_chat_msgs(
-      this.dcn_context,
+    return callBinding(this, 'get_chat_msgs', [
       Number(chatId),
       flags,
       marker1before
-    )
+    ], cb, ids => idArray(this, ids))
+  }
+
+  getChatMessagesCursor (chatId, flags, marker1before, cb) {
+    if (typeof flags === 'function') return this.getChatMessagesCursor(chatId, 0, 0, flags)
+    debug(`getChatMessagesCursor ${chatId} ${flags} ${marker1before}`)
+    // The ids are always loaded off the main thread, without a callback
+    // a promise is returned
+    return callBinding(this, 'chat_msgs_cursor', [
+      Number(chatId),
+      flags || 0,
+      marker1before || 0
+    ], cb || new PromiseRequest(), cursor => new MessageCursor(cursor, this))
   }
 
   getChats (listFlags, queryStr, queryContactId) {
@@ -286,19 +428,16 @@ class DeltaChat extends EventEmitter {
     return result
   }
 
-  getChatList (listFlags, queryStr, queryContactId) {
+  getChatList (listFlags, queryStr, queryContactId, cb) {
     listFlags = listFlags || 0
     queryStr = queryStr || ''
     queryContactId = queryContactId || 0
     debug(`getChatList ${listFlags} ${queryStr} ${queryContactId}`)
-    return new ChatList(
-      binding.dcn_get_chatlist(
-        this.dcn_context,
-        listFlags,
-        queryStr,
-        Number(queryContactId)
-      )
-    )
+    return callBinding(this, 'get_chatlist', [
+      listFlags,
+      queryStr,
+      Number(queryContactId)
+    ], cb, dc_chatlist => new ChatList(dc_chatlist))
   }
 
   static getConfig (dir, cb) {
@@ -319,123 +458,192 @@ class DeltaChat extends EventEmitter {
     })
   }
 
-  getConfig (key) {
+  getChatListSnapshot (opts, cb) {
+    if (typeof opts === 'function') return this.getChatListSnapshot({}, opts)
+    opts = opts || {}
+    debug('getChatListSnapshot', opts)
+    return binding.dcn_chatlist_snapshot(
+      this.dcn_context,
+      opts.listFlags || 0,
+      opts.query || '',
+      Number(opts.queryContactId || 0),
+      Number(opts.offset || 0),
+      Number(opts.limit || 0),
+      typeof cb === 'function' ? snapshot => {
+        if (snapshot instanceof Error) return cb(snapshot)
+        cb(null, snapshot)
+      } : undefined,
+      priorityOf(cb)
+    )
+  }
+
+  getChatsInfo (chatIds, cb) {
+    chatIds = toIds(chatIds)
+    debug('getChatsInfo', chatIds.length)
+    return callBinding(this, 'get_chats_info', [ chatIds ], cb)
+  }
+
+  getConfig (key, cb) {
     debug(`getConfig ${key}`)
-    return binding.dcn_get_config(this.dcn_context, key)
+    return callBinding(this, 'get_config', [ key ], cb)
   }
 
-  getContact (contactId) {
+  getContact (contactId, cb) {
     debug(`getContact ${contactId}`)
-    const dc_contact = binding.dcn_get_contact(
-      this.dcn_context,
+    return callBinding(this, 'get_contact', [
       Number(contactId)
-    )
-    return dc_contact ? new Contact(dc_contact) : null
+    ], cb, dc_contact => {
+      return dc_contact ? new Contact(dc_contact) : null
+    })
   }
 
-  getContactEncryptionInfo (contactId) {
+  getContactEncryptionInfo (contactId, cb) {
     debug(`getContactEncryptionInfo ${contactId}`)
-    return binding.dcn_get_contact_encrinfo(this.dcn_context, Number(contactId))
+    return callBinding(this, 'get_contact_encrinfo', [ Number(contactId) ], cb)
   }
 
-  getContacts (listFlags, query) {
+  getContacts (listFlags, query, cb) {
     listFlags = listFlags || 0
     query = query || ''
     debug(`getContacts ${listFlags} ${query}`)
-    return binding.dcn_get_contacts(this.dcn_context, listFlags, query)
+    return callBinding(this, 'get_contacts', [
+      listFlags,
+      query
+    ], cb, ids => idArray(this, ids))
   }
 
-  getDraft (chatId) {
+  getContactsInfo (contactIds, cb) {
+    contactIds = toIds(contactIds)
+    debug('getContactsInfo', contactIds.length)
+    return callBinding(this, 'get_contacts_info', [ contactIds ], cb)
+  }
+
+  getDraft (chatId, cb) {
     debug(`getDraft ${chatId}`)
-    const dc_msg = binding.dcn_get_draft(this.dcn_context, Number(chatId))
-    return dc_msg ? new Message(dc_msg) : null
+    return callBinding(this, 'get_draft', [ Number(chatId) ], cb, dc_msg => {
+      return dc_msg ? new Message(dc_msg) : null
+    })
   }
 
-  getFreshMessageCount (chatId) {
+  getEventQueueStats () {
+    debug('getEventQueueStats')
+    return binding.dcn_get_event_queue_stats(this.dcn_context)
+  }
+
+  getEventStats () {
+    debug('getEventStats')
+    const stats = binding.dcn_get_event_stats(this.dcn_context)
+    return Object.keys(stats).reduce((result, code) => {
+      result[events[code] || code] = stats[code]
+      return result
+    }, {})
+  }
+
+  getFreshMessageCount (chatId, cb) {
     debug(`getFreshMessageCount ${chatId}`)
-    return binding.dcn_get_fresh_msg_cnt(this.dcn_context, Number(chatId))
+    return callBinding(this, 'get_fresh_msg_cnt', [ Number(chatId) ], cb)
   }
 
-  getFreshMessages () {
+  getFreshMessages (cb) {
     debug('getFreshMessages')
-    return binding.dcn_get_fresh_msgs(this.dcn_context)
+    return callBinding(this, 'get_fresh_msgs', [], cb, ids => idArray(this, ids))
+  }
+
+  static getHttpCacheStats () {
+    debug('DeltaChat.getHttpCacheStats')
+    return binding.dcn_get_http_cache_stats()
   }
 
-  getInfo () {
+  getInfo (cb) {
     debug('getInfo')
-    const result = {}
-
-    const regex = /^(\w+)=(.*)$/i
-    binding.dcn_get_info(this.dcn_context)
-      .split('\n')
-      .filter(Boolean)
-      .forEach(line => {
-        const match = regex.exec(line)
-        if (match) {
-          result[match[1]] = match[2]
-        }
-      })
+    return callBinding(this, 'get_info', [], cb, info => {
+      const result = {}
+
+      const regex = /^(\w+)=(.*)$/i
+      info
+        .split('\n')
+        .filter(Boolean)
+        .forEach(line => {
+          const match = regex.exec(line)
+          if (match) {
+            result[match[1]] = match[2]
+          }
+        })
 
-    return result
+      return result
+    })
   }
 
-  getMessage (messageId) {
+  getMessage (messageId, cb) {
     debug(`getMessage ${messageId}`)
-    const dc_msg = binding.dcn_get_msg(this.dcn_context, Number(messageId))
-    return dc_msg ? new Message(dc_msg) : null
+    return callBinding(this, 'get_msg', [ Number(messageId) ], cb, dc_msg => {
+      return dc_msg ? new Message(dc_msg) : null
+    })
   }
 
-  getMessageCount (chatId) {
+  getMessageCount (chatId, cb) {
     debug(`getMessageCount ${chatId}`)
-    return binding.dcn_get_msg_cnt(this.dcn_context, Number(chatId))
+    return callBinding(this, 'get_msg_cnt', [ Number(chatId) ], cb)
   }
 
-  getMessageInfo (messageId) {
+  getMessageInfo (messageId, cb) {
     debug(`getMessageInfo ${messageId}`)
-    return binding.dcn_get_msg_info(this.dcn_context, Number(messageId))
+    return callBinding(this, 'get_msg_info', [ Number(messageId) ], cb)
+  }
+
+  getMessages (messageIds, cb) {
+    messageIds = toIds(messageIds)
+    debug('getMessages', messageIds.length)
+    return callBinding(this, 'get_msgs', [ messageIds ], cb)
   }
 
-  getNextMediaMessage (messageId, msgType1, msgType2, msgType3) {
+  getNextMediaMessage (messageId, msgType1, msgType2, msgType3, cb) {
     debug(`getNextMediaMessage ${messageId} ${msgType1} ${msgType2} ${msgType3}`)
     return this._getNextMedia(
       messageId,
       1,
       msgType1,
       msgType2,
-      msgType3
+      msgType3,
+      cb
     )
   }
 
-  getPreviousMediaMessage (messageId, msgType1, msgType2, msgType3) {
+  getPreviousMediaMessage (messageId, msgType1, msgType2, msgType3, cb) {
     debug(`getPreviousMediaMessage ${messageId} ${msgType1} ${msgType2} ${msgType3}`)
     return this._getNextMedia(
       messageId,
       -1,
       msgType1,
       msgType2,
-      msgType3
+      msgType3,
+      cb
     )
   }
 
-  _getNextMedia (messageId, dir, msgType1, msgType2, msgType3) {
-    return binding.dcn_get_next_media(
-      this.dcn_context,
+  _getNextMedia (messageId, dir, msgType1, msgType2, msgType3, cb) {
+    return callBinding(this, 'get_next_media', [
       Number(messageId),
       dir,
       msgType1 || 0,
       msgType2 || 0,
       msgType3 || 0
-    )
+    ], cb)
   }
 
-  getSecurejoinQrCode (chatId) {
+  getSecurejoinQrCode (chatId, cb) {
     debug(`getSecurejoinQrCode ${chatId}`)
-    return binding.dcn_get_securejoin_qr(this.dcn_context, Number(chatId))
+    return callBinding(this, 'get_securejoin_qr', [ Number(chatId) ], cb)
   }
 
-  getStarredMessages () {
+  getStarredMessages (cb) {
     debug('getStarredMessages')
-    return this.getChatMessages(C.DC_CHAT_ID_STARRED, 0, 0)
+    return this.getChatMessages(C.DC_CHAT_ID_STARRED, 0, 0, cb)
+  }
+
+  static getWorkPoolStats () {
+    debug('DeltaChat.getWorkPoolStats')
+    return binding.dcn_get_work_pool_stats()
   }
 
   static getSystemInfo () {
@@ -454,40 +662,65 @@ class DeltaChat extends EventEmitter {
     return result
   }
 
-  importExport (what, param1, param2) {
+  importExport (what, param1, param2, opts, cb) {
+    if (typeof opts === 'function') return this.importExport(what, param1, param2, {}, opts)
+    opts = opts || {}
     debug(`importExport ${what} ${param1} ${param2}`)
-    binding.dcn_imex(this.dcn_context, what, param1, param2 || '')
+    const args = [ what, param1, param2 || '' ]
+    if (typeof cb !== 'function' && !(cb instanceof PromiseRequest)) {
+      binding.dcn_imex(this.dcn_context, ...args)
+      return
+    }
+    const progress = imexProgress(this, what, param1, opts.onProgress)
+    if (typeof cb === 'function') {
+      binding.dcn_imex_async(this.dcn_context, ...args, err => {
+        progress.stop()
+        cb(err)
+      })
+      return
+    }
+    return binding.dcn_imex_async(this.dcn_context, ...args, undefined, priorityOf(cb)).then(() => {
+      progress.stop()
+    }, err => {
+      progress.stop()
+      throw err
+    })
   }
 
-  importExportHasBackup (dir) {
+  importExportHasBackup (dir, cb) {
     debug(`importExportHasBackup ${dir}`)
-    return binding.dcn_imex_has_backup(this.dcn_context, dir)
+    return callBinding(this, 'imex_has_backup', [ dir ], cb)
   }
 
   initiateKeyTransfer (cb) {
     debug('initiateKeyTransfer')
-    return binding.dcn_initiate_key_transfer(this.dcn_context, statusCode => {
+    const error = () => new Error('Could not initiate key transfer')
+    if (typeof cb !== 'function') {
+      return binding.dcn_initiate_key_transfer(this.dcn_context, undefined, priorityOf(cb)).then(statusCode => {
+        if (typeof statusCode === 'string') return statusCode
+        throw error()
+      })
+    }
+    binding.dcn_initiate_key_transfer(this.dcn_context, statusCode => {
+      if (statusCode instanceof Error) return cb(statusCode)
       if (typeof statusCode === 'string') {
         return cb(null, statusCode)
       }
-      cb(new Error('Could not initiate key transfer'))
+      cb(error())
     })
   }
 
-  isConfigured () {
+  isConfigured (cb) {
     debug('isConfigured')
-    return Boolean(binding.dcn_is_configured(this.dcn_context))
+    return callBinding(this, 'is_configured', [], cb, Boolean)
   }
 
-  isContactInChat (chatId, contactId) {
+  isContactInChat (chatId, contactId, cb) {
     debug(`isContactInChat ${chatId} ${contactId}`)
-    return Boolean(
-      binding.dcn_is_contact_in_chat(
-        this.dcn_context,
-        Number(chatId),
-        Number(contactId)
-      )
-    )
+    return callBinding(this, 'is_contact_in_chat', [
+      Number(chatId),
+      Number(contactId)
+    ], cb, Boolean)
   }
 
   isOpen () {
@@ -495,42 +728,52 @@ class DeltaChat extends EventEmitter {
     return Boolean(binding.dcn_is_open(this.dcn_context))
   }
 
-  // TODO this should most likely be async, see
-  // https://c.delta.chat/classdc__context__t.html#ae49176cbc26d4d40d52de4f5301d1fa7
-  joinSecurejoin (qrCode) {
+  joinSecurejoin (qrCode, cb) {
     debug(`joinSecurejoin ${qrCode}`)
-    return binding.dcn_join_securejoin(this.dcn_context, qrCode)
+    return callBinding(this, 'join_securejoin', [ qrCode ], cb)
   }
 
-  lookupContactIdByAddr (addr) {
-    debug(`lookupContactIdByAddr ${addr}`)
-    return Boolean(
-      binding.dcn_lookup_contact_id_by_addr(this.dcn_context, addr)
+  loadStringTable (strings) {
+    debug('loadStringTable')
+    return binding.dcn_load_string_table(
+      this.dcn_context,
+      StringTable.toArray(strings)
     )
   }
 
-  markNoticedChat (chatId) {
+  loadStringTableFile (file) {
+    debug(`loadStringTableFile ${file}`)
+    const result = binding.dcn_load_string_table_file(this.dcn_context, file)
+    if (result < 0) {
+      throw new Error(`Cannot read string table ${file}`)
+    }
+    return result
+  }
+
+  lookupContactIdByAddr (addr, cb) {
+    debug(`lookupContactIdByAddr ${addr}`)
+    return callBinding(this, 'lookup_contact_id_by_addr', [ addr ], cb, Boolean)
+  }
+
+  markNoticedChat (chatId, cb) {
     debug(`markNoticedChat ${chatId}`)
-    binding.dcn_marknoticed_chat(this.dcn_context, Number(chatId))
+    return callBinding(this, 'marknoticed_chat', [ Number(chatId) ], cb)
   }
 
-  markNoticedAllChats () {
+  markNoticedAllChats (cb) {
     debug('markNoticedAllChats')
-    binding.dcn_marknoticed_all_chats(this.dcn_context)
+    return callBinding(this, 'marknoticed_all_chats', [], cb)
   }
 
-  markNoticedContact (contactId) {
+  markNoticedContact (contactId, cb) {
     debug(`markNoticedContact ${contactId}`)
-    binding.dcn_marknoticed_contact(this.dcn_context, Number(contactId))
+    return callBinding(this, 'marknoticed_contact', [ Number(contactId) ], cb)
   }
 
-  markSeenMessages (messageIds) {
-    if (!Array.isArray(messageIds)) {
-      messageIds = [ messageIds ]
-    }
-    messageIds = messageIds.map(id => Number(id))
-    debug('markSeenMessages', messageIds)
-    binding.dcn_markseen_msgs(this.dcn_context, messageIds)
+  markSeenMessages (messageIds, cb) {
+    messageIds = toIds(messageIds)
+    debug('markSeenMessages', messageIds.length)
+    return callBinding(this, 'markseen_msgs', [ messageIds ], cb)
   }
 
   static maybeValidAddr (addr) {
@@ -563,35 +806,44 @@ class DeltaChat extends EventEmitter {
       const db = path.join(cwd, 'db.sqlite')
       binding.dcn_open(this.dcn_context, db, '', err => {
         if (err) return cb(err)
+        this._dbFile = db
+        binding.dcn_set_event_handler(this.dcn_context, batch => {
+          handleEvents(this, batch)
+        })
         binding.dcn_start_threads(this.dcn_context)
 
-        // TODO temporary timer for polling events
-        this._pollInterval = setInterval(() => {
-          const event = binding.dcn_poll_event(this.dcn_context)
-          if (event) {
-            handleEvent(this, event.event, event.data1, event.data2)
-          }
-        }, 50)
-
         cb()
       })
     })
   }
 
-  removeContactFromChat (chatId, contactId) {
+  removeContactFromChat (chatId, contactId, cb) {
     debug(`removeContactFromChat ${chatId} ${contactId}`)
-    return Boolean(
-      binding.dcn_remove_contact_from_chat(
-        this.dcn_context,
-        Number(chatId),
-        Number(contactId)
-      )
+    return callBinding(this, 'remove_contact_from_chat', [
+      Number(chatId),
+      Number(contactId)
+    ], cb, Boolean)
+  }
+
+  replayEventJournal (file, opts, cb) {
+    if (typeof opts === 'function') return this.replayEventJournal(file, {}, opts)
+    opts = opts || {}
+    debug(`replayEventJournal ${file}`)
+    const speed = typeof opts.speed === 'number' ? opts.speed : 1
+    return binding.dcn_replay_event_journal(
+      this.dcn_context,
+      file,
+      speed,
+      typeof cb === 'function' ? cb : undefined
     )
   }
 
-  searchMessages (chatId, query) {
+  searchMessages (chatId, query, cb) {
     debug(`searchMessages ${chatId} ${query}`)
-    return binding.dcn_search_msgs(this.dcn_context, Number(chatId), query)
+    return callBinding(this, 'search_msgs', [
+      Number(chatId),
+      query
+    ], cb, ids => idArray(this, ids))
   }
 
   sendMessage (chatId, msg) {
@@ -610,31 +862,25 @@ class DeltaChat extends EventEmitter {
     return binding.dcn_send_msg(this.dcn_context, Number(chatId), msg.dc_msg)
   }
 
-  setChatName (chatId, name) {
+  setChatName (chatId, name, cb) {
     debug(`setChatName ${chatId} ${name}`)
-    return Boolean(
-      binding.dcn_set_chat_name(
-        this.dcn_context,
-        Number(chatId),
-        name
-      )
-    )
+    return callBinding(this, 'set_chat_name', [
+      Number(chatId),
+      name
+    ], cb, Boolean)
   }
 
-  setChatProfileImage (chatId, image) {
+  setChatProfileImage (chatId, image, cb) {
     debug(`setChatProfileImage ${chatId} ${image}`)
-    return Boolean(
-      binding.dcn_set_chat_profile_image(
-        this.dcn_context,
-        Number(chatId),
-        image || ''
-      )
-    )
+    return callBinding(this, 'set_chat_profile_image', [
+      Number(chatId),
+      image || ''
+    ], cb, Boolean)
   }
 
-  setConfig (key, value) {
+  setConfig (key, value, cb) {
     debug(`setConfig ${key} ${value}`)
-    return binding.dcn_set_config(this.dcn_context, key, value || '')
+    return callBinding(this, 'set_config', [ key, value || '' ], cb)
   }
 
   setDraft (chatId, msg) {
@@ -646,18 +892,220 @@ class DeltaChat extends EventEmitter {
     )
   }
 
+  setSharedStringTable (table) {
+    debug('setSharedStringTable')
+    if (table && !(table instanceof StringTable)) {
+      throw new Error('invalid table, expected a StringTable')
+    }
+    const attached = binding.dcn_set_shared_string_table(
+      this.dcn_context,
+      table ? table.dc_strtable : null
+    )
+    if (!attached) {
+      throw new Error('Cannot attach the string table')
+    }
+  }
+
   setStringTable (index, str) {
+    if (typeof index === 'object') {
+      debug('setStringTable')
+      return binding.dcn_merge_string_table(this.dcn_context, StringTable.toArray(index))
+    }
     debug(`setStringTable ${index} ${str}`)
     binding.dcn_set_string_table(this.dcn_context, Number(index), str)
   }
 
-  starMessages (messageIds, star) {
-    if (!Array.isArray(messageIds)) {
-      messageIds = [ messageIds ]
+  starMessages (messageIds, star, cb) {
+    messageIds = toIds(messageIds)
+    debug('starMessages', messageIds.length)
+    return callBinding(this, 'star_msgs', [ messageIds, star ? 1 : 0 ], cb)
+  }
+
+  startEventJournal (file) {
+    debug(`startEventJournal ${file}`)
+    if (!binding.dcn_start_event_journal(this.dcn_context, file)) {
+      throw new Error(`Cannot create event journal ${file}`)
+    }
+  }
+
+  stopEventJournal () {
+    debug('stopEventJournal')
+    return binding.dcn_stop_event_journal(this.dcn_context)
+  }
+
+  stopEventReplay () {
+    debug('stopEventReplay')
+    binding.dcn_stop_event_replay(this.dcn_context)
+  }
+
+  stopOngoingProcess () {
+    debug('stopOngoingProcess')
+    binding.dcn_stop_ongoing_process(this.dcn_context)
+  }
+}
+
+/**
+ * Calls a context binding on the main thread, or through its _async
+ * variant on the threadpool when a callback is given. The result is
+ * passed through map in all cases. With a PromiseRequest as callback the
+ * _async variant returns a promise instead.
+ */
+function callBinding (self, name, args, cb, map) {
+  if (cb instanceof PromiseRequest) {
+    const promise = binding[`dcn_${name}_async`](self.dcn_context, ...args, undefined, cb.priority)
+    return map ? promise.then(map) : promise
+  }
+  map = map || (result => result)
+  if (typeof cb === 'function') {
+    binding[`dcn_${name}_async`](self.dcn_context, ...args, result => {
+      // Called back with the error if completing the call failed
+      if (result instanceof Error) return cb(result)
+      cb(null, map(result))
+    })
+    return
+  }
+  return map(binding[`dcn_${name}`](self.dcn_context, ...args))
+}
+
+/**
+ * Builds dc.promises, which has the methods with a trailing callback
+ * returning a promise instead. With a priority the calls are queued in
+ * that class, it is passed to the bindings along with the PromiseRequest.
+ */
+function promiseMethods (self, priority) {
+  const request = new PromiseRequest(priority)
+  return PROMISE_METHODS.reduce((promises, name) => {
+    const method = self[name]
+    const arity = method.length - 1
+    promises[name] = (...args) => {
+      args.length = arity
+      return method.call(self, ...args, request)
+    }
+    return promises
+  }, {})
+}
+
+/**
+ * The priority class requested by a callback argument, undefined for the
+ * default class of the binding
+ */
+function priorityOf (cb) {
+  return cb instanceof PromiseRequest ? cb.priority : undefined
+}
+
+/**
+ * Ids are passed to native code as Uint32Array, which is read there
+ * without a copy
+ */
+const INTEGER_ARRAYS = [
+  Int8Array, Uint8Array, Uint8ClampedArray, Int16Array, Uint16Array, Int32Array
+]
+
+function toIds (ids) {
+  if (ids instanceof Uint32Array) return ids
+  // The binding copies the other integer typed arrays in one go
+  if (INTEGER_ARRAYS.some(type => ids instanceof type)) return ids
+  if (!Array.isArray(ids)) ids = [ ids ]
+  return Uint32Array.from(ids, id => Number(id))
+}
+
+/**
+ * Turns DC_EVENT_IMEX_PROGRESS into throughput estimates for a running
+ * import or export. Core reports permille of the files processed, bytes
+ * are estimated from the size of the backup or of the blobs.
+ */
+function imexProgress (self, what, file, onProgress) {
+  if (typeof onProgress !== 'function') return { stop () {} }
+  const start = Date.now()
+  let totalBytes = null
+  imexSize(self, what, file, size => { totalBytes = size })
+
+  const listener = permille => {
+    // 0 signals an error, which fails the import/export anyway
+    if (permille === 0) return
+    const seconds = (Date.now() - start) / 1000
+    const progress = {
+      permille,
+      seconds,
+      eta: seconds * (1000 - permille) / permille,
+      bytes: null,
+      totalBytes,
+      bytesPerSecond: null
+    }
+    if (totalBytes !== null) {
+      progress.bytes = Math.round(totalBytes * permille / 1000)
+      progress.bytesPerSecond = seconds > 0 ? progress.bytes / seconds : null
+    }
+    onProgress(progress)
+  }
+  self.on('DC_EVENT_IMEX_PROGRESS', listener)
+  return {
+    stop () {
+      self.removeListener('DC_EVENT_IMEX_PROGRESS', listener)
+    }
+  }
+}
+
+function imexSize (self, what, file, cb) {
+  if (what === C.DC_IMEX_IMPORT_BACKUP) {
+    return fs.stat(file, (err, stat) => cb(err ? null : stat.size))
+  }
+  if (what !== C.DC_IMEX_EXPORT_BACKUP) return cb(null)
+
+  // A backup holds the database along with the blobs
+  const blobdir = self.getBlobdir()
+  fs.readdir(blobdir, (err, names) => {
+    if (err) return cb(null)
+    const files = names.map(name => path.join(blobdir, name))
+    if (self._dbFile) files.push(self._dbFile)
+    let size = 0
+    let pending = files.length
+    if (pending === 0) return cb(0)
+    files.forEach(file => {
+      fs.stat(file, (err, stat) => {
+        if (!err && stat.isFile()) size += stat.size
+        if (--pending === 0) cb(size)
+      })
+    })
+  })
+}
+
+/**
+ * Lists of ids come as Uint32Array from native code, plain arrays are kept
+ * for compatibility unless opts.typedArrays was set
+ */
+function idArray (self, ids) {
+  return self.typedArrays ? ids : Array.from(ids)
+}
+
+/**
+ * Dispatches a batch of events as produced by the native side. See
+ * eventqueue_items_to_js() in src/module.c for the layout.
+ */
+function handleEvents (self, batch) {
+  const { event, data1, data2, strings, emitted } = batch
+  // Only part of the batch with opts.eventStats
+  const start = emitted && process.hrtime()
+  for (let i = 0; i < event.length; i++) {
+    const str1 = strings[2 * i]
+    const str2 = strings[2 * i + 1]
+    if (emitted) {
+      // Microseconds since the batch arrived, for the dispatch latency
+      // in getEventStats()
+      const elapsed = process.hrtime(start)
+      emitted[i] = elapsed[0] * 1e6 + elapsed[1] / 1e3
+    }
+    try {
+      handleEvent(
+        self,
+        event[i],
+        str1 !== undefined ? str1 : data1[i],
+        str2 !== undefined ? str2 : data2[i]
+      )
+    } catch (err) {
+      // Native code can't report this, rethrow outside of it
+      setImmediate(() => { throw err })
     }
-    messageIds = messageIds.map(id => Number(id))
-    debug('starMessages', messageIds)
-    binding.dcn_star_msgs(this.dcn_context, messageIds, star ? 1 : 0)
   }
 }
 
@@ -668,15 +1116,15 @@ function handleEvent (self, event, data1, data2) {
 
   const eventStr = events[event]
 
-  async function handleHttpGetEvent (url) {
+  async function handleHttpGetEvent (url, requestId) {
     try {
-      debug(`handleHttpGetEvent ${url}`)
+      debug(`handleHttpGetEvent ${requestId} ${url}`)
       const response = await got(url, {})
       debug('handleHttpGetEvent response.body', response.body)
-      binding.dcn_set_http_get_response(self.dcn_context, response.body)
+      binding.dcn_set_http_get_response(self.dcn_context, requestId, response.body)
     } catch (err) {
       debug('handleHttpGetEvent err', err)
-      binding.dcn_set_http_get_response(self.dcn_context, '')
+      binding.dcn_set_http_get_response(self.dcn_context, requestId, null)
     }
   }
 
@@ -743,11 +1191,57 @@ function handleEvent (self, event, data1, data2) {
       self.emit(eventStr, data1, data2)
       break
     case 'DC_EVENT_HTTP_GET': // 2100
-      handleHttpGetEvent(data1)
+      handleHttpGetEvent(data1, data2)
       break
     default:
       debug(`Unknown event ${eventStr}`)
   }
 }
 
+// Keeps the native event mask in sync with the listeners, so that the core
+// threads don't even copy events nobody listens to
+function trackEventListeners (self) {
+  let tracking = true
+  const onNewListener = name => updateEventMask(self, name)
+  const onRemoveListener = (name, listener) => {
+    if (!tracking) return
+    if (name === 'newListener' && listener === onNewListener) {
+      // Someone removed all listeners, deliver everything from now on
+      tracking = false
+      binding.dcn_set_event_mask(self.dcn_context, ALL_EVENTS)
+      return
+    }
+    updateEventMask(self)
+  }
+  self.on('newListener', onNewListener)
+  self.on('removeListener', onRemoveListener)
+  updateEventMask(self)
+}
+
+function updateEventMask (self, added) {
+  const names = self.eventNames().concat(added || [])
+  if (names.includes('ALL')) {
+    return binding.dcn_set_event_mask(self.dcn_context, ALL_EVENTS)
+  }
+  // Always needed internally by configure() and for HTTP requests
+  const codes = [C.DC_EVENT_CONFIGURE_PROGRESS, C.DC_EVENT_HTTP_GET]
+  names.forEach(name => {
+    if (typeof name === 'string' && name.startsWith('DC_EVENT_') && C[name]) {
+      codes.push(C[name])
+    }
+  })
+  binding.dcn_set_event_mask(self.dcn_context, codes)
+}
+
+function eventQueuePolicy (overflow) {
+  return [].concat(overflow).reduce((policy, name) => {
+    if (!EVENT_QUEUE_OVERFLOW[name]) {
+      throw new Error(`Unknown event queue overflow policy ${name}`)
+    }
+    return policy | EVENT_QUEUE_OVERFLOW[name]
+  }, 0)
+}
+
 module.exports = DeltaChat
+module.exports.MessageCursor = MessageCursor
+module.exports.StringTable = StringTable
@@ -0,0 +1,45 @@
+/* eslint-disable camelcase */
+
+const binding = require('./binding')
+const debug = require('debug')('deltachat:messagecursor')
+
+/**
+ * Wrapper around dcn_msg_cursor_t*, walks the messages of a chat a
+ * window at a time and reads the next window in advance
+ */
+class MessageCursor {
+  constructor (dc_msg_cursor, dc) {
+    debug('MessageCursor constructor')
+    this.dc_msg_cursor = dc_msg_cursor
+    // Messages are read through the context, keep it alive
+    this.dc = dc
+  }
+
+  getCount () {
+    debug('getCount')
+    return binding.dcn_msg_cursor_get_cnt(this.dc_msg_cursor)
+  }
+
+  next (count, cb) {
+    debug(`next ${count}`)
+    binding.dcn_msg_cursor_next(this.dc_msg_cursor, Number(count), (messages, ids) => {
+      if (messages instanceof Error) return cb(messages)
+      cb(null, messages, this.dc.typedArrays ? ids : Array.from(ids))
+    })
+  }
+
+  prev (count, cb) {
+    debug(`prev ${count}`)
+    binding.dcn_msg_cursor_prev(this.dc_msg_cursor, Number(count), (messages, ids) => {
+      if (messages instanceof Error) return cb(messages)
+      cb(null, messages, this.dc.typedArrays ? ids : Array.from(ids))
+    })
+  }
+
+  seek (messageId) {
+    debug(`seek ${messageId}`)
+    return binding.dcn_msg_cursor_seek(this.dc_msg_cursor, Number(messageId))
+  }
+}
+
+module.exports = MessageCursor
@@ -22,26 +22,206 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <deltachat.h>
 #include "eventqueue.h"
 
 
+/*
+ * The eventqueue is a bounded ring buffer for many producers (the core
+ * threads calling the event handler) and a single consumer (the JavaScript
+ * main thread). Pushing does not take any lock and does not allocate an
+ * item, see Dmitry Vyukov's bounded MPMC queue for the idea. Every cell has
+ * a sequence number telling whether it is free for the push with the same
+ * position (sequence==pos) or holds an item for the pop at that position
+ * (sequence==pos+1).
+ *
+ * The overflow policies and coalescing are a slow path on top of that: they
+ * take `lock`, and with EVENTQUEUE_DROP_OLDEST_LOG or EVENTQUEUE_COALESCE the
+ * consumer takes it as well while popping, so that a producer may remove
+ * events from the head of the ring and the table of pending coalescable
+ * events stays in sync with the ring.
+ */
+
+
+#define EVENTQUEUE_IS_LOG(e)          ((e)==DC_EVENT_INFO || (e)==DC_EVENT_WARNING)
+#define EVENTQUEUE_CAN_COALESCE(e)    ((e)==DC_EVENT_MSGS_CHANGED || (e)==DC_EVENT_CONTACTS_CHANGED || (e)==DC_EVENT_CHAT_MODIFIED)
+
+
+typedef struct eventqueue_cell_t {
+	atomic_size_t     sequence;
+	eventqueue_item_t item;
+} eventqueue_cell_t;
+
+
 typedef struct eventqueue_t {
-	pthread_mutex_t    mutex;
-	eventqueue_item_t* first;
+	eventqueue_cell_t* cells;
+	size_t             mask;
+	int                policy;
+	int                consumer_locks;
+	pthread_t          consumer;
+	strpool_t*         strpool;
+
+	pthread_mutex_t    lock;
+	pthread_cond_t     not_full;
+	atomic_int         waiters;
+
+	// coalescable events currently in the ring, open addressing,
+	// an entry with event==0 is free
+	eventqueue_item_t* pending;
+	size_t             pending_mask;
+
+	atomic_uint_least64_t dropped;
+	atomic_uint_least64_t coalesced;
+	atomic_uint_least64_t delivered;
+	atomic_uint_least64_t batches;
+	atomic_size_t         max_depth;
+
+	// written by producers only, keep it apart from the consumer fields
+	char               pad0_[64];
+	atomic_size_t      enqueue_pos;
+	char               pad1_[64];
+
+	// owned by the consumer, atomic only for eventqueue_get_stats()
+	atomic_size_t      dequeue_pos;
+	eventqueue_item_t* batch;
 } eventqueue_t;
 
 
-eventqueue_t* eventqueue_new()
+/*******************************************************************************
+ * Pending coalescable events
+ ******************************************************************************/
+
+
+static size_t pending_hash(const eventqueue_item_t* item)
+{
+	uint64_t h = (uint64_t)item->event*0x9E3779B97F4A7C15ULL;
+	h ^= (uint64_t)item->data1 + 0x7F4A7C15ULL + (h<<6) + (h>>2);
+	h ^= (uint64_t)item->data2 + 0x9E3779B9ULL + (h<<6) + (h>>2);
+	return (size_t)(h ^ (h>>31));
+}
+
+
+static int pending_equals(const eventqueue_item_t* a, int event, uintptr_t data1, uintptr_t data2)
+{
+	return a->event==event && a->data1==data1 && a->data2==data2;
+}
+
+
+/* returns the index of the entry or of the free slot where it belongs */
+static size_t pending_lookup(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
+{
+	eventqueue_item_t key = { event, data1, data2, 0 };
+	size_t i = pending_hash(&key) & eventqueue->pending_mask;
+
+	while (eventqueue->pending[i].event
+	    && !pending_equals(&eventqueue->pending[i], event, data1, data2)) {
+		i = (i+1) & eventqueue->pending_mask;
+	}
+
+	return i;
+}
+
+
+static void pending_remove(eventqueue_t* eventqueue, const eventqueue_item_t* item)
+{
+	eventqueue_item_t* pending = eventqueue->pending;
+	size_t             mask = eventqueue->pending_mask;
+	size_t             i = pending_lookup(eventqueue, item->event, item->data1, item->data2);
+
+	if (pending[i].event==0) {
+		return;
+	}
+
+	// backward shift deletion, move up the entries that probed past `i`
+	for (;;) {
+		pending[i].event = 0;
+		size_t j = i;
+		for (;;) {
+			j = (j+1) & mask;
+			if (pending[j].event==0) {
+				return;
+			}
+			size_t k = pending_hash(&pending[j]) & mask;
+			if ((i<=j)? (i<k && k<=j) : (i<k || k<=j)) {
+				continue; // entry j is still reachable from its home slot
+			}
+			break;
+		}
+		pending[i] = pending[j];
+		i = j;
+	}
+}
+
+
+/*******************************************************************************
+ * Main interface
+ ******************************************************************************/
+
+
+/**
+ * Create a new eventqueue that holds up to `capacity` events.
+ * The capacity is rounded up to the next power of two,
+ * 0 selects EVENTQUEUE_DEFAULT_CAPACITY. `policy` is a combination of the
+ * EVENTQUEUE_DROP_OLDEST_LOG, EVENTQUEUE_BLOCK and EVENTQUEUE_COALESCE flags.
+ * The calling thread becomes the consumer of the eventqueue; it is never
+ * blocked by EVENTQUEUE_BLOCK as this would deadlock.
+ */
+eventqueue_t* eventqueue_new(size_t capacity, int policy)
 {
 	eventqueue_t* eventqueue = calloc(1, sizeof(eventqueue_t));
 	if (eventqueue==NULL) {
 		exit(666);
 	}
 
-	pthread_mutex_init(&eventqueue->mutex, NULL);
-	eventqueue->first = NULL;
+	if (capacity==0) {
+		capacity = EVENTQUEUE_DEFAULT_CAPACITY;
+	}
+
+	size_t size = 2;
+	while (size < capacity) {
+		size <<= 1;
+	}
+
+	eventqueue->cells = calloc(size, sizeof(eventqueue_cell_t));
+	eventqueue->batch = calloc(size, sizeof(eventqueue_item_t));
+	if (eventqueue->cells==NULL || eventqueue->batch==NULL) {
+		exit(666);
+	}
+
+	for (size_t i=0; i<size; i++) {
+		atomic_init(&eventqueue->cells[i].sequence, i);
+	}
+
+	eventqueue->mask = size-1;
+	eventqueue->policy = policy;
+	eventqueue->consumer_locks = (policy & (EVENTQUEUE_DROP_OLDEST_LOG|EVENTQUEUE_COALESCE))!=0;
+	eventqueue->consumer = pthread_self();
+	eventqueue->strpool = strpool_new();
+
+	if (policy & EVENTQUEUE_COALESCE) {
+		// at most `size` entries, so there is always a free slot
+		eventqueue->pending = calloc(size*2, sizeof(eventqueue_item_t));
+		if (eventqueue->pending==NULL) {
+			exit(666);
+		}
+		eventqueue->pending_mask = size*2-1;
+	}
+
+	pthread_mutex_init(&eventqueue->lock, NULL);
+	pthread_cond_init(&eventqueue->not_full, NULL);
+	atomic_init(&eventqueue->waiters, 0);
+	atomic_init(&eventqueue->dropped, 0);
+	atomic_init(&eventqueue->coalesced, 0);
+
+	atomic_init(&eventqueue->enqueue_pos, 0);
+	atomic_init(&eventqueue->dequeue_pos, 0);
+	atomic_init(&eventqueue->delivered, 0);
+	atomic_init(&eventqueue->batches, 0);
+	atomic_init(&eventqueue->max_depth, 0);
 
 	return eventqueue;
 }
@@ -56,91 +236,387 @@ void eventqueue_unref(eventqueue_t* eventqueue)
 		return;
 	}
 
-	eventqueue_item_t* item = NULL;
-	while ((item=eventqueue_pop(eventqueue))!=NULL) {
-		eventqueue_item_unref(item);
+	eventqueue_item_t item;
+	while (eventqueue_pop(eventqueue, &item)) {
+		eventqueue_item_clear(eventqueue, &item);
 	}
 
-	pthread_mutex_destroy(&eventqueue->mutex);
-
+	pthread_cond_destroy(&eventqueue->not_full);
+	pthread_mutex_destroy(&eventqueue->lock);
+	free(eventqueue->pending);
+	strpool_unref(eventqueue->strpool);
+	free(eventqueue->cells);
+	free(eventqueue->batch);
 	free(eventqueue);
 }
 
 
-/**
- * Add event to eventqueue. If data1/data2 contain strings, they're copied
- */
-void eventqueue_push(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
+/* lock-free part of eventqueue_push(), returns 0 if the ring is full */
+static int try_push(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
 {
-	if (eventqueue==NULL) {
-		return;
+	eventqueue_cell_t* cell = NULL;
+	size_t             pos = atomic_load_explicit(&eventqueue->enqueue_pos, memory_order_relaxed);
+
+	// claim a cell
+	for (;;) {
+		cell = &eventqueue->cells[pos & eventqueue->mask];
+		size_t   sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff==0) {
+			if (atomic_compare_exchange_weak_explicit(&eventqueue->enqueue_pos, &pos, pos+1,
+			                                          memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff<0) {
+			return 0; // full, the consumer has not freed this cell yet
+		}
+		else {
+			pos = atomic_load_explicit(&eventqueue->enqueue_pos, memory_order_relaxed);
+		}
 	}
 
-	eventqueue_item_t* new_item = calloc(1, sizeof(eventqueue_item_t));
-	if (new_item==NULL) {
-		exit(666);
+	cell->item.event = event;
+	cell->item.timestamp = eventqueue_now();
+	cell->item.data1 = (data1 && DC_EVENT_DATA1_IS_STRING(event))? (uintptr_t)strpool_strdup(eventqueue->strpool, (const char*)data1) : data1;
+	cell->item.data2 = (data2 && DC_EVENT_DATA2_IS_STRING(event))? (uintptr_t)strpool_strdup(eventqueue->strpool, (const char*)data2) : data2;
+
+	// publish the cell to the consumer
+	atomic_store_explicit(&cell->sequence, pos+1, memory_order_release);
+
+	return 1;
+}
+
+
+/* Drop the oldest log event and move the events before it up by one cell,
+ * which frees the cell at the head of the ring. Must be called with `lock`
+ * held. Returns 0 if there is no log event in the ring. */
+static int drop_oldest_log(eventqueue_t* eventqueue)
+{
+	size_t head = atomic_load_explicit(&eventqueue->dequeue_pos, memory_order_relaxed);
+	size_t pos = head;
+
+	for (;;) {
+		if (pos-head > eventqueue->mask) {
+			return 0;
+		}
+		eventqueue_cell_t* cell = &eventqueue->cells[pos & eventqueue->mask];
+		if (atomic_load_explicit(&cell->sequence, memory_order_acquire)!=pos+1) {
+			return 0; // not published yet, everything behind is newer anyway
+		}
+		if (EVENTQUEUE_IS_LOG(cell->item.event)) {
+			break;
+		}
+		pos++;
 	}
 
-	new_item->event = event;
-	new_item->data1 = (data1 && DC_EVENT_DATA1_IS_STRING(event))? (uintptr_t)strdup((const char*)data1) : data1;
-	new_item->data2 = (data2 && DC_EVENT_DATA2_IS_STRING(event))? (uintptr_t)strdup((const char*)data2) : data2;
-	new_item->next_ = NULL;
+	eventqueue_item_clear(eventqueue, &eventqueue->cells[pos & eventqueue->mask].item);
+	for (; pos!=head; pos--) {
+		eventqueue->cells[pos & eventqueue->mask].item = eventqueue->cells[(pos-1) & eventqueue->mask].item;
+	}
 
-	// add event to end of list
-	pthread_mutex_lock(&eventqueue->mutex);
-		if (eventqueue->first) {
-			eventqueue_item_t* cur = eventqueue->first;
-			while (cur->next_) {
-				cur = cur->next_;
-			}
-			cur->next_ = new_item;
+	atomic_store_explicit(&eventqueue->cells[head & eventqueue->mask].sequence, head+eventqueue->mask+1, memory_order_release);
+	atomic_store_explicit(&eventqueue->dequeue_pos, head+1, memory_order_relaxed);
+
+	atomic_fetch_add_explicit(&eventqueue->dropped, 1, memory_order_relaxed);
+	return 1;
+}
+
+
+/* Slow path of eventqueue_push() for a full ring, applies the overflow
+ * policy. Must be called with `lock` held. */
+static int push_full(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
+{
+	int             may_block = (eventqueue->policy & EVENTQUEUE_BLOCK)
+	                         && !pthread_equal(pthread_self(), eventqueue->consumer);
+	struct timespec deadline;
+
+	if (may_block) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec  += EVENTQUEUE_BLOCK_TIMEOUT_MS/1000;
+		deadline.tv_nsec += (EVENTQUEUE_BLOCK_TIMEOUT_MS%1000)*1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
 		}
-		else {
-			eventqueue->first = new_item;
+	}
+
+	for (;;) {
+		if (try_push(eventqueue, event, data1, data2)) {
+			return 1;
 		}
-	pthread_mutex_unlock(&eventqueue->mutex);
 
+		if ((eventqueue->policy & EVENTQUEUE_DROP_OLDEST_LOG) && drop_oldest_log(eventqueue)) {
+			continue;
+		}
+
+		if (may_block) {
+			// announce the waiter before the last try, the consumer checks
+			// `waiters` after freeing cells, so no wakeup gets lost
+			atomic_fetch_add(&eventqueue->waiters, 1);
+			atomic_thread_fence(memory_order_seq_cst);
+			int queued = try_push(eventqueue, event, data1, data2);
+			if (!queued && pthread_cond_timedwait(&eventqueue->not_full, &eventqueue->lock, &deadline)==ETIMEDOUT) {
+				may_block = 0;
+			}
+			atomic_fetch_sub(&eventqueue->waiters, 1);
+			if (queued) {
+				return 1;
+			}
+			continue;
+		}
+
+		atomic_fetch_add_explicit(&eventqueue->dropped, 1, memory_order_relaxed);
+		return 0;
+	}
+}
+
+
+/* eventqueue_push() and eventqueue_try_push(), the overflow policy is only
+ * applied with `apply_policy` set, otherwise a full ring just returns 0 */
+static int push(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2, int apply_policy)
+{
+	if (eventqueue==NULL) {
+		return 0;
+	}
+
+	if ((eventqueue->policy & EVENTQUEUE_COALESCE) && EVENTQUEUE_CAN_COALESCE(event)) {
+		pthread_mutex_lock(&eventqueue->lock);
+			size_t i = pending_lookup(eventqueue, event, data1, data2);
+			int    queued = 1;
+			if (eventqueue->pending[i].event) {
+				atomic_fetch_add_explicit(&eventqueue->coalesced, 1, memory_order_relaxed);
+			}
+			else {
+				queued = try_push(eventqueue, event, data1, data2)
+				      || (apply_policy && push_full(eventqueue, event, data1, data2));
+				if (queued) {
+					// look up again, push_full() may have waited on the lock
+					i = pending_lookup(eventqueue, event, data1, data2);
+					eventqueue->pending[i].event = event;
+					eventqueue->pending[i].data1 = data1;
+					eventqueue->pending[i].data2 = data2;
+				}
+			}
+		pthread_mutex_unlock(&eventqueue->lock);
+		return queued;
+	}
+
+	if (try_push(eventqueue, event, data1, data2)) {
+		return 1;
+	}
+
+	if (!apply_policy) {
+		return 0;
+	}
+
+	if ((eventqueue->policy & (EVENTQUEUE_DROP_OLDEST_LOG|EVENTQUEUE_BLOCK))==0) {
+		atomic_fetch_add_explicit(&eventqueue->dropped, 1, memory_order_relaxed);
+		return 0;
+	}
+
+	pthread_mutex_lock(&eventqueue->lock);
+		int queued = push_full(eventqueue, event, data1, data2);
+	pthread_mutex_unlock(&eventqueue->lock);
+	return queued;
+}
+
+
+/**
+ * Add event to eventqueue. If data1/data2 contain strings, they're copied.
+ * May be called from any thread. Returns 1 if the event was queued (or
+ * coalesced with a pending one) and 0 if the eventqueue is full and the
+ * event was dropped according to the overflow policy.
+ */
+int eventqueue_push(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
+{
+	return push(eventqueue, event, data1, data2, 1);
+}
+
+
+/**
+ * Like eventqueue_push(), but if the eventqueue is full, 0 is returned
+ * right away without applying the overflow policy. The event is not
+ * counted as dropped, as the caller still owns it and may retry.
+ */
+int eventqueue_try_push(eventqueue_t* eventqueue, int event, uintptr_t data1, uintptr_t data2)
+{
+	return push(eventqueue, event, data1, data2, 0);
+}
+
+
+/* eventqueue_pop() without locking and waking up producers */
+static int pop_one(eventqueue_t* eventqueue, eventqueue_item_t* item)
+{
+	size_t             pos = atomic_load_explicit(&eventqueue->dequeue_pos, memory_order_relaxed);
+	eventqueue_cell_t* cell = &eventqueue->cells[pos & eventqueue->mask];
+	size_t             sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+
+	if ((intptr_t)sequence - (intptr_t)(pos+1) < 0) {
+		return 0; // empty or the producer has not published the cell yet
+	}
+
+	*item = cell->item;
+
+	if (eventqueue->pending && EVENTQUEUE_CAN_COALESCE(item->event)) {
+		pending_remove(eventqueue, item);
+	}
+
+	// hand the cell back to the producers for the next round
+	atomic_store_explicit(&cell->sequence, pos+eventqueue->mask+1, memory_order_release);
+	atomic_store_explicit(&eventqueue->dequeue_pos, pos+1, memory_order_relaxed);
+
+	return 1;
+}
+
+
+/* wake up producers waiting in push_full() for free cells */
+static void wake_producers(eventqueue_t* eventqueue)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load(&eventqueue->waiters)) {
+		pthread_mutex_lock(&eventqueue->lock);
+			pthread_cond_broadcast(&eventqueue->not_full);
+		pthread_mutex_unlock(&eventqueue->lock);
+	}
 }
 
 
 /**
  * Get the oldest object from the eventqueue.
- * The size of the eventqueue shrinks by one.
- * The returned event must be freed using eventqueue_item_unref() if no longer used.
- * If there are no events in the eventqueue, NULL is returned.
+ * Must only be called from the consumer thread. The item is copied to
+ * `item`, its strings must be freed using eventqueue_item_clear() if no
+ * longer used. Returns 0 if there are no events in the eventqueue.
+ */
+int eventqueue_pop(eventqueue_t* eventqueue, eventqueue_item_t* item)
+{
+	int ret;
+
+	if (eventqueue->consumer_locks) {
+		pthread_mutex_lock(&eventqueue->lock);
+			ret = pop_one(eventqueue, item);
+		pthread_mutex_unlock(&eventqueue->lock);
+	}
+	else {
+		ret = pop_one(eventqueue, item);
+	}
+
+	if (ret) {
+		atomic_fetch_add_explicit(&eventqueue->delivered, 1, memory_order_relaxed);
+		if (eventqueue->policy & EVENTQUEUE_BLOCK) {
+			wake_producers(eventqueue);
+		}
+	}
+
+	return ret;
+}
+
+
+/**
+ * Get all objects from the eventqueue at once, oldest first.
+ * Must only be called from the consumer thread. `*items` is set to a buffer
+ * owned by the eventqueue which is valid until the next call to
+ * eventqueue_pop_all(); the strings must be freed using
+ * eventqueue_items_clear(). Returns the number of events.
  */
-eventqueue_item_t* eventqueue_pop(eventqueue_t* eventqueue)
+size_t eventqueue_pop_all(eventqueue_t* eventqueue, eventqueue_item_t** items)
 {
-	eventqueue_item_t* first_item = NULL;
+	size_t cnt = 0;
+
+	if (eventqueue->consumer_locks) {
+		pthread_mutex_lock(&eventqueue->lock);
+	}
 
-	pthread_mutex_lock(&eventqueue->mutex);
-		first_item = eventqueue->first;
-		if( first_item ) {
-			eventqueue->first = first_item->next_;
-			first_item->next_ = NULL;
+	while (cnt<=eventqueue->mask && pop_one(eventqueue, &eventqueue->batch[cnt])) {
+		cnt++;
+	}
+
+	if (eventqueue->consumer_locks) {
+		pthread_mutex_unlock(&eventqueue->lock);
+	}
+
+	if (cnt) {
+		atomic_fetch_add_explicit(&eventqueue->delivered, cnt, memory_order_relaxed);
+		atomic_fetch_add_explicit(&eventqueue->batches, 1, memory_order_relaxed);
+		if (cnt > atomic_load_explicit(&eventqueue->max_depth, memory_order_relaxed)) {
+			atomic_store_explicit(&eventqueue->max_depth, cnt, memory_order_relaxed);
+		}
+		if (eventqueue->policy & EVENTQUEUE_BLOCK) {
+			wake_producers(eventqueue);
 		}
-	pthread_mutex_unlock(&eventqueue->mutex);
+	}
 
-	return first_item;
+	*items = eventqueue->batch;
+	return cnt;
 }
 
 
 /**
- * Free an event returned by eventqueue_pop()
+ * Give the strings of an event returned by eventqueue_pop() back to the
+ * eventqueue's strpool, where they are recycled for the next events.
  */
-void eventqueue_item_unref(eventqueue_item_t* item)
+void eventqueue_item_clear(eventqueue_t* eventqueue, eventqueue_item_t* item)
 {
 	if (item==NULL) {
 		return;
 	}
 
 	if (DC_EVENT_DATA1_IS_STRING(item->event)) {
-		free((void*)item->data1);
+		strpool_free(eventqueue->strpool, (char*)item->data1);
 	}
 
 	if (DC_EVENT_DATA2_IS_STRING(item->event)) {
-		free((void*)item->data2);
+		strpool_free(eventqueue->strpool, (char*)item->data2);
 	}
 
-	free(item);
+	item->data1 = 0;
+	item->data2 = 0;
+}
+
+
+/**
+ * Give the strings of the events returned by eventqueue_pop_all() back
+ */
+void eventqueue_items_clear(eventqueue_t* eventqueue, eventqueue_item_t* items, size_t cnt)
+{
+	for (size_t i=0; i<cnt; i++) {
+		eventqueue_item_clear(eventqueue, &items[i]);
+	}
+}
+
+
+/**
+ * Get the capacity, the current and maximum depth, the number of delivered,
+ * dropped and coalesced events since the eventqueue was created and the
+ * allocation counters of the string pool. May be called from any thread.
+ */
+void eventqueue_get_stats(eventqueue_t* eventqueue, eventqueue_stats_t* stats)
+{
+	memset(stats, 0, sizeof(eventqueue_stats_t));
+	if (eventqueue==NULL) {
+		return;
+	}
+
+	size_t enqueue_pos = atomic_load_explicit(&eventqueue->enqueue_pos, memory_order_relaxed);
+	size_t dequeue_pos = atomic_load_explicit(&eventqueue->dequeue_pos, memory_order_relaxed);
+
+	stats->capacity  = eventqueue->mask+1;
+	stats->depth     = enqueue_pos>dequeue_pos? enqueue_pos-dequeue_pos : 0;
+	stats->max_depth = atomic_load_explicit(&eventqueue->max_depth, memory_order_relaxed);
+	stats->delivered = atomic_load_explicit(&eventqueue->delivered, memory_order_relaxed);
+	stats->batches   = atomic_load_explicit(&eventqueue->batches, memory_order_relaxed);
+	stats->dropped   = atomic_load_explicit(&eventqueue->dropped, memory_order_relaxed);
+	stats->coalesced = atomic_load_explicit(&eventqueue->coalesced, memory_order_relaxed);
+	strpool_get_stats(eventqueue->strpool, &stats->strings);
+}
+
+
+/**
+ * Monotonic clock in nanoseconds, as used for the timestamps of the items.
+ */
+uint64_t eventqueue_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
 }
@@ -27,7 +27,20 @@ extern "C" {
 #endif
 
 
+#include <stddef.h>
 #include <stdint.h>
+#include "strpool.h"
+
+
+#define EVENTQUEUE_DEFAULT_CAPACITY   4096
+#define EVENTQUEUE_BLOCK_TIMEOUT_MS   1000
+
+
+/* What to do when an event is pushed to a full eventqueue, the flags can be
+ * combined. Without any flag, the new event is dropped. */
+#define EVENTQUEUE_DROP_OLDEST_LOG    0x01 // make room by dropping the oldest info/warning event
+#define EVENTQUEUE_BLOCK              0x02 // let the producer wait up to EVENTQUEUE_BLOCK_TIMEOUT_MS
+#define EVENTQUEUE_COALESCE           0x04 // keep only one pending MSGS_CHANGED/CONTACTS_CHANGED/CHAT_MODIFIED per data1/data2
 
 
 typedef struct eventqueue_t eventqueue_t;
@@ -36,17 +49,35 @@ typedef struct eventqueue_item_t {
 	int       event;
 	uintptr_t data1;
 	uintptr_t data2;
-	struct eventqueue_item_t* next_;
+	uint64_t  timestamp;      // eventqueue_now() when the event was pushed
 } eventqueue_item_t;
 
+typedef struct eventqueue_stats_t {
+	size_t    capacity;
+	size_t    depth;          // events waiting right now
+	size_t    max_depth;      // most events taken at once by eventqueue_pop_all()
+	uint64_t  delivered;      // events taken by the consumer
+	uint64_t  batches;        // non-empty eventqueue_pop_all() calls
+	uint64_t  dropped;        // events discarded by the overflow policy
+	uint64_t  coalesced;
+	strpool_stats_t strings;
+} eventqueue_stats_t;
 
-eventqueue_t*         eventqueue_new        ();
+
+eventqueue_t*         eventqueue_new        (size_t capacity, int policy);
 void                  eventqueue_unref      (eventqueue_t*);
 
-void                  eventqueue_push       (eventqueue_t*, int event, uintptr_t data1, uintptr_t data2);
-eventqueue_item_t*    eventqueue_pop        (eventqueue_t*);
+int                   eventqueue_push       (eventqueue_t*, int event, uintptr_t data1, uintptr_t data2);
+int                   eventqueue_try_push   (eventqueue_t*, int event, uintptr_t data1, uintptr_t data2);
+int                   eventqueue_pop        (eventqueue_t*, eventqueue_item_t*);
+size_t                eventqueue_pop_all    (eventqueue_t*, eventqueue_item_t**);
+
+void                  eventqueue_item_clear (eventqueue_t*, eventqueue_item_t*);
+void                  eventqueue_items_clear (eventqueue_t*, eventqueue_item_t*, size_t cnt);
+
+void                  eventqueue_get_stats  (eventqueue_t*, eventqueue_stats_t*);
 
-void                  eventqueue_item_unref (eventqueue_item_t*);
+uint64_t              eventqueue_now        ();
 
 
 #ifdef __cplusplus
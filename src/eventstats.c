@@ -0,0 +1,134 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include "eventstats.h"
+
+
+/*
+ * Latency histograms per event type, in microseconds. An entry is added the
+ * first time an event type is recorded. Only used from the main thread, so
+ * there is no locking.
+ */
+
+
+typedef struct eventstats_entry_t {
+	int          event;
+	histogram_t* histograms[EVENTSTATS_STAGES];
+} eventstats_entry_t;
+
+
+typedef struct eventstats_t {
+	eventstats_entry_t* entries;
+	int                 cnt;
+	int                 allocated;
+} eventstats_t;
+
+
+eventstats_t* eventstats_new()
+{
+	eventstats_t* eventstats = calloc(1, sizeof(eventstats_t));
+	if (eventstats==NULL) {
+		exit(666);
+	}
+
+	return eventstats;
+}
+
+
+void eventstats_unref(eventstats_t* eventstats)
+{
+	if (eventstats==NULL) {
+		return;
+	}
+
+	for (int i=0; i<eventstats->cnt; i++) {
+		for (int stage=0; stage<EVENTSTATS_STAGES; stage++) {
+			histogram_unref(eventstats->entries[i].histograms[stage]);
+		}
+	}
+
+	free(eventstats->entries);
+	free(eventstats);
+}
+
+
+static eventstats_entry_t* get_entry(eventstats_t* eventstats, int event)
+{
+	for (int i=0; i<eventstats->cnt; i++) {
+		if (eventstats->entries[i].event==event) {
+			return &eventstats->entries[i];
+		}
+	}
+
+	if (eventstats->cnt==eventstats->allocated) {
+		eventstats->allocated = eventstats->allocated? eventstats->allocated*2 : 32;
+		eventstats->entries = realloc(eventstats->entries, eventstats->allocated*sizeof(eventstats_entry_t));
+		if (eventstats->entries==NULL) {
+			exit(666);
+		}
+	}
+
+	eventstats_entry_t* entry = &eventstats->entries[eventstats->cnt++];
+	entry->event = event;
+	for (int stage=0; stage<EVENTSTATS_STAGES; stage++) {
+		entry->histograms[stage] = histogram_new();
+	}
+
+	return entry;
+}
+
+
+void eventstats_record(eventstats_t* eventstats, int event, int stage, uint64_t usec)
+{
+	if (eventstats==NULL || stage<0 || stage>=EVENTSTATS_STAGES) {
+		return;
+	}
+
+	histogram_record(get_entry(eventstats, event)->histograms[stage], usec);
+}
+
+
+int eventstats_get_cnt(const eventstats_t* eventstats)
+{
+	return eventstats? eventstats->cnt : 0;
+}
+
+
+int eventstats_get_event(const eventstats_t* eventstats, int index)
+{
+	if (eventstats==NULL || index<0 || index>=eventstats->cnt) {
+		return 0;
+	}
+
+	return eventstats->entries[index].event;
+}
+
+
+const histogram_t* eventstats_get_histogram(const eventstats_t* eventstats, int index, int stage)
+{
+	if (eventstats==NULL || index<0 || index>=eventstats->cnt || stage<0 || stage>=EVENTSTATS_STAGES) {
+		return NULL;
+	}
+
+	return eventstats->entries[index].histograms[stage];
+}
@@ -0,0 +1,52 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#ifndef __EVENTSTATS_H__
+#define __EVENTSTATS_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "histogram.h"
+
+
+#define EVENTSTATS_QUEUED    0 // from dc_event_handler() until the main thread takes the event
+#define EVENTSTATS_DISPATCH  1 // from there until the event is emitted in JavaScript
+#define EVENTSTATS_STAGES    2
+
+
+typedef struct eventstats_t eventstats_t;
+
+eventstats_t*       eventstats_new       ();
+void                eventstats_unref     (eventstats_t*);
+
+void                eventstats_record    (eventstats_t*, int event, int stage, uint64_t usec);
+
+int                 eventstats_get_cnt   (const eventstats_t*);
+int                 eventstats_get_event (const eventstats_t*, int index);
+const histogram_t*  eventstats_get_histogram (const eventstats_t*, int index, int stage);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __EVENTSTATS_H__ */
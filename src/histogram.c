@@ -0,0 +1,165 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "histogram.h"
+
+
+/*
+ * A histogram with logarithmic buckets that are split into 16 linear
+ * sub-buckets each, like HdrHistogram does. Values below 32 are exact,
+ * larger values are recorded with an error of at most 1/16. Values above
+ * 2^HISTOGRAM_MAX_BITS are counted as 2^HISTOGRAM_MAX_BITS-1; for the
+ * microseconds recorded by the event statistics this is about 19 hours.
+ *
+ * The histogram is not thread-safe.
+ */
+
+
+#define HISTOGRAM_SUB_BITS  4
+#define HISTOGRAM_SUB_COUNT (1<<HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS  36
+#define HISTOGRAM_BUCKETS   ((HISTOGRAM_MAX_BITS-HISTOGRAM_SUB_BITS+1)*HISTOGRAM_SUB_COUNT)
+
+
+typedef struct histogram_t {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+
+static int bucket_index(uint64_t value)
+{
+	if (value < 2*HISTOGRAM_SUB_COUNT) {
+		return (int)value;
+	}
+
+	int msb = 63 - __builtin_clzll(value);
+	int shift = msb - HISTOGRAM_SUB_BITS;
+	return shift*HISTOGRAM_SUB_COUNT + (int)(value>>shift);
+}
+
+
+/* the highest value that ends up in the bucket */
+static uint64_t bucket_value(int index)
+{
+	if (index < 2*HISTOGRAM_SUB_COUNT) {
+		return (uint64_t)index;
+	}
+
+	int      shift = index/HISTOGRAM_SUB_COUNT - 1;
+	uint64_t sub = (uint64_t)(index%HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_COUNT);
+	return ((sub+1)<<shift) - 1;
+}
+
+
+histogram_t* histogram_new()
+{
+	histogram_t* histogram = calloc(1, sizeof(histogram_t));
+	if (histogram==NULL) {
+		exit(666);
+	}
+
+	return histogram;
+}
+
+
+void histogram_unref(histogram_t* histogram)
+{
+	free(histogram);
+}
+
+
+void histogram_record(histogram_t* histogram, uint64_t value)
+{
+	if (histogram==NULL) {
+		return;
+	}
+
+	if (value >= ((uint64_t)1<<HISTOGRAM_MAX_BITS)) {
+		value = ((uint64_t)1<<HISTOGRAM_MAX_BITS) - 1;
+	}
+
+	histogram->buckets[bucket_index(value)]++;
+	histogram->count++;
+	if (value > histogram->max) {
+		histogram->max = value;
+	}
+}
+
+
+void histogram_reset(histogram_t* histogram)
+{
+	if (histogram) {
+		memset(histogram, 0, sizeof(histogram_t));
+	}
+}
+
+
+void histogram_copy(histogram_t* dst, const histogram_t* src)
+{
+	if (dst && src) {
+		memcpy(dst, src, sizeof(histogram_t));
+	}
+}
+
+
+uint64_t histogram_count(const histogram_t* histogram)
+{
+	return histogram? histogram->count : 0;
+}
+
+
+uint64_t histogram_max(const histogram_t* histogram)
+{
+	return histogram? histogram->max : 0;
+}
+
+
+/**
+ * Get the value below which `percentile` percent of the recorded values
+ * fall, e.g. histogram_percentile(histogram, 99.0). Returns 0 for an empty
+ * histogram.
+ */
+uint64_t histogram_percentile(const histogram_t* histogram, double percentile)
+{
+	if (histogram==NULL || histogram->count==0) {
+		return 0;
+	}
+
+	uint64_t wanted = (uint64_t)(percentile/100.0*(double)histogram->count + 0.5);
+	if (wanted < 1) {
+		wanted = 1;
+	}
+
+	uint64_t seen = 0;
+	for (int i=0; i<HISTOGRAM_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= wanted) {
+			uint64_t value = bucket_value(i);
+			return value < histogram->max? value : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+typedef struct histogram_t histogram_t;
+
+histogram_t*        histogram_new        ();
+void                histogram_unref      (histogram_t*);
+
+void                histogram_record     (histogram_t*, uint64_t value);
+void                histogram_reset      (histogram_t*);
+void                histogram_copy       (histogram_t* dst, const histogram_t* src);
+
+uint64_t            histogram_count      (const histogram_t*);
+uint64_t            histogram_max        (const histogram_t*);
+uint64_t            histogram_percentile (const histogram_t*, double percentile);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __HISTOGRAM_H__ */
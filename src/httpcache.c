@@ -0,0 +1,519 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "httpcache.h"
+
+
+/*
+ * An LRU list of entries plus a chained hash table on the urls. With a
+ * directory set, every response is also written to a file named after the
+ * hash of its url, so it survives restarts and is shared by processes
+ * provisioning accounts on the same domains. The file holds the url and
+ * the wall clock expiry followed by 0 for a failed request or 1 for a
+ * response on two lines, followed by the response. The files are read and
+ * written without holding `mutex`.
+ */
+
+
+typedef struct httpcache_entry_t {
+	char*     url;
+	char*     response;       // NULL for a failed request
+	uint64_t  hash;
+	uint64_t  expires;        // milliseconds since the epoch
+	struct httpcache_entry_t* lru_prev; // more recently used
+	struct httpcache_entry_t* lru_next;
+	struct httpcache_entry_t* bucket_next;
+} httpcache_entry_t;
+
+
+typedef struct httpcache_t {
+	pthread_mutex_t      mutex;
+	size_t               capacity;
+	uint32_t             ttl_ms;
+	uint32_t             negative_ttl_ms;
+	char*                dir;
+	unsigned             tmp_seq;        // names the files being written
+
+	httpcache_entry_t**  buckets;
+	size_t               bucket_mask;
+	httpcache_entry_t*   lru_head;
+	httpcache_entry_t*   lru_tail;
+	size_t               entries;
+
+	uint64_t             hits;
+	uint64_t             negative_hits;
+	uint64_t             disk_hits;
+	uint64_t             misses;
+	uint64_t             evictions;
+} httpcache_t;
+
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+static uint64_t hash_url(const char* url)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (const unsigned char* p = (const unsigned char*)url; *p; p++) {
+		hash ^= *p;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+static char* safe_strdup(const char* str)
+{
+	char* ret = strdup(str? str : "");
+	if (ret==NULL) {
+		exit(666);
+	}
+	return ret;
+}
+
+
+static void lru_unlink(httpcache_t* cache, httpcache_entry_t* entry)
+{
+	if (entry->lru_prev) { entry->lru_prev->lru_next = entry->lru_next; } else { cache->lru_head = entry->lru_next; }
+	if (entry->lru_next) { entry->lru_next->lru_prev = entry->lru_prev; } else { cache->lru_tail = entry->lru_prev; }
+	entry->lru_prev = NULL;
+	entry->lru_next = NULL;
+}
+
+
+static void lru_push_front(httpcache_t* cache, httpcache_entry_t* entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_head;
+	if (cache->lru_head) { cache->lru_head->lru_prev = entry; } else { cache->lru_tail = entry; }
+	cache->lru_head = entry;
+}
+
+
+static httpcache_entry_t* find_entry(httpcache_t* cache, const char* url, uint64_t hash)
+{
+	httpcache_entry_t* entry = cache->buckets[hash & cache->bucket_mask];
+	while (entry && (entry->hash!=hash || strcmp(entry->url, url)!=0)) {
+		entry = entry->bucket_next;
+	}
+	return entry;
+}
+
+
+static void remove_entry(httpcache_t* cache, httpcache_entry_t* entry)
+{
+	httpcache_entry_t** link = &cache->buckets[entry->hash & cache->bucket_mask];
+	while (*link!=entry) {
+		link = &(*link)->bucket_next;
+	}
+	*link = entry->bucket_next;
+	lru_unlink(cache, entry);
+	cache->entries--;
+
+	free(entry->url);
+	free(entry->response);
+	free(entry);
+}
+
+
+static void evict(httpcache_t* cache, size_t capacity)
+{
+	while (cache->entries > capacity && cache->lru_tail) {
+		remove_entry(cache, cache->lru_tail);
+		cache->evictions++;
+	}
+}
+
+
+static void insert_entry(httpcache_t* cache, const char* url, uint64_t hash, char* response, uint64_t expires)
+{
+	httpcache_entry_t* entry = find_entry(cache, url, hash);
+	if (entry) {
+		free(entry->response);
+		lru_unlink(cache, entry);
+	}
+	else {
+		evict(cache, cache->capacity-1);
+
+		entry = calloc(1, sizeof(httpcache_entry_t));
+		if (entry==NULL) {
+			exit(666);
+		}
+		entry->url = safe_strdup(url);
+		entry->hash = hash;
+		entry->bucket_next = cache->buckets[hash & cache->bucket_mask];
+		cache->buckets[hash & cache->bucket_mask] = entry;
+		cache->entries++;
+	}
+
+	entry->response = response;
+	entry->expires = expires;
+	lru_push_front(cache, entry);
+}
+
+
+static void resize_buckets(httpcache_t* cache, size_t capacity)
+{
+	size_t bucket_cnt = 16;
+	while (bucket_cnt < capacity) {
+		bucket_cnt *= 2;
+	}
+	if (bucket_cnt-1==cache->bucket_mask) {
+		return;
+	}
+
+	httpcache_entry_t** buckets = calloc(bucket_cnt, sizeof(httpcache_entry_t*));
+	if (buckets==NULL) {
+		exit(666);
+	}
+	for (httpcache_entry_t* entry = cache->lru_head; entry; entry = entry->lru_next) {
+		entry->bucket_next = buckets[entry->hash & (bucket_cnt-1)];
+		buckets[entry->hash & (bucket_cnt-1)] = entry;
+	}
+
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->bucket_mask = bucket_cnt-1;
+}
+
+
+static char* disk_path(const char* dir, uint64_t hash)
+{
+	size_t len = strlen(dir) + 32;
+	char*  path = malloc(len);
+	if (path==NULL) {
+		exit(666);
+	}
+	snprintf(path, len, "%s/%016llx.http", dir, (unsigned long long)hash);
+	return path;
+}
+
+
+/* returns 1 if the url was found, `*response` is NULL for a failed request */
+static int disk_load(const char* dir, const char* url, uint64_t hash, char** response, uint64_t* expires)
+{
+	char*  path = disk_path(dir, hash);
+	FILE*  file = fopen(path, "rb");
+	int    ret = 0;
+	char*  line = NULL;
+	size_t line_size = 0;
+	free(path);
+	*response = NULL;
+	if (file==NULL) {
+		return 0;
+	}
+
+	// url, expiry and status and the rest of the file is the response
+	ssize_t line_len = getline(&line, &line_size, file);
+	if (line_len <= 0 || line[line_len-1]!='\n') {
+		goto cleanup;
+	}
+	line[line_len-1] = 0;
+	if (strcmp(line, url)!=0) {
+		goto cleanup; // another url with the same hash
+	}
+	if (getline(&line, &line_size, file) <= 0) {
+		goto cleanup;
+	}
+	char* status = NULL;
+	*expires = strtoull(line, &status, 10);
+	if (*expires <= now_ms() || (strncmp(status, " 0", 2)!=0 && strncmp(status, " 1", 2)!=0)) {
+		goto cleanup;
+	}
+	if (status[1]=='0') {
+		ret = 1;
+		goto cleanup;
+	}
+
+	long start = ftell(file);
+	fseek(file, 0, SEEK_END);
+	long len = ftell(file) - start;
+	fseek(file, start, SEEK_SET);
+	if (start < 0 || len < 0) {
+		goto cleanup;
+	}
+	*response = malloc(len+1);
+	if (*response==NULL) {
+		exit(666);
+	}
+	if (fread(*response, 1, len, file)!=(size_t)len) {
+		free(*response);
+		*response = NULL;
+		goto cleanup;
+	}
+	(*response)[len] = 0;
+	ret = 1;
+
+cleanup:
+	free(line);
+	fclose(file);
+	return ret;
+}
+
+
+static void disk_store(const char* dir, unsigned tmp_seq, const char* url, uint64_t hash, const char* response, uint64_t expires)
+{
+	// urls with a newline can't be stored in the header line
+	if (strchr(url, '\n')) {
+		return;
+	}
+
+	char*  path = disk_path(dir, hash);
+	size_t tmp_len = strlen(path) + 48;
+	char*  tmp = malloc(tmp_len);
+	if (tmp==NULL) {
+		exit(666);
+	}
+	// written aside and renamed, readers never see half a file
+	snprintf(tmp, tmp_len, "%s.%d.%u.tmp", path, (int)getpid(), tmp_seq);
+
+	FILE* file = fopen(tmp, "wb");
+	if (file) {
+		size_t len = response? strlen(response) : 0;
+		int ok = fprintf(file, "%s\n%llu %d\n", url, (unsigned long long)expires, response!=NULL) > 0
+		      && fwrite(response? response : "", 1, len, file)==len;
+		ok = (fclose(file)==0) && ok;
+		if (!ok || rename(tmp, path)!=0) {
+			unlink(tmp);
+		}
+	}
+
+	free(tmp);
+	free(path);
+}
+
+
+/**
+ * Create a cache for up to `capacity` responses. `dir` is optional, if set,
+ * the responses are also kept in this directory, which must exist.
+ */
+httpcache_t* httpcache_new(size_t capacity, uint32_t ttl_ms, uint32_t negative_ttl_ms, const char* dir)
+{
+	httpcache_t* cache = calloc(1, sizeof(httpcache_t));
+	if (cache==NULL) {
+		exit(666);
+	}
+
+	pthread_mutex_init(&cache->mutex, NULL);
+	httpcache_configure(cache, capacity, ttl_ms, negative_ttl_ms, dir);
+
+	return cache;
+}
+
+
+void httpcache_unref(httpcache_t* cache)
+{
+	if (cache==NULL) {
+		return;
+	}
+
+	httpcache_clear(cache);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->buckets);
+	free(cache->dir);
+	free(cache);
+}
+
+
+/**
+ * Change the limits of a cache in use. A capacity of 0 disables the cache,
+ * a NULL or empty `dir` stops using the directory.
+ */
+void httpcache_configure(httpcache_t* cache, size_t capacity, uint32_t ttl_ms, uint32_t negative_ttl_ms, const char* dir)
+{
+	if (cache==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+		cache->capacity = capacity;
+		cache->ttl_ms = ttl_ms;
+		cache->negative_ttl_ms = negative_ttl_ms;
+		free(cache->dir);
+		cache->dir = (dir && dir[0])? safe_strdup(dir) : NULL;
+
+		evict(cache, capacity);
+		resize_buckets(cache, capacity);
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+
+/**
+ * Look up a response. On a hit, 1 is returned and a copy of the response
+ * is stored in `response`, the caller must free() it. For a cached failure
+ * `response` is set to NULL.
+ */
+int httpcache_get(httpcache_t* cache, const char* url, char** response)
+{
+	*response = NULL;
+	if (cache==NULL || url==NULL) {
+		return 0;
+	}
+
+	uint64_t hash = hash_url(url);
+	uint64_t now = now_ms();
+	char*    dir = NULL;
+
+	pthread_mutex_lock(&cache->mutex);
+		if (cache->capacity==0) {
+			pthread_mutex_unlock(&cache->mutex);
+			return 0;
+		}
+
+		httpcache_entry_t* entry = find_entry(cache, url, hash);
+		if (entry && entry->expires <= now) {
+			remove_entry(cache, entry);
+			entry = NULL;
+		}
+
+		if (entry) {
+			lru_unlink(cache, entry);
+			lru_push_front(cache, entry);
+			*response = entry->response? safe_strdup(entry->response) : NULL;
+			cache->hits++;
+			if (entry->response==NULL) {
+				cache->negative_hits++;
+			}
+			pthread_mutex_unlock(&cache->mutex);
+			return 1;
+		}
+
+		if (cache->dir==NULL) {
+			cache->misses++;
+			pthread_mutex_unlock(&cache->mutex);
+			return 0;
+		}
+		dir = safe_strdup(cache->dir);
+	pthread_mutex_unlock(&cache->mutex);
+
+	uint64_t expires = 0;
+	int      loaded = disk_load(dir, url, hash, response, &expires);
+	free(dir);
+
+	pthread_mutex_lock(&cache->mutex);
+		if (loaded) {
+			if (cache->capacity) {
+				insert_entry(cache, url, hash, *response? safe_strdup(*response) : NULL, expires);
+			}
+			cache->hits++;
+			cache->disk_hits++;
+			if (*response==NULL) {
+				cache->negative_hits++;
+			}
+		}
+		else {
+			cache->misses++;
+		}
+	pthread_mutex_unlock(&cache->mutex);
+
+	return loaded;
+}
+
+
+/**
+ * Store the response to a request, NULL marks a failed request. An empty
+ * response is a response like any other.
+ */
+void httpcache_put(httpcache_t* cache, const char* url, const char* response)
+{
+	if (cache==NULL || url==NULL) {
+		return;
+	}
+
+	uint64_t hash = hash_url(url);
+	int      negative = (response==NULL);
+	char*    dir = NULL;
+	unsigned tmp_seq = 0;
+
+	pthread_mutex_lock(&cache->mutex);
+		if (cache->capacity==0) {
+			pthread_mutex_unlock(&cache->mutex);
+			return;
+		}
+
+		uint64_t expires = now_ms() + (negative? cache->negative_ttl_ms : cache->ttl_ms);
+		insert_entry(cache, url, hash, negative? NULL : safe_strdup(response), expires);
+		if (cache->dir) {
+			dir = safe_strdup(cache->dir);
+			tmp_seq = cache->tmp_seq++;
+		}
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (dir) {
+		disk_store(dir, tmp_seq, url, hash, response, expires);
+		free(dir);
+	}
+}
+
+
+/**
+ * Forget all responses kept in memory and reset the counters. Files in
+ * the directory are left alone.
+ */
+void httpcache_clear(httpcache_t* cache)
+{
+	if (cache==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+		while (cache->lru_head) {
+			remove_entry(cache, cache->lru_head);
+		}
+		cache->hits = 0;
+		cache->negative_hits = 0;
+		cache->disk_hits = 0;
+		cache->misses = 0;
+		cache->evictions = 0;
+	pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void httpcache_get_stats(httpcache_t* cache, httpcache_stats_t* stats)
+{
+	memset(stats, 0, sizeof(httpcache_stats_t));
+	if (cache==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->mutex);
+		stats->capacity = cache->capacity;
+		stats->entries = cache->entries;
+		stats->hits = cache->hits;
+		stats->negative_hits = cache->negative_hits;
+		stats->disk_hits = cache->disk_hits;
+		stats->misses = cache->misses;
+		stats->evictions = cache->evictions;
+	pthread_mutex_unlock(&cache->mutex);
+}
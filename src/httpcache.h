@@ -0,0 +1,68 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#ifndef __HTTPCACHE_H__
+#define __HTTPCACHE_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Responses to DC_EVENT_HTTP_GET, keyed by url. Failed requests are kept
+ * for negative_ttl_ms only. */
+#define HTTPCACHE_DEFAULT_CAPACITY      256
+#define HTTPCACHE_DEFAULT_TTL_MS        (60*60*1000)
+#define HTTPCACHE_DEFAULT_NEGATIVE_TTL_MS (60*1000)
+
+
+typedef struct httpcache_t httpcache_t;
+
+typedef struct httpcache_stats_t {
+	size_t    capacity;
+	size_t    entries;
+	uint64_t  hits;
+	uint64_t  negative_hits;  // hits on failed requests, included in hits
+	uint64_t  disk_hits;      // hits loaded from the directory, included in hits
+	uint64_t  misses;
+	uint64_t  evictions;
+} httpcache_stats_t;
+
+
+httpcache_t*  httpcache_new        (size_t capacity, uint32_t ttl_ms, uint32_t negative_ttl_ms, const char* dir);
+void          httpcache_unref      (httpcache_t*);
+void          httpcache_configure  (httpcache_t*, size_t capacity, uint32_t ttl_ms, uint32_t negative_ttl_ms, const char* dir);
+
+int           httpcache_get        (httpcache_t*, const char* url, char** response);
+void          httpcache_put        (httpcache_t*, const char* url, const char* response);
+void          httpcache_clear      (httpcache_t*);
+
+void          httpcache_get_stats  (httpcache_t*, httpcache_stats_t*);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __HTTPCACHE_H__ */
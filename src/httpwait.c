@@ -0,0 +1,173 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "httpwait.h"
+
+
+/*
+ * Core threads waiting for the answers to their DC_EVENT_HTTP_GET requests.
+ * Every request lives on the stack of its waiting thread and has a condition
+ * variable of its own, so any number of threads may wait at the same time
+ * and an answer only wakes up the thread it is meant for.
+ */
+
+
+typedef struct httpwait_request_t {
+	uint32_t         id;
+	int              done;
+	char*            response;
+	pthread_cond_t   cond;
+	struct httpwait_request_t* next;
+} httpwait_request_t;
+
+
+typedef struct httpwait_t {
+	pthread_mutex_t      mutex;
+	uint32_t             timeout_ms;     // 0 waits forever
+	uint32_t             next_id;
+	httpwait_request_t*  requests;
+} httpwait_t;
+
+
+httpwait_t* httpwait_new(uint32_t timeout_ms)
+{
+	httpwait_t* httpwait = calloc(1, sizeof(httpwait_t));
+	if (httpwait==NULL) {
+		exit(666);
+	}
+
+	httpwait->timeout_ms = timeout_ms;
+	pthread_mutex_init(&httpwait->mutex, NULL);
+	return httpwait;
+}
+
+
+/* No thread may be waiting any longer */
+void httpwait_unref(httpwait_t* httpwait)
+{
+	if (httpwait==NULL) {
+		return;
+	}
+
+	pthread_mutex_destroy(&httpwait->mutex);
+	free(httpwait);
+}
+
+
+/**
+ * Passes the url to `send` and waits for the answer. Returns 1 if there was
+ * an answer, `response` is NULL for a failed request then. Returns 0 with
+ * `response` set to NULL if there was no answer within timeout_ms or if the
+ * request could not be sent. The caller owns the response.
+ */
+int httpwait_request(httpwait_t* httpwait, const char* url, httpwait_send_t send, void* userdata, char** response)
+{
+	*response = NULL;
+	if (httpwait==NULL) {
+		return 0;
+	}
+
+	httpwait_request_t request;
+	memset(&request, 0, sizeof(request));
+	pthread_cond_init(&request.cond, NULL);
+
+	pthread_mutex_lock(&httpwait->mutex);
+		// 0 is never used, that is what core passes as data2
+		do {
+			request.id = ++httpwait->next_id;
+		} while (request.id==0);
+		request.next = httpwait->requests;
+		httpwait->requests = &request;
+	pthread_mutex_unlock(&httpwait->mutex);
+
+	// Never wait for an answer to a request that didn't make it out
+	int sent = send(userdata, url, request.id);
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += httpwait->timeout_ms / 1000;
+	deadline.tv_nsec += (httpwait->timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&httpwait->mutex);
+		// while() is to protect against spuriously wakeups
+		while (sent && !request.done) {
+			if (httpwait->timeout_ms==0) {
+				pthread_cond_wait(&request.cond, &httpwait->mutex);
+			}
+			else if (pthread_cond_timedwait(&request.cond, &httpwait->mutex, &deadline)==ETIMEDOUT) {
+				break;
+			}
+		}
+		// A late answer finds no request and is dropped
+		httpwait_request_t** link = &httpwait->requests;
+		while (*link!=&request) {
+			link = &(*link)->next;
+		}
+		*link = request.next;
+	pthread_mutex_unlock(&httpwait->mutex);
+
+	pthread_cond_destroy(&request.cond);
+
+	*response = request.response;
+	return request.done;
+}
+
+
+/**
+ * Hands the response, NULL for a failed request, to the thread waiting for
+ * `request_id` and takes ownership of it. Returns 0 and frees the response
+ * if nobody is waiting any longer, because the request timed out or was
+ * answered already.
+ */
+int httpwait_answer(httpwait_t* httpwait, uint32_t request_id, char* response)
+{
+	int result = 0;
+
+	if (httpwait) {
+		pthread_mutex_lock(&httpwait->mutex);
+			httpwait_request_t* request = httpwait->requests;
+			while (request && request->id!=request_id) {
+				request = request->next;
+			}
+			if (request && !request->done) {
+				request->done = 1;
+				request->response = response;
+				response = NULL;
+				pthread_cond_signal(&request->cond);
+				result = 1;
+			}
+		pthread_mutex_unlock(&httpwait->mutex);
+	}
+
+	free(response);
+	return result;
+}
@@ -0,0 +1,52 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __HTTPWAIT_H__
+#define __HTTPWAIT_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+typedef struct httpwait_t httpwait_t;
+
+/* Passes the url on to whoever fetches it, e.g. by queueing
+ * DC_EVENT_HTTP_GET. The answer must be given to httpwait_answer() with the
+ * same request id. Returns 0 if the request could not be passed on. */
+typedef int (*httpwait_send_t) (void* userdata, const char* url, uint32_t request_id);
+
+
+httpwait_t*   httpwait_new      (uint32_t timeout_ms);
+void          httpwait_unref    (httpwait_t*);
+
+int           httpwait_request  (httpwait_t*, const char* url, httpwait_send_t, void* userdata, char** response);
+int           httpwait_answer   (httpwait_t*, uint32_t request_id, char* response);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __HTTPWAIT_H__ */
@@ -0,0 +1,374 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <deltachat.h>
+#include "eventqueue.h"
+#include "journal.h"
+
+
+/*
+ * The writer serializes records into a memory buffer under a mutex, a
+ * background thread swaps the buffer with a second one and writes it to
+ * disk, so that the threads emitting events never wait for the disk.
+ */
+
+
+#define JOURNAL_FLUSH_SIZE        (64*1024)
+#define JOURNAL_FLUSH_INTERVAL_MS 200
+#define JOURNAL_NULL_STRING       0xFFFFFFFFu
+
+
+typedef struct journal_buffer_t {
+	char*  data;
+	size_t len;
+	size_t allocated;
+} journal_buffer_t;
+
+
+typedef struct journal_writer_t {
+	FILE*            file;
+	pthread_t        thread;
+	pthread_mutex_t  mutex;
+	pthread_cond_t   cond;
+	int              stop;
+
+	journal_buffer_t buffer;  // filled by journal_writer_append()
+	journal_buffer_t spare;   // written by the thread
+
+	uint64_t         start;
+	uint64_t         records;
+	uint64_t         dropped;
+} journal_writer_t;
+
+
+typedef struct journal_reader_t {
+	FILE*            file;
+} journal_reader_t;
+
+
+static void buffer_append(journal_buffer_t* buffer, const void* data, size_t len)
+{
+	if (buffer->len+len > buffer->allocated) {
+		size_t allocated = buffer->allocated? buffer->allocated : JOURNAL_FLUSH_SIZE;
+		while (allocated < buffer->len+len) {
+			allocated *= 2;
+		}
+		buffer->data = realloc(buffer->data, allocated);
+		if (buffer->data==NULL) {
+			exit(666);
+		}
+		buffer->allocated = allocated;
+	}
+
+	memcpy(buffer->data+buffer->len, data, len);
+	buffer->len += len;
+}
+
+
+static void buffer_append_data(journal_buffer_t* buffer, uintptr_t data, int is_string)
+{
+	if (is_string) {
+		const char* str = (const char*)data;
+		uint32_t    len = str? (uint32_t)strlen(str) : JOURNAL_NULL_STRING;
+		buffer_append(buffer, &len, sizeof(len));
+		if (str) {
+			buffer_append(buffer, str, len);
+		}
+	}
+	else {
+		int32_t value = (int32_t)data;
+		buffer_append(buffer, &value, sizeof(value));
+	}
+}
+
+
+static void* writer_thread_func(void* arg)
+{
+	journal_writer_t* writer = (journal_writer_t*)arg;
+
+	pthread_mutex_lock(&writer->mutex);
+	for (;;) {
+		if (writer->buffer.len==0) {
+			if (writer->stop) {
+				break;
+			}
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += JOURNAL_FLUSH_INTERVAL_MS*1000000L;
+			if (deadline.tv_nsec >= 1000000000L) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&writer->cond, &writer->mutex, &deadline);
+			continue;
+		}
+
+		journal_buffer_t full = writer->buffer;
+		writer->buffer = writer->spare;
+		writer->buffer.len = 0;
+
+		pthread_mutex_unlock(&writer->mutex);
+			fwrite(full.data, 1, full.len, writer->file);
+			fflush(writer->file);
+		pthread_mutex_lock(&writer->mutex);
+
+		writer->spare = full;
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+
+/**
+ * Create a journal file at `path` and start the writer thread.
+ * Returns NULL if the file cannot be created.
+ */
+journal_writer_t* journal_writer_new(const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (file==NULL) {
+		return NULL;
+	}
+
+	journal_writer_t* writer = calloc(1, sizeof(journal_writer_t));
+	if (writer==NULL) {
+		exit(666);
+	}
+
+	writer->file = file;
+	writer->start = eventqueue_now();
+	fwrite(JOURNAL_MAGIC, 1, 4, file);
+
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+	pthread_create(&writer->thread, NULL, writer_thread_func, writer);
+
+	return writer;
+}
+
+
+/**
+ * Write everything that is buffered, stop the writer thread and close the
+ * journal file.
+ */
+void journal_writer_unref(journal_writer_t* writer)
+{
+	if (writer==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+		writer->stop = 1;
+		pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	pthread_join(writer->thread, NULL);
+
+	fclose(writer->file);
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer->buffer.data);
+	free(writer->spare.data);
+	free(writer);
+}
+
+
+/**
+ * Add an event to the journal. May be called from any thread, the strings
+ * in data1/data2 are copied.
+ */
+void journal_writer_append(journal_writer_t* writer, int event, uintptr_t data1, uintptr_t data2)
+{
+	if (writer==NULL) {
+		return;
+	}
+
+	int32_t  event32 = event;
+	uint8_t  flags = (DC_EVENT_DATA1_IS_STRING(event)? JOURNAL_DATA1_STRING : 0)
+	               | (DC_EVENT_DATA2_IS_STRING(event)? JOURNAL_DATA2_STRING : 0);
+
+	pthread_mutex_lock(&writer->mutex);
+		// taken under the lock, so the records are in order
+		uint64_t timestamp = eventqueue_now() - writer->start;
+		if (writer->buffer.len >= JOURNAL_MAX_BUFFER) {
+			writer->dropped++;
+		}
+		else {
+			buffer_append(&writer->buffer, &timestamp, sizeof(timestamp));
+			buffer_append(&writer->buffer, &event32, sizeof(event32));
+			buffer_append(&writer->buffer, &flags, sizeof(flags));
+			buffer_append_data(&writer->buffer, data1, flags & JOURNAL_DATA1_STRING);
+			buffer_append_data(&writer->buffer, data2, flags & JOURNAL_DATA2_STRING);
+			writer->records++;
+			if (writer->buffer.len >= JOURNAL_FLUSH_SIZE) {
+				pthread_cond_signal(&writer->cond);
+			}
+		}
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+
+void journal_writer_get_stats(journal_writer_t* writer, uint64_t* records, uint64_t* dropped)
+{
+	*records = 0;
+	*dropped = 0;
+	if (writer==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+		*records = writer->records;
+		*dropped = writer->dropped;
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+
+/**
+ * Open a journal for reading. Returns NULL if the file cannot be opened or
+ * is not a journal.
+ */
+journal_reader_t* journal_reader_new(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file==NULL) {
+		return NULL;
+	}
+
+	char magic[4];
+	if (fread(magic, 1, 4, file)!=4 || memcmp(magic, JOURNAL_MAGIC, 4)!=0) {
+		fclose(file);
+		return NULL;
+	}
+
+	journal_reader_t* reader = calloc(1, sizeof(journal_reader_t));
+	if (reader==NULL) {
+		exit(666);
+	}
+	reader->file = file;
+
+	return reader;
+}
+
+
+void journal_reader_unref(journal_reader_t* reader)
+{
+	if (reader==NULL) {
+		return;
+	}
+
+	fclose(reader->file);
+	free(reader);
+}
+
+
+static int read_data(FILE* file, uintptr_t* data, int is_string)
+{
+	if (is_string) {
+		uint32_t len;
+		if (fread(&len, sizeof(len), 1, file)!=1) {
+			return 0;
+		}
+		if (len==JOURNAL_NULL_STRING) {
+			*data = 0;
+			return 1;
+		}
+		char* str = malloc((size_t)len+1);
+		if (str==NULL) {
+			exit(666);
+		}
+		if (len && fread(str, 1, len, file)!=len) {
+			free(str);
+			return 0;
+		}
+		str[len] = 0;
+		*data = (uintptr_t)str;
+	}
+	else {
+		int32_t value;
+		if (fread(&value, sizeof(value), 1, file)!=1) {
+			return 0;
+		}
+		*data = (uintptr_t)value;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Read the next record. Returns 0 at the end of the journal or if the
+ * journal is truncated. The strings of the record must be freed using
+ * journal_record_clear().
+ */
+int journal_reader_next(journal_reader_t* reader, journal_record_t* record)
+{
+	memset(record, 0, sizeof(journal_record_t));
+
+	int32_t event;
+	uint8_t flags;
+	if (reader==NULL
+	 || fread(&record->timestamp, sizeof(record->timestamp), 1, reader->file)!=1
+	 || fread(&event, sizeof(event), 1, reader->file)!=1
+	 || fread(&flags, sizeof(flags), 1, reader->file)!=1) {
+		return 0;
+	}
+	record->event = event;
+	record->flags = flags;
+
+	// strings are flagged in the record, so events unknown to this version
+	// of deltachat.h are read correctly as well
+	if (!read_data(reader->file, &record->data1, flags & JOURNAL_DATA1_STRING)) {
+		return 0;
+	}
+	if (!read_data(reader->file, &record->data2, flags & JOURNAL_DATA2_STRING)) {
+		if (flags & JOURNAL_DATA1_STRING) {
+			free((void*)record->data1);
+		}
+		record->data1 = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+
+void journal_record_clear(journal_record_t* record)
+{
+	if (record==NULL) {
+		return;
+	}
+
+	if (record->flags & JOURNAL_DATA1_STRING) {
+		free((void*)record->data1);
+	}
+	if (record->flags & JOURNAL_DATA2_STRING) {
+		free((void*)record->data2);
+	}
+	record->data1 = 0;
+	record->data2 = 0;
+}
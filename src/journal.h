@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+/* A journal is a binary file with all events passing the event handler.
+ * It starts with the 4 bytes JOURNAL_MAGIC, followed by one record per
+ * event in host byte order:
+ *
+ *   uint64_t  nanoseconds since the journal was started
+ *   int32_t   event
+ *   uint8_t   flags, JOURNAL_DATA1_STRING and JOURNAL_DATA2_STRING
+ *   data1 and data2, each either
+ *     int32_t   the integer value, or
+ *     uint32_t  the string length followed by the bytes, without NUL,
+ *               0xFFFFFFFF for a NULL string
+ */
+#define JOURNAL_MAGIC             "DCJ1"
+#define JOURNAL_DATA1_STRING      0x01
+#define JOURNAL_DATA2_STRING      0x02
+#define JOURNAL_MAX_BUFFER        (16*1024*1024) // records are dropped when the disk can't keep up
+
+
+typedef struct journal_writer_t journal_writer_t;
+typedef struct journal_reader_t journal_reader_t;
+
+typedef struct journal_record_t {
+	uint64_t  timestamp;
+	int       event;
+	int       flags;          // JOURNAL_DATA1_STRING, JOURNAL_DATA2_STRING
+	uintptr_t data1;
+	uintptr_t data2;
+} journal_record_t;
+
+
+journal_writer_t*   journal_writer_new    (const char* path);
+void                journal_writer_unref  (journal_writer_t*);
+void                journal_writer_append (journal_writer_t*, int event, uintptr_t data1, uintptr_t data2);
+void                journal_writer_get_stats (journal_writer_t*, uint64_t* records, uint64_t* dropped);
+
+journal_reader_t*   journal_reader_new    (const char* path);
+void                journal_reader_unref  (journal_reader_t*);
+int                 journal_reader_next   (journal_reader_t*, journal_record_t*);
+
+void                journal_record_clear  (journal_record_t*);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __JOURNAL_H__ */
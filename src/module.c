@@ -1,186 +1,510 @@
 #define NAPI_EXPERIMENTAL
 
-//#define NODE_10_6
-
+#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
 #include <node_api.h>
 #include <uv.h>
 #include <deltachat.h>
 #include "napi-macros-extensions.h"
 #include "eventqueue.h"
+#include "eventstats.h"
+#include "httpcache.h"
+#include "httpwait.h"
+#include "journal.h"
 #include "strtable.h"
+#include "workpool.h"
 
 /**
  * TODO remove once upgrading core to new version
  */
 int dc_msg_has_deviating_timestamp(const dc_msg_t*);
 
+/**
+ * Event codes covered by the event mask, all current codes are below.
+ * Events with a higher code are always delivered.
+ */
+#define DCN_EVENT_MASK_BITS 4096
+#define DCN_EVENT_MASK_WORDS (DCN_EVENT_MASK_BITS / 32)
+
+/**
+ * Responses to DC_EVENT_HTTP_GET, shared by all contexts in the process
+ * since accounts on the same domain do the same autoconfig lookups
+ */
+static httpcache_t* http_cache = NULL;
+
+/**
+ * Threads for the async bindings, shared by all contexts in the process.
+ * Keeps long running database work off the libuv threadpool, where it
+ * would hold up fs and dns requests.
+ */
+static workpool_t* work_pool = NULL;
+
+/**
+ * Async work queued by a binding, see NAPI_ASYNC_QUEUE_WORK(). Runs on
+ * work_pool and is handed back to the main thread through
+ * dcn_context_t.work_async. Exclusive work of a context doesn't run
+ * alongside other work of the same context. priority is one of the
+ * WORKPOOL_ classes, interactive unless the binding says otherwise, and
+ * interactive work overtakes background work of the same context too.
+ */
+typedef struct dcn_work_t {
+  struct dcn_context_t* dcn_context;
+  napi_async_execute_callback execute;
+  napi_async_complete_callback complete;
+  void* data;
+  int exclusive;
+  int priority;
+  struct dcn_work_t* next;
+} dcn_work_t;
+
 /**
  * Custom context
  */
 typedef struct dcn_context_t {
   dc_context_t* dc_context;
-#ifdef NODE_10_6
-  napi_threadsafe_function threadsafe_event_handler;
-#else
   eventqueue_t* event_queue;
-#endif
+  eventqueue_item_t* undelivered;
+  size_t undelivered_cnt;
+  eventstats_t* event_stats;
+  uv_async_t* event_async;
+  napi_env event_env;
+  napi_ref event_handler_ref;
+  napi_async_context event_async_context;
+  atomic_uint event_mask[DCN_EVENT_MASK_WORDS];
+  journal_writer_t* journal;
+  atomic_int journal_active;
+  atomic_uint stop_generation;
+  pthread_rwlock_t journal_lock;
+  struct dcn_replay_event_journal_carrier_t* replay;
   strtable_t* strtable;
   uv_thread_t imap_thread;
   uv_thread_t smtp_thread;
   uv_thread_t mvbox_thread;
   uv_thread_t sentbox_thread;
   int loop_thread;
-  pthread_mutex_t dc_event_http_mutex;
-  pthread_cond_t  dc_event_http_cond;
-  int             dc_event_http_done;
-  char*           dc_event_http_response;
+  httpwait_t*         http_wait;
+  workpool_group_t    work_group;
+  uv_async_t*         work_async;
+  pthread_mutex_t     work_mutex;
+  dcn_work_t*         work_done;
+  uint32_t            work_pending;
+  napi_ref            work_context_ref;
+  napi_env            work_env;
+  napi_ref            work_resource_ref;
+  napi_async_context  work_async_context;
 } dcn_context_t;
 
+static int dcn_event_wanted(dcn_context_t* dcn_context, int event)
+{
+  if (event < 0 || event >= DCN_EVENT_MASK_BITS) {
+    return 1;
+  }
+  unsigned int word = atomic_load_explicit(&dcn_context->event_mask[event / 32],
+                                           memory_order_relaxed);
+  return (word >> (event % 32)) & 1;
+}
+
+/**
+ * Tells the main thread that there are events in the queue. Never blocks,
+ * the events wait in the queue until the main thread gets to them. Safe
+ * from any thread, core's as well as the pool's, for as long as the
+ * context lives.
+ */
+static void dcn_event_wakeup(dcn_context_t* dcn_context)
+{
+  uv_async_send(dcn_context->event_async);
+}
+
+/**
+ * Queues an event for the main thread unless nobody listens to it.
+ * Returns 1 if the event was queued.
+ */
+static int dcn_queue_event(dcn_context_t* dcn_context, int event, uintptr_t data1, uintptr_t data2)
+{
+  // Checked before anything is copied, nobody listens to these
+  if (!dcn_event_wanted(dcn_context, event)) {
+    return 0;
+  }
+  if (dcn_context->event_queue &&
+      eventqueue_push(dcn_context->event_queue, event, data1, data2)) {
+    dcn_event_wakeup(dcn_context);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Appends an event to the journal, if one is recording. The lock is only
+ * taken while recording and keeps dcn_stop_event_journal() from closing
+ * the journal under our feet.
+ */
+static void dcn_journal_event(dcn_context_t* dcn_context, int event, uintptr_t data1, uintptr_t data2)
+{
+  if (!atomic_load_explicit(&dcn_context->journal_active, memory_order_relaxed)) {
+    return;
+  }
+  pthread_rwlock_rdlock(&dcn_context->journal_lock);
+    journal_writer_append(dcn_context->journal, event, data1, data2);
+  pthread_rwlock_unlock(&dcn_context->journal_lock);
+}
+
+static int dcn_http_get_send(void* userdata, const char* url, uint32_t request_id)
+{
+  dcn_context_t* dcn_context = (dcn_context_t*)userdata;
+  if (dcn_context->event_queue &&
+      eventqueue_push(dcn_context->event_queue, DC_EVENT_HTTP_GET, (uintptr_t)url, request_id)) {
+    dcn_event_wakeup(dcn_context);
+    return 1;
+  }
+  return 0;
+}
+
 /**
- * Event struct for calling back to JavaScript
+ * Asks JS to fetch an url and waits for the answer, passed back by
+ * dcn_set_http_get_response() with the request id in data2. Returns NULL
+ * if the request failed or there was no answer within the httpGetTimeout.
+ * Answers are cached in http_cache, hits don't involve JS at all.
  */
-typedef struct dcn_event_t {
-  int event;
-  uintptr_t data1_int;
-  uintptr_t data2_int;
-  char* data1_str;
-  char* data2_str;
-} dcn_event_t;
+static char* dcn_http_get(dcn_context_t* dcn_context, uintptr_t url)
+{
+  char* response = NULL;
+  if (httpcache_get(http_cache, (const char*)url, &response)) {
+    return response;
+  }
+
+  // A timeout says nothing about the url, failed requests are answered null
+  if (httpwait_request(dcn_context->http_wait, (const char*)url,
+                       dcn_http_get_send, dcn_context, &response)) {
+    httpcache_put(http_cache, (const char*)url, response);
+  }
+  return response;
+}
 
 static uintptr_t dc_event_handler(dc_context_t* dc_context, int event, uintptr_t data1, uintptr_t data2)
 {
   dcn_context_t* dcn_context = (dcn_context_t*)dc_get_userdata(dc_context);
 
+  if (event != DC_EVENT_GET_STRING) {
+    dcn_journal_event(dcn_context, event, data1, data2);
+  }
+
   switch (event) {
     case DC_EVENT_GET_STRING:
       return (uintptr_t)strtable_get_str(dcn_context->strtable, (int)data1);
 
-    case DC_EVENT_HTTP_GET: {
-      uintptr_t http_ret = 0;
-      if (dcn_context->event_queue) {
-        eventqueue_push(dcn_context->event_queue, event, data1, data2);
-
-        pthread_mutex_lock(&dcn_context->dc_event_http_mutex);
-          // while() is to protect against spuriously wakeups
-          while (!dcn_context->dc_event_http_done) {
-            // unlock -> wait -> lock
-            pthread_cond_wait(&dcn_context->dc_event_http_cond, &dcn_context->dc_event_http_mutex);
-          }
-          http_ret = (uintptr_t)dcn_context->dc_event_http_response;
-          dcn_context->dc_event_http_response = NULL;
-          dcn_context->dc_event_http_done = 0;
-        pthread_mutex_unlock(&dcn_context->dc_event_http_mutex);
-      }
-      return http_ret;
-    }
+    case DC_EVENT_HTTP_GET:
+      return (uintptr_t)dcn_http_get(dcn_context, data1);
 
     default:
-#ifdef NODE_10_6
-      if (dcn_context->threadsafe_event_handler) {
-        dcn_event_t* dcn_event = calloc(1, sizeof(dcn_event_t));
-        dcn_event->event = event;
-        dcn_event->data1_int = data1;
-        dcn_event->data2_int = data2;
-        dcn_event->data1_str = (DC_EVENT_DATA1_IS_STRING(event) && data1) ? strdup((char*)data1) : NULL;
-        dcn_event->data2_str = (DC_EVENT_DATA2_IS_STRING(event) && data2) ? strdup((char*)data2) : NULL;
-        napi_call_threadsafe_function(dcn_context->threadsafe_event_handler, dcn_event, napi_tsfn_blocking);
-      }
-#else
-      if (dcn_context->event_queue) {
-        eventqueue_push(dcn_context->event_queue, event, data1, data2);
-      }
-#endif
+      dcn_queue_event(dcn_context, event, data1, data2);
       break;
   }
 
   return 0;
 }
 
-#ifdef NODE_10_6
-static void call_js_event_handler(napi_env env, napi_value js_callback, void* context, void* data)
-{
-  dcn_event_t* dcn_event = (dcn_event_t*)data;
+/**
+ * Turns a list of queued events into a single batch object:
+ *
+ *   { event: Int32Array, data1: Int32Array, data2: Int32Array, strings: Array,
+ *     emitted: Float64Array }
+ *
+ * All three Int32Arrays are views on the same ArrayBuffer. String payloads
+ * are put in strings[2 * i] (data1) and strings[2 * i + 1] (data2), all
+ * other slots of strings are left empty. JavaScript fills in emitted[i], the
+ * microseconds from the start of the callback until event i was emitted;
+ * it starts out as -1. If given, `events` is set to the backing store of
+ * the event array. `emitted` is only part of the batch if requested, it is
+ * set to its backing store then.
+ */
+static napi_value eventqueue_items_to_js(napi_env env, eventqueue_item_t* items, uint32_t cnt,
+                                         int32_t** events, double** emitted) {
+  int32_t* data = NULL;
+  napi_value arraybuffer;
+  NAPI_STATUS_THROWS(napi_create_arraybuffer(env, 3 * cnt * sizeof(int32_t),
+                                             (void**)&data, &arraybuffer));
+
+  napi_value strings;
+  NAPI_STATUS_THROWS(napi_create_array_with_length(env, 2 * cnt, &strings));
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    eventqueue_item_t* item = &items[i];
+    data[i] = item->event;
+
+    if (DC_EVENT_DATA1_IS_STRING(item->event)) {
+      napi_value str;
+      if (item->data1) {
+        NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data1,
+                                                   NAPI_AUTO_LENGTH, &str));
+      } else {
+        NAPI_STATUS_THROWS(napi_get_null(env, &str));
+      }
+      NAPI_STATUS_THROWS(napi_set_element(env, strings, 2 * i, str));
+      data[cnt + i] = 0;
+    } else {
+      data[cnt + i] = (int32_t)item->data1;
+    }
 
-  napi_value global;
-  napi_status status = napi_get_global(env, &global);
+    if (DC_EVENT_DATA2_IS_STRING(item->event)) {
+      napi_value str;
+      if (item->data2) {
+        NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data2,
+                                                   NAPI_AUTO_LENGTH, &str));
+      } else {
+        NAPI_STATUS_THROWS(napi_get_null(env, &str));
+      }
+      NAPI_STATUS_THROWS(napi_set_element(env, strings, 2 * i + 1, str));
+      data[2 * cnt + i] = 0;
+    } else {
+      data[2 * cnt + i] = (int32_t)item->data2;
+    }
+  }
 
-  if (status != napi_ok) {
-    napi_throw_error(env, NULL, "Unable to get global");
+  napi_value event;
+  napi_value data1;
+  napi_value data2;
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_int32_array, cnt,
+                                            arraybuffer, 0, &event));
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_int32_array, cnt,
+                                            arraybuffer, cnt * sizeof(int32_t),
+                                            &data1));
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_int32_array, cnt,
+                                            arraybuffer, 2 * cnt * sizeof(int32_t),
+                                            &data2));
+
+  napi_value batch;
+  NAPI_STATUS_THROWS(napi_create_object(env, &batch));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, batch, "event", event));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, batch, "data1", data1));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, batch, "data2", data2));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, batch, "strings", strings));
+
+  if (emitted) {
+    double* emitted_data = NULL;
+    napi_value emitted_buffer;
+    napi_value emitted_array;
+    NAPI_STATUS_THROWS(napi_create_arraybuffer(env, cnt * sizeof(double),
+                                               (void**)&emitted_data, &emitted_buffer));
+    NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_float64_array, cnt,
+                                              emitted_buffer, 0, &emitted_array));
+    for (uint32_t i = 0; i < cnt; i++) {
+      emitted_data[i] = -1;
+    }
+    NAPI_STATUS_THROWS(napi_set_named_property(env, batch, "emitted", emitted_array));
+    *emitted = emitted_data;
   }
 
-  const int argc = 3;
-  napi_value argv[argc];
+  if (events) {
+    *events = data;
+  }
 
-  status = napi_create_int32(env, dcn_event->event, &argv[0]);
-  if (status != napi_ok) {
-    napi_throw_error(env, NULL, "Unable to create argv[0] for event_handler arguments");
+  return batch;
+}
+
+/**
+ * Records how long the items waited in the queue, `now` is when they were
+ * taken out.
+ */
+static void dcn_record_queued(dcn_context_t* dcn_context, eventqueue_item_t* items,
+                              size_t cnt, uint64_t now)
+{
+  if (dcn_context->event_stats == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < cnt; i++) {
+    uint64_t waited = now > items[i].timestamp ? now - items[i].timestamp : 0;
+    eventstats_record(dcn_context->event_stats, items[i].event,
+                      EVENTSTATS_QUEUED, waited / 1000);
   }
+}
 
-  if (dcn_event->data1_str) {
-    status = napi_create_string_utf8(env, dcn_event->data1_str, NAPI_AUTO_LENGTH, &argv[1]);
-    if (status != napi_ok) {
-      napi_throw_error(env, NULL, "Unable to create argv[1] for event_handler arguments");
-    }
-    free(dcn_event->data1_str);
-  } else {
-    status = napi_create_int32(env, dcn_event->data1_int, &argv[1]);
-    if (status != napi_ok) {
-      napi_throw_error(env, NULL, "Unable to create argv[1] for event_handler arguments");
+/**
+ * Takes everything that is queued, after the events that could not be
+ * handed over to JavaScript the last time. `owned` is set if `items` was
+ * allocated here, pass it on to dcn_release_events().
+ */
+static size_t dcn_take_events(dcn_context_t* dcn_context, eventqueue_item_t** items,
+                              int* owned)
+{
+  eventqueue_item_t* popped = NULL;
+  size_t cnt = eventqueue_pop_all(dcn_context->event_queue, &popped);
+  dcn_record_queued(dcn_context, popped, cnt, eventqueue_now());
+
+  size_t kept = dcn_context->undelivered_cnt;
+  *owned = kept > 0;
+  if (kept == 0) {
+    *items = popped;
+    return cnt;
+  }
+
+  eventqueue_item_t* all = realloc(dcn_context->undelivered,
+                                   (kept + cnt) * sizeof(eventqueue_item_t));
+  if (all == NULL) {
+    exit(666);
+  }
+  memcpy(all + kept, popped, cnt * sizeof(eventqueue_item_t));
+  dcn_context->undelivered = NULL;
+  dcn_context->undelivered_cnt = 0;
+  *items = all;
+  return kept + cnt;
+}
+
+/**
+ * Takes the oldest event, like dcn_take_events() does for all of them
+ */
+static int dcn_take_event(dcn_context_t* dcn_context, eventqueue_item_t* item)
+{
+  if (dcn_context->undelivered_cnt > 0) {
+    *item = dcn_context->undelivered[0];
+    dcn_context->undelivered_cnt--;
+    memmove(dcn_context->undelivered, dcn_context->undelivered + 1,
+            dcn_context->undelivered_cnt * sizeof(eventqueue_item_t));
+    if (dcn_context->undelivered_cnt == 0) {
+      free(dcn_context->undelivered);
+      dcn_context->undelivered = NULL;
     }
+    return 1;
   }
 
-  if (dcn_event->data2_str) {
-    status = napi_create_string_utf8(env, dcn_event->data2_str, NAPI_AUTO_LENGTH, &argv[2]);
-    if (status != napi_ok) {
-      napi_throw_error(env, NULL, "Unable to create argv[2] for event_handler arguments");
+  if (!eventqueue_pop(dcn_context->event_queue, item)) {
+    return 0;
+  }
+  dcn_record_queued(dcn_context, item, 1, eventqueue_now());
+  return 1;
+}
+
+/**
+ * Gives the strings of the items back to the queue once they are copied
+ * into a batch. Without a batch, the conversion failed half way, and the
+ * items are kept to be delivered before the next ones instead.
+ */
+static void dcn_release_events(dcn_context_t* dcn_context, eventqueue_item_t* items,
+                               size_t cnt, int owned, napi_value batch)
+{
+  if (batch != NULL) {
+    eventqueue_items_clear(dcn_context->event_queue, items, cnt);
+    if (owned) {
+      free(items);
     }
-    free(dcn_event->data2_str);
-  } else {
-    status = napi_create_int32(env, dcn_event->data2_int, &argv[2]);
-    if (status != napi_ok) {
-      napi_throw_error(env, NULL, "Unable to create argv[2] for event_handler arguments");
+    return;
+  }
+
+  if (!owned) {
+    // The queue reuses its buffer for the next eventqueue_pop_all()
+    eventqueue_item_t* copy = malloc(cnt * sizeof(eventqueue_item_t));
+    if (copy == NULL) {
+      exit(666);
     }
+    memcpy(copy, items, cnt * sizeof(eventqueue_item_t));
+    items = copy;
+  }
+  dcn_context->undelivered = items;
+  dcn_context->undelivered_cnt = cnt;
+}
+
+/**
+ * Hands everything that is queued over to JavaScript as one batch. Events
+ * queued while the handler runs end up in the next batch, so do events that
+ * could not be converted, e.g. because an exception was pending.
+ */
+static void dcn_deliver_events(dcn_context_t* dcn_context, napi_env env,
+                               napi_value callback,
+                               napi_async_context async_context)
+{
+  eventqueue_item_t* items = NULL;
+  int owned = 0;
+  size_t cnt = dcn_take_events(dcn_context, &items, &owned);
+  if (cnt == 0) {
+    return;
   }
 
-  free(dcn_event);
-  dcn_event = NULL;
+  uint64_t popped = eventqueue_now();
 
-  napi_value result;
-  status = napi_call_function(
-    env,
-    global,
-    js_callback,
-    argc,
-    argv,
-    &result);
+  napi_value global;
+  napi_get_global(env, &global);
+
+  // The batch holds copies, release the items before JavaScript gets a
+  // chance to pop from the queue again. Without statistics JavaScript
+  // doesn't measure the dispatch either.
+  int32_t* events = NULL;
+  double* emitted = NULL;
+  napi_value batch = eventqueue_items_to_js(env, items, cnt, &events,
+                                            dcn_context->event_stats ? &emitted : NULL);
+  dcn_release_events(dcn_context, items, cnt, owned, batch);
+
+  napi_status status = napi_generic_failure;
+  uint64_t called = eventqueue_now();
+  if (batch != NULL) {
+    status = async_context
+      // napi_make_callback() also runs the nextTick and microtask queues
+      ? napi_make_callback(env, async_context, global, callback, 1, &batch, NULL)
+      : napi_call_function(env, global, callback, 1, &batch, NULL);
+
+    // The batch is still referenced from this handle scope
+    uint64_t before_call = (called - popped) / 1000;
+    for (size_t i = 0; emitted && i < cnt; i++) {
+      if (emitted[i] >= 0) {
+        eventstats_record(dcn_context->event_stats, events[i], EVENTSTATS_DISPATCH,
+                          before_call + (uint64_t)emitted[i]);
+      }
+    }
+  }
 
   if (status != napi_ok) {
-    napi_throw_error(env, NULL, "Unable to call event_handler callback");
+    // The JavaScript side rethrows outside of this callback,
+    // just make sure nothing is left pending here
+    napi_value exception;
+    napi_get_and_clear_last_exception(env, &exception);
+  }
+}
+
+/**
+ * Runs on the main loop whenever dcn_event_wakeup() has signalled
+ * event_async. uv_async_send() calls are coalesced, so one run delivers
+ * everything that is pending.
+ */
+static void dcn_event_async_cb(uv_async_t* handle)
+{
+  dcn_context_t* dcn_context = (dcn_context_t*)handle->data;
+  if (dcn_context == NULL || dcn_context->event_handler_ref == NULL) {
+    return;
+  }
+
+  napi_env env = dcn_context->event_env;
+  napi_handle_scope scope;
+  if (napi_open_handle_scope(env, &scope) != napi_ok) {
+    return;
   }
+
+  napi_value callback;
+  if (napi_get_reference_value(env, dcn_context->event_handler_ref, &callback) == napi_ok) {
+    dcn_deliver_events(dcn_context, env, callback,
+                       dcn_context->event_async_context);
+  }
+
+  napi_close_handle_scope(env, scope);
+}
+
+static void dcn_event_async_close_cb(uv_handle_t* handle)
+{
+  free(handle);
 }
-#endif
 
 static void imap_thread_func(void* arg)
 {
   dcn_context_t* dcn_context = (dcn_context_t*)arg;
   dc_context_t* dc_context = dcn_context->dc_context;
 
-#ifdef NODE_10_6
-  napi_acquire_threadsafe_function(dcn_context->threadsafe_event_handler);
-#endif
-
   while (dcn_context->loop_thread) {
     dc_perform_imap_jobs(dc_context);
     dc_perform_imap_fetch(dc_context);
     dc_perform_imap_idle(dc_context);
   }
-
-#ifdef NODE_10_6
-  napi_release_threadsafe_function(dcn_context->threadsafe_event_handler, napi_tsfn_release);
-#endif
 }
 
 static void smtp_thread_func(void* arg)
@@ -188,18 +512,10 @@ static void smtp_thread_func(void* arg)
   dcn_context_t* dcn_context = (dcn_context_t*)arg;
   dc_context_t* dc_context = dcn_context->dc_context;
 
-#ifdef NODE_10_6
-  napi_acquire_threadsafe_function(dcn_context->threadsafe_event_handler);
-#endif
-
   while (dcn_context->loop_thread) {
     dc_perform_smtp_jobs(dc_context);
     dc_perform_smtp_idle(dc_context);
   }
-
-#ifdef NODE_10_6
-  napi_release_threadsafe_function(dcn_context->threadsafe_event_handler, napi_tsfn_release);
-#endif
 }
 
 
@@ -208,18 +524,10 @@ static void mvbox_thread_func(void* arg)
   dcn_context_t* dcn_context = (dcn_context_t*)arg;
   dc_context_t* dc_context = dcn_context->dc_context;
 
-#ifdef NODE_10_6
-  napi_acquire_threadsafe_function(dcn_context->threadsafe_event_handler);
-#endif
-
   while (dcn_context->loop_thread) {
     dc_perform_mvbox_fetch(dc_context);
     dc_perform_mvbox_idle(dc_context);
   }
-
-#ifdef NODE_10_6
-  napi_release_threadsafe_function(dcn_context->threadsafe_event_handler, napi_tsfn_release);
-#endif
 }
 
 static void sentbox_thread_func(void* arg)
@@ -227,20 +535,160 @@ static void sentbox_thread_func(void* arg)
   dcn_context_t* dcn_context = (dcn_context_t*)arg;
   dc_context_t* dc_context = dcn_context->dc_context;
 
-#ifdef NODE_10_6
-  napi_acquire_threadsafe_function(dcn_context->threadsafe_event_handler);
-#endif
-
   while (dcn_context->loop_thread) {
     dc_perform_sentbox_fetch(dc_context);
     dc_perform_sentbox_idle(dc_context);
   }
+}
+
+
+/**
+ * Async work on work_pool
+ */
+
+static void dcn_work_execute(void* data)
+{
+  dcn_work_t* work = (dcn_work_t*)data;
+  work->execute(NULL, work->data);
+}
+
+/**
+ * Called on the pool thread once the work is done, or on the main thread
+ * for work that doesn't run on work_pool
+ */
+static void dcn_work_done(void* data)
+{
+  dcn_work_t* work = (dcn_work_t*)data;
+  dcn_context_t* dcn_context = work->dcn_context;
+
+  pthread_mutex_lock(&dcn_context->work_mutex);
+  work->next = dcn_context->work_done;
+  dcn_context->work_done = work;
+  pthread_mutex_unlock(&dcn_context->work_mutex);
+
+  uv_async_send(dcn_context->work_async);
+}
+
+/**
+ * Runs the complete callbacks of the finished work on the main loop, in
+ * the order the work finished
+ */
+static void dcn_work_async_cb(uv_async_t* handle)
+{
+  dcn_context_t* dcn_context = (dcn_context_t*)handle->data;
+  if (dcn_context == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&dcn_context->work_mutex);
+  dcn_work_t* done = dcn_context->work_done;
+  dcn_context->work_done = NULL;
+  pthread_mutex_unlock(&dcn_context->work_mutex);
+
+  dcn_work_t* work = NULL;
+  while (done) {
+    dcn_work_t* next = done->next;
+    done->next = work;
+    work = done;
+    done = next;
+  }
+
+  napi_env env = dcn_context->work_env;
+  uint32_t released = 0;
+  while (work) {
+    // The complete callback frees the carrier and the work with it
+    dcn_work_t* next = work->next;
+
+    napi_handle_scope scope;
+    napi_callback_scope callback_scope;
+    napi_value resource;
+    if (napi_open_handle_scope(env, &scope) != napi_ok) {
+      // Put the rest back in front of the newer work and retry it on the
+      // next wakeup, it stays pending until then
+      dcn_work_t* rest = NULL;
+      while (work) {
+        next = work->next;
+        work->next = rest;
+        rest = work;
+        work = next;
+      }
+      pthread_mutex_lock(&dcn_context->work_mutex);
+      dcn_work_t** tail = &dcn_context->work_done;
+      while (*tail) {
+        tail = &(*tail)->next;
+      }
+      *tail = rest;
+      pthread_mutex_unlock(&dcn_context->work_mutex);
+      uv_async_send(handle);
+      break;
+    }
+
+    // Only keeps the loop alive while work is pending
+    if (--dcn_context->work_pending == 0) {
+      uv_unref((uv_handle_t*)handle);
+      released++;
+    }
+    napi_get_reference_value(env, dcn_context->work_resource_ref, &resource);
+    napi_open_callback_scope(env, resource, dcn_context->work_async_context,
+                             &callback_scope);
+
+    work->complete(env, napi_ok, work->data);
+
+    // Same as an exception thrown from any other callback
+    bool pending = false;
+    napi_is_exception_pending(env, &pending);
+    if (pending) {
+      napi_value exception;
+      napi_get_and_clear_last_exception(env, &exception);
+      napi_fatal_exception(env, exception);
+    }
+
+    napi_close_callback_scope(env, callback_scope);
+    napi_close_handle_scope(env, scope);
+    work = next;
+  }
+
+  // Not before all of the work is done, the context may be collected then
+  while (released--) {
+    napi_reference_unref(env, dcn_context->work_context_ref, NULL);
+  }
+}
+
+static void dcn_work_async_close_cb(uv_handle_t* handle)
+{
+  free(handle);
+}
 
-#ifdef NODE_10_6
-  napi_release_threadsafe_function(dcn_context->threadsafe_event_handler, napi_tsfn_release);
-#endif
+/**
+ * Counts the work as pending until dcn_work_done() hands it back, also for
+ * work that doesn't run on work_pool
+ */
+static void dcn_work_begin(dcn_context_t* dcn_context, dcn_work_t* work,
+                           napi_async_complete_callback complete,
+                           void* data)
+{
+  work->dcn_context = dcn_context;
+  work->complete = complete;
+  work->data = data;
+
+  // Keeps the context from being collected while the pool may use it
+  if (dcn_context->work_pending++ == 0) {
+    uv_ref((uv_handle_t*)dcn_context->work_async);
+    napi_reference_ref(dcn_context->work_env, dcn_context->work_context_ref, NULL);
+  }
 }
 
+static void dcn_work_queue(dcn_context_t* dcn_context, dcn_work_t* work,
+                           napi_async_execute_callback execute,
+                           napi_async_complete_callback complete,
+                           void* data)
+{
+  work->execute = execute;
+  dcn_work_begin(dcn_context, work, complete, data);
+  workpool_push(work_pool, &dcn_context->work_group,
+                work->exclusive ? WORKPOOL_EXCLUSIVE : 0,
+                work->priority, dcn_work_execute, dcn_work_done, work);
+}
 
 /**
  * Finalize functions. These are called once the corresponding
@@ -270,21 +718,55 @@ static void finalize_context(napi_env env, void* data, void* hint) {
     dcn_context_t* dcn_context = (dcn_context_t*)data;
     dc_context_unref(dcn_context->dc_context);
     dcn_context->dc_context = NULL;
+    if (dcn_context->event_handler_ref) {
+      napi_delete_reference(env, dcn_context->event_handler_ref);
+      dcn_context->event_handler_ref = NULL;
+    }
+    napi_async_destroy(env, dcn_context->event_async_context);
+    dcn_context->event_async->data = NULL;
+    uv_close((uv_handle_t*)dcn_context->event_async, dcn_event_async_close_cb);
+    dcn_context->event_async = NULL;
     if (dcn_context->event_queue) {
+      eventqueue_items_clear(dcn_context->event_queue, dcn_context->undelivered,
+                             dcn_context->undelivered_cnt);
+      free(dcn_context->undelivered);
+      dcn_context->undelivered = NULL;
       eventqueue_unref(dcn_context->event_queue);
       dcn_context->event_queue = NULL;
     }
+    eventstats_unref(dcn_context->event_stats);
+    dcn_context->event_stats = NULL;
+
+    journal_writer_unref(dcn_context->journal);
+    dcn_context->journal = NULL;
+    pthread_rwlock_destroy(&dcn_context->journal_lock);
 
     strtable_unref(dcn_context->strtable);
     dcn_context->strtable = NULL;
 
-    pthread_cond_destroy(&dcn_context->dc_event_http_cond);
-    pthread_mutex_destroy(&dcn_context->dc_event_http_mutex);
+    httpwait_unref(dcn_context->http_wait);
+    dcn_context->http_wait = NULL;
+
+    // Pending work holds a reference to the context
+    assert(dcn_context->work_pending == 0);
+    napi_delete_reference(env, dcn_context->work_context_ref);
+    napi_delete_reference(env, dcn_context->work_resource_ref);
+    napi_async_destroy(env, dcn_context->work_async_context);
+    dcn_context->work_async->data = NULL;
+    uv_close((uv_handle_t*)dcn_context->work_async, dcn_work_async_close_cb);
+    dcn_context->work_async = NULL;
+    pthread_mutex_destroy(&dcn_context->work_mutex);
 
     free(dcn_context);
   }
 }
 
+static void finalize_strtable(napi_env env, void* data, void* hint) {
+  if (data) {
+    strtable_unref((strtable_t*)data);
+  }
+}
+
 static void finalize_lot(napi_env env, void* data, void* hint) {
   if (data) {
     dc_lot_unref((dc_lot_t*)data);
@@ -305,87 +787,1510 @@ static uint32_t* js_array_to_uint32(napi_env env, napi_value js_array, uint32_t*
   *length = 0;
   NAPI_STATUS_THROWS(napi_get_array_length(env, js_array, length));
 
-  uint32_t* array = calloc(*length, sizeof(uint32_t));
+  uint32_t* array = calloc(*length ? *length : 1, sizeof(uint32_t));
+  if (array == NULL) {
+    exit(666);
+  }
 
   for (uint32_t i = 0; i < *length; i++) {
     napi_value napi_element;
-    NAPI_STATUS_THROWS(napi_get_element(env, js_array, i, &napi_element));
-    NAPI_STATUS_THROWS(napi_get_value_uint32(env, napi_element, &array[i]));
+    if (napi_get_element(env, js_array, i, &napi_element) != napi_ok ||
+        napi_get_value_uint32(env, napi_element, &array[i]) != napi_ok) {
+      // Does nothing if a getter of the array threw already
+      napi_throw_type_error(env, NULL, "Expected an array of numbers");
+      free(array);
+      *length = 0;
+      return NULL;
+    }
   }
 
   return array;
 }
 
-static napi_value dc_array_to_js_array(napi_env env, dc_array_t* array) {
-  napi_value js_array;
-
-  const int length = dc_array_get_cnt(array);
-  NAPI_STATUS_THROWS(napi_create_array_with_length(env, length, &js_array));
+/**
+ * Copies the elements of an integer typed array other than a Uint32Array,
+ * negative numbers wrap around like napi_get_value_uint32() does
+ */
+static uint32_t* js_typedarray_to_uint32(napi_typedarray_type type, const void* data,
+                                         size_t length) {
+  uint32_t* array = calloc(length ? length : 1, sizeof(uint32_t));
+  if (array == NULL) {
+    exit(666);
+  }
 
-  if (length > 0) {
-    for (int i = 0; i < length; i++) {
-      const uint32_t id = dc_array_get_id(array, i);
-      napi_value napi_id;
-      NAPI_STATUS_THROWS(napi_create_uint32(env, id, &napi_id));
-      NAPI_STATUS_THROWS(napi_set_element(env, js_array, i, napi_id));
+  for (size_t i = 0; i < length; i++) {
+    switch (type) {
+      case napi_int8_array: array[i] = (uint32_t)((const int8_t*)data)[i]; break;
+      case napi_uint8_array:
+      case napi_uint8_clamped_array: array[i] = ((const uint8_t*)data)[i]; break;
+      case napi_int16_array: array[i] = (uint32_t)((const int16_t*)data)[i]; break;
+      case napi_uint16_array: array[i] = ((const uint16_t*)data)[i]; break;
+      case napi_int32_array: array[i] = (uint32_t)((const int32_t*)data)[i]; break;
+      default: break;
     }
   }
 
-  return js_array;
+  return array;
 }
 
 /**
- * Main context.
+ * Gets a list of ids from a Uint32Array without copying, or from another
+ * integer typed array or a plain array of numbers. `*owned` tells if the
+ * result must be free()d, without, it points into the typed array and is
+ * valid as long as it is alive. Returns NULL with an exception pending if
+ * the value is neither, e.g. a Float64Array or an array holding a string.
+ * Only for use on the main thread, async work must use js_to_uint32_ids_copy().
  */
+static uint32_t* js_to_uint32_ids(napi_env env, napi_value value, uint32_t* length, int* owned) {
+  static uint32_t no_ids[1];
+  bool is_typedarray = false;
+  *length = 0;
+  *owned = 0;
+  NAPI_STATUS_THROWS(napi_is_typedarray(env, value, &is_typedarray));
 
-NAPI_METHOD(dcn_context_new) {
-  dcn_context_t* dcn_context = calloc(1, sizeof(dcn_context_t));
-  dcn_context->dc_context = dc_context_new(dc_event_handler, dcn_context, NULL);
-#ifdef NODE_10_6
-  dcn_context->threadsafe_event_handler = NULL;
-#else
-  dcn_context->event_queue = eventqueue_new();
-#endif
-  dcn_context->strtable = strtable_new();
+  if (!is_typedarray) {
+    *owned = 1;
+    return js_array_to_uint32(env, value, length);
+  }
 
-  dcn_context->imap_thread = 0;
-  dcn_context->smtp_thread = 0;
-  dcn_context->mvbox_thread = 0;
-  dcn_context->sentbox_thread = 0;
+  napi_typedarray_type type;
+  size_t typed_length;
+  void* data;
+  NAPI_STATUS_THROWS(napi_get_typedarray_info(env, value, &type, &typed_length,
+                                              &data, NULL, NULL));
+  switch (type) {
+    case napi_uint32_array:
+      *length = typed_length;
+      // An empty typed array may have no buffer at all, NULL means failure
+      return typed_length ? (uint32_t*)data : no_ids;
+    case napi_int8_array:
+    case napi_uint8_array:
+    case napi_uint8_clamped_array:
+    case napi_int16_array:
+    case napi_uint16_array:
+    case napi_int32_array:
+      *length = typed_length;
+      *owned = 1;
+      return js_typedarray_to_uint32(type, data, typed_length);
+    default:
+      napi_throw_type_error(env, NULL, "Expected a Uint32Array or an array of numbers");
+      return NULL;
+  }
+}
 
-  dcn_context->loop_thread = 0;
+/**
+ * Like js_to_uint32_ids(), but always returns a copy that async work can
+ * own, or NULL with an exception pending
+ */
+static uint32_t* js_to_uint32_ids_copy(napi_env env, napi_value value, uint32_t* length) {
+  int owned;
+  uint32_t* ids = js_to_uint32_ids(env, value, length, &owned);
+  if (ids == NULL || owned) {
+    return ids;
+  }
+
+  uint32_t* copy = malloc(*length * sizeof(uint32_t) + 1);
+  if (copy == NULL) {
+    exit(666);
+  }
+  memcpy(copy, ids, *length * sizeof(uint32_t));
+  return copy;
+}
+
+/**
+ * Replaces all strings of a table with an array of strings indexed by
+ * DC_STR_*, holes and non-strings stay unset. With merge set they keep
+ * their current value instead. Returns the number of strings set.
+ */
+static napi_value js_array_to_strtable(napi_env env, strtable_t* strtable, napi_value js_array,
+                                       int merge) {
+  uint32_t length;
+  NAPI_STATUS_THROWS(napi_get_array_length(env, js_array, &length));
+  if (length > DC_STR_COUNT) {
+    length = DC_STR_COUNT;
+  }
+
+  char* strs[DC_STR_COUNT] = { NULL };
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value element;
+    napi_valuetype type;
+    NAPI_STATUS_THROWS(napi_get_element(env, js_array, i, &element));
+    NAPI_STATUS_THROWS(napi_typeof(env, element, &type));
+    if (type != napi_string) {
+      continue;
+    }
+    size_t size;
+    NAPI_STATUS_THROWS(napi_get_value_string_utf8(env, element, NULL, 0, &size));
+    strs[i] = malloc(size + 1);
+    NAPI_STATUS_THROWS(napi_get_value_string_utf8(env, element, strs[i], size + 1, &size));
+  }
+
+  int loaded = merge
+    ? strtable_merge(strtable, (const char* const*)strs, length)
+    : strtable_load(strtable, (const char* const*)strs, length);
 
-  dcn_context->dc_event_http_done = 0;
-  dcn_context->dc_event_http_response = NULL;
-  pthread_mutex_init(&dcn_context->dc_event_http_mutex, NULL);
-  pthread_cond_init(&dcn_context->dc_event_http_cond, NULL);
+  for (uint32_t i = 0; i < length; i++) {
+    free(strs[i]);
+  }
 
   napi_value result;
-  NAPI_STATUS_THROWS(napi_create_external(env, dcn_context,
-                                          finalize_context,
-                                          NULL, &result));
+  NAPI_STATUS_THROWS(napi_create_int32(env, loaded, &result));
   return result;
 }
 
 /**
- * Static functions
+ * Turns a dc_array_t of ids into a Uint32Array. The ids are copied in one
+ * pass without calling into JS per id, dc_array_t stores uintptr_t values
+ * which can't be viewed as uint32 directly on 64 bit platforms.
+ */
+static napi_value dc_array_to_uint32_array(napi_env env, dc_array_t* array) {
+  const size_t length = dc_array_get_cnt(array);
+
+  uint32_t* ids = NULL;
+  napi_value arraybuffer;
+  NAPI_STATUS_THROWS(napi_create_arraybuffer(env, length * sizeof(uint32_t),
+                                             (void**)&ids, &arraybuffer));
+  for (size_t i = 0; i < length; i++) {
+    ids[i] = dc_array_get_id(array, i);
+  }
+
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_uint32_array, length,
+                                            arraybuffer, 0, &result));
+  return result;
+}
+
+/**
+ * Property names of the objects built natively, see dcn_strings_t
  */
+typedef enum {
+  DCN_KEY_ADDRESS,
+  DCN_KEY_ARCHIVED,
+  DCN_KEY_CHAT_ID,
+  DCN_KEY_COLOR,
+  DCN_KEY_DATA1,
+  DCN_KEY_DATA2,
+  DCN_KEY_DISPLAY_NAME,
+  DCN_KEY_DURATION,
+  DCN_KEY_EVENT,
+  DCN_KEY_FILE,
+  DCN_KEY_FIRST_NAME,
+  DCN_KEY_FROM_ID,
+  DCN_KEY_HAS_DEVIATING_TIMESTAMP,
+  DCN_KEY_ID,
+  DCN_KEY_IS_BLOCKED,
+  DCN_KEY_IS_FORWARDED,
+  DCN_KEY_IS_INFO,
+  DCN_KEY_IS_SELF_TALK,
+  DCN_KEY_IS_SETUPMESSAGE,
+  DCN_KEY_IS_UNPROMOTED,
+  DCN_KEY_IS_VERIFIED,
+  DCN_KEY_NAME,
+  DCN_KEY_NAME_AND_ADDR,
+  DCN_KEY_PROFILE_IMAGE,
+  DCN_KEY_RECEIVED_TIMESTAMP,
+  DCN_KEY_SHOW_PADLOCK,
+  DCN_KEY_SORT_TIMESTAMP,
+  DCN_KEY_STATE,
+  DCN_KEY_SUBTITLE,
+  DCN_KEY_SUMMARY,
+  DCN_KEY_TEXT,
+  DCN_KEY_TEXT1,
+  DCN_KEY_TEXT1_MEANING,
+  DCN_KEY_TEXT2,
+  DCN_KEY_TIMESTAMP,
+  DCN_KEY_TYPE,
+  DCN_KEY_VIEW_TYPE,
+  DCN_KEY_COUNT
+} dcn_key_t;
+
+static const char* const dcn_key_names[DCN_KEY_COUNT] = {
+  [DCN_KEY_ADDRESS] = "address",
+  [DCN_KEY_ARCHIVED] = "archived",
+  [DCN_KEY_CHAT_ID] = "chatId",
+  [DCN_KEY_COLOR] = "color",
+  [DCN_KEY_DATA1] = "data1",
+  [DCN_KEY_DATA2] = "data2",
+  [DCN_KEY_DISPLAY_NAME] = "displayName",
+  [DCN_KEY_DURATION] = "duration",
+  [DCN_KEY_EVENT] = "event",
+  [DCN_KEY_FILE] = "file",
+  [DCN_KEY_FIRST_NAME] = "firstName",
+  [DCN_KEY_FROM_ID] = "fromId",
+  [DCN_KEY_HAS_DEVIATING_TIMESTAMP] = "hasDeviatingTimestamp",
+  [DCN_KEY_ID] = "id",
+  [DCN_KEY_IS_BLOCKED] = "isBlocked",
+  [DCN_KEY_IS_FORWARDED] = "isForwarded",
+  [DCN_KEY_IS_INFO] = "isInfo",
+  [DCN_KEY_IS_SELF_TALK] = "isSelfTalk",
+  [DCN_KEY_IS_SETUPMESSAGE] = "isSetupmessage",
+  [DCN_KEY_IS_UNPROMOTED] = "isUnpromoted",
+  [DCN_KEY_IS_VERIFIED] = "isVerified",
+  [DCN_KEY_NAME] = "name",
+  [DCN_KEY_NAME_AND_ADDR] = "nameAndAddr",
+  [DCN_KEY_PROFILE_IMAGE] = "profileImage",
+  [DCN_KEY_RECEIVED_TIMESTAMP] = "receivedTimestamp",
+  [DCN_KEY_SHOW_PADLOCK] = "showPadlock",
+  [DCN_KEY_SORT_TIMESTAMP] = "sortTimestamp",
+  [DCN_KEY_STATE] = "state",
+  [DCN_KEY_SUBTITLE] = "subtitle",
+  [DCN_KEY_SUMMARY] = "summary",
+  [DCN_KEY_TEXT] = "text",
+  [DCN_KEY_TEXT1] = "text1",
+  [DCN_KEY_TEXT1_MEANING] = "text1Meaning",
+  [DCN_KEY_TEXT2] = "text2",
+  [DCN_KEY_TIMESTAMP] = "timestamp",
+  [DCN_KEY_TYPE] = "type",
+  [DCN_KEY_VIEW_TYPE] = "viewType"
+};
 
-NAPI_METHOD(dcn_maybe_valid_addr) {
-  NAPI_ARGV(1);
-  NAPI_ARGV_UTF8_MALLOC(addr, 0);
+/**
+ * Values like chat and contact names show up over and over, the last
+ * string seen per slot is kept instead of creating it again. Longer
+ * strings, e.g. message texts, are rarely repeated and never cached.
+ */
+#define DCN_INTERN_SLOTS 512
+#define DCN_INTERN_MAX_LENGTH 128
 
-  int result = dc_may_be_valid_addr(addr);
+typedef struct dcn_interned_t {
+  uint32_t hash;
+  char* str;
+} dcn_interned_t;
 
-  free(addr);
+/**
+ * Strings for building objects, kept per env. JavaScript strings can't be
+ * referenced directly, so they live in a referenced array: the property
+ * names at their dcn_key_t index, followed by the interned values.
+ * Every env runs on a thread of its own, hence one cache per thread.
+ */
+typedef struct dcn_string_cache_t {
+  napi_env env;
+  napi_ref array_ref;
+  dcn_interned_t interned[DCN_INTERN_SLOTS];
+} dcn_string_cache_t;
+
+static __thread dcn_string_cache_t* string_cache = NULL;
+
+/**
+ * The cached strings of one env, looked up once and passed along while
+ * building a batch of objects, so every key is fetched once per batch.
+ * `cache` is NULL if the env has no cache, values are not interned then.
+ */
+typedef struct dcn_strings_t {
+  napi_env env;
+  dcn_string_cache_t* cache;
+  napi_value array;
+  napi_value keys[DCN_KEY_COUNT];
+} dcn_strings_t;
+
+static void dcn_string_cache_cleanup(void* arg) {
+  dcn_string_cache_t* cache = (dcn_string_cache_t*)arg;
+  napi_delete_reference(cache->env, cache->array_ref);
+  for (int i = 0; i < DCN_INTERN_SLOTS; i++) {
+    free(cache->interned[i].str);
+  }
+  if (string_cache == cache) {
+    string_cache = NULL;
+  }
+  free(cache);
+}
+
+static napi_value dcn_strings_init(napi_env env, dcn_strings_t* strings) {
+  memset(strings, 0, sizeof(dcn_strings_t));
+  strings->env = env;
+
+  if (string_cache != NULL && string_cache->env == env) {
+    strings->cache = string_cache;
+    NAPI_STATUS_THROWS(napi_get_reference_value(env, string_cache->array_ref,
+                                                &strings->array));
+    return strings->array;
+  }
+
+  NAPI_STATUS_THROWS(napi_create_array_with_length(env, DCN_KEY_COUNT + DCN_INTERN_SLOTS,
+                                                   &strings->array));
+  for (uint32_t i = 0; i < DCN_KEY_COUNT; i++) {
+    napi_value key;
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, dcn_key_names[i],
+                                               NAPI_AUTO_LENGTH, &key));
+    NAPI_STATUS_THROWS(napi_set_element(env, strings->array, i, key));
+  }
+
+  // Only the first env seen on this thread gets a cache
+  if (string_cache == NULL) {
+    dcn_string_cache_t* cache = calloc(1, sizeof(dcn_string_cache_t));
+    cache->env = env;
+    NAPI_STATUS_THROWS(napi_create_reference(env, strings->array, 1, &cache->array_ref));
+    NAPI_STATUS_THROWS(napi_add_env_cleanup_hook(env, dcn_string_cache_cleanup, cache));
+    string_cache = cache;
+    strings->cache = cache;
+  }
+
+  return strings->array;
+}
+
+static napi_value dcn_key(dcn_strings_t* strings, dcn_key_t key) {
+  napi_env env = strings->env;
+  if (strings->keys[key] == NULL) {
+    NAPI_STATUS_THROWS(napi_get_element(env, strings->array, key, &strings->keys[key]));
+  }
+  return strings->keys[key];
+}
+
+/**
+ * Creates a string or null. With `intern`, short strings are looked up in
+ * the cache first and stored there when missing.
+ */
+static napi_value dcn_string(dcn_strings_t* strings, const char* str, int intern) {
+  napi_env env = strings->env;
+  napi_value result;
+  if (str == NULL) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &result));
+    return result;
+  }
+
+  size_t length = strlen(str);
+  if (!intern || strings->cache == NULL || length > DCN_INTERN_MAX_LENGTH) {
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, str, length, &result));
+    return result;
+  }
+
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+  }
+
+  uint32_t slot = hash % DCN_INTERN_SLOTS;
+  dcn_interned_t* interned = &strings->cache->interned[slot];
+  if (interned->str != NULL && interned->hash == hash && strcmp(interned->str, str) == 0) {
+    NAPI_STATUS_THROWS(napi_get_element(env, strings->array, DCN_KEY_COUNT + slot, &result));
+    return result;
+  }
+
+  NAPI_STATUS_THROWS(napi_create_string_utf8(env, str, length, &result));
+  NAPI_STATUS_THROWS(napi_set_element(env, strings->array, DCN_KEY_COUNT + slot, result));
+  free(interned->str);
+  interned->hash = hash;
+  interned->str = strdup(str);
+
+  return result;
+}
+
+/**
+ * Build an object from a list of properties with keys from dcn_key() and
+ * values from dcn_string(), defined all at once by NAPI_PROPS_DEFINE()
+ */
+#define NAPI_PROPS_BEGIN(size) \
+  napi_property_descriptor props[size]; \
+  size_t props_cnt = 0;
+
+#define NAPI_PROP_VALUE(strings, key, value) { \
+  napi_value prop_key = dcn_key(strings, key); \
+  if (prop_key == NULL) { \
+    return NULL; \
+  } \
+  napi_property_descriptor prop = { NULL, prop_key, NULL, NULL, NULL, value, \
+                                    napi_writable | napi_enumerable | napi_configurable, \
+                                    NULL }; \
+  props[props_cnt++] = prop; \
+}
+
+#define NAPI_PROP_INT32(strings, key, value) { \
+  napi_value prop_value; \
+  NAPI_STATUS_THROWS(napi_create_int32(env, value, &prop_value)); \
+  NAPI_PROP_VALUE(strings, key, prop_value); \
+}
+
+#define NAPI_PROP_UINT32(strings, key, value) { \
+  napi_value prop_value; \
+  NAPI_STATUS_THROWS(napi_create_uint32(env, value, &prop_value)); \
+  NAPI_PROP_VALUE(strings, key, prop_value); \
+}
+
+#define NAPI_PROP_BOOL(strings, key, value) { \
+  napi_value prop_value; \
+  NAPI_STATUS_THROWS(napi_get_boolean(env, (value) != 0, &prop_value)); \
+  NAPI_PROP_VALUE(strings, key, prop_value); \
+}
+
+#define NAPI_PROP_STRING(strings, key, value, intern) { \
+  napi_value prop_value = dcn_string(strings, value, intern); \
+  if (prop_value == NULL) { \
+    return NULL; \
+  } \
+  NAPI_PROP_VALUE(strings, key, prop_value); \
+}
+
+#define NAPI_PROPS_DEFINE(object) \
+  NAPI_STATUS_THROWS(napi_create_object(env, &object)); \
+  NAPI_STATUS_THROWS(napi_define_properties(env, object, props_cnt, props));
+
+/**
+ * Everything Message.toJson() returns, read from a dc_msg_t in one go.
+ * Filled without touching JS, so this can happen on a worker thread.
+ */
+typedef struct dcn_msg_json_t {
+  int exists;
+  uint32_t id;
+  uint32_t chat_id;
+  uint32_t from_id;
+  int duration;
+  char* file;
+  int received_timestamp;
+  int sort_timestamp;
+  char* text;
+  int timestamp;
+  int viewtype;
+  int state;
+  int has_deviating_timestamp;
+  int showpadlock;
+  int is_setupmessage;
+  int is_info;
+  int is_forwarded;
+  int summary_state;
+  char* summary_text1;
+  int summary_text1_meaning;
+  char* summary_text2;
+  int summary_timestamp;
+} dcn_msg_json_t;
+
+static void dcn_msg_json_load(dc_context_t* dc_context, uint32_t msg_id, void* data) {
+  dcn_msg_json_t* json = (dcn_msg_json_t*)data;
+  memset(json, 0, sizeof(dcn_msg_json_t));
+
+  dc_msg_t* dc_msg = dc_get_msg(dc_context, msg_id);
+  if (dc_msg == NULL) {
+    return;
+  }
+
+  json->exists = 1;
+  json->id = dc_msg_get_id(dc_msg);
+  json->chat_id = dc_msg_get_chat_id(dc_msg);
+  json->from_id = dc_msg_get_from_id(dc_msg);
+  json->duration = dc_msg_get_duration(dc_msg);
+  json->file = dc_msg_get_file(dc_msg);
+  json->received_timestamp = dc_msg_get_received_timestamp(dc_msg);
+  json->sort_timestamp = dc_msg_get_sort_timestamp(dc_msg);
+  json->text = dc_msg_get_text(dc_msg);
+  json->timestamp = dc_msg_get_timestamp(dc_msg);
+  json->viewtype = dc_msg_get_viewtype(dc_msg);
+  json->state = dc_msg_get_state(dc_msg);
+  json->has_deviating_timestamp = dc_msg_has_deviating_timestamp(dc_msg);
+  json->showpadlock = dc_msg_get_showpadlock(dc_msg);
+  json->is_setupmessage = dc_msg_is_setupmessage(dc_msg);
+  json->is_info = dc_msg_is_info(dc_msg);
+  json->is_forwarded = dc_msg_is_forwarded(dc_msg);
+
+  dc_lot_t* summary = dc_msg_get_summary(dc_msg, NULL);
+  json->summary_state = dc_lot_get_state(summary);
+  json->summary_text1 = dc_lot_get_text1(summary);
+  json->summary_text1_meaning = dc_lot_get_text1_meaning(summary);
+  json->summary_text2 = dc_lot_get_text2(summary);
+  json->summary_timestamp = dc_lot_get_timestamp(summary);
+  dc_lot_unref(summary);
+
+  dc_msg_unref(dc_msg);
+}
+
+static void dcn_msg_json_clear(void* data) {
+  dcn_msg_json_t* json = (dcn_msg_json_t*)data;
+  free(json->file);
+  free(json->text);
+  free(json->summary_text1);
+  free(json->summary_text2);
+  memset(json, 0, sizeof(dcn_msg_json_t));
+}
+
+static napi_value dcn_msg_json_summary_to_js(napi_env env, dcn_strings_t* strings, const dcn_msg_json_t* json) {
+  napi_value result;
+  NAPI_PROPS_BEGIN(5);
+  NAPI_PROP_INT32(strings, DCN_KEY_STATE, json->summary_state);
+  NAPI_PROP_STRING(strings, DCN_KEY_TEXT1, json->summary_text1, 1);
+  NAPI_PROP_INT32(strings, DCN_KEY_TEXT1_MEANING, json->summary_text1_meaning);
+  NAPI_PROP_STRING(strings, DCN_KEY_TEXT2, json->summary_text2, 0);
+  NAPI_PROP_INT32(strings, DCN_KEY_TIMESTAMP, json->summary_timestamp);
+  NAPI_PROPS_DEFINE(result);
+
+  return result;
+}
+
+/**
+ * Creates the same object as Message.toJson(), null for a missing message
+ */
+static napi_value dcn_msg_json_to_js(napi_env env, dcn_strings_t* strings, const void* data) {
+  const dcn_msg_json_t* json = (const dcn_msg_json_t*)data;
+  napi_value result;
+  if (!json->exists) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &result));
+    return result;
+  }
+
+  napi_value summary = dcn_msg_json_summary_to_js(env, strings, json);
+  if (summary == NULL) {
+    return NULL;
+  }
+
+  NAPI_PROPS_BEGIN(17);
+  NAPI_PROP_UINT32(strings, DCN_KEY_CHAT_ID, json->chat_id);
+  NAPI_PROP_INT32(strings, DCN_KEY_DURATION, json->duration);
+  NAPI_PROP_STRING(strings, DCN_KEY_FILE, json->file, 0);
+  NAPI_PROP_UINT32(strings, DCN_KEY_FROM_ID, json->from_id);
+  NAPI_PROP_UINT32(strings, DCN_KEY_ID, json->id);
+  NAPI_PROP_INT32(strings, DCN_KEY_RECEIVED_TIMESTAMP, json->received_timestamp);
+  NAPI_PROP_INT32(strings, DCN_KEY_SORT_TIMESTAMP, json->sort_timestamp);
+  NAPI_PROP_STRING(strings, DCN_KEY_TEXT, json->text, 0);
+  NAPI_PROP_INT32(strings, DCN_KEY_TIMESTAMP, json->timestamp);
+  NAPI_PROP_INT32(strings, DCN_KEY_VIEW_TYPE, json->viewtype);
+  NAPI_PROP_INT32(strings, DCN_KEY_STATE, json->state);
+  NAPI_PROP_INT32(strings, DCN_KEY_HAS_DEVIATING_TIMESTAMP, json->has_deviating_timestamp);
+  NAPI_PROP_BOOL(strings, DCN_KEY_SHOW_PADLOCK, json->showpadlock);
+  NAPI_PROP_VALUE(strings, DCN_KEY_SUMMARY, summary);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_SETUPMESSAGE, json->is_setupmessage);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_INFO, json->is_info);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_FORWARDED, json->is_forwarded);
+  NAPI_PROPS_DEFINE(result);
+
+  return result;
+}
+
+/**
+ * Everything Contact.toJson() returns, see dcn_msg_json_t
+ */
+typedef struct dcn_contact_json_t {
+  int exists;
+  uint32_t id;
+  char* addr;
+  uint32_t color;
+  char* display_name;
+  char* first_name;
+  char* name;
+  char* profile_image;
+  char* name_n_addr;
+  int is_blocked;
+  int is_verified;
+} dcn_contact_json_t;
+
+static void dcn_contact_json_load(dc_context_t* dc_context, uint32_t contact_id, void* data) {
+  dcn_contact_json_t* json = (dcn_contact_json_t*)data;
+  memset(json, 0, sizeof(dcn_contact_json_t));
+
+  dc_contact_t* dc_contact = dc_get_contact(dc_context, contact_id);
+  if (dc_contact == NULL) {
+    return;
+  }
+
+  json->exists = 1;
+  json->id = dc_contact_get_id(dc_contact);
+  json->addr = dc_contact_get_addr(dc_contact);
+  json->color = dc_contact_get_color(dc_contact);
+  json->display_name = dc_contact_get_display_name(dc_contact);
+  json->first_name = dc_contact_get_first_name(dc_contact);
+  json->name = dc_contact_get_name(dc_contact);
+  json->profile_image = dc_contact_get_profile_image(dc_contact);
+  json->name_n_addr = dc_contact_get_name_n_addr(dc_contact);
+  json->is_blocked = dc_contact_is_blocked(dc_contact);
+  json->is_verified = dc_contact_is_verified(dc_contact);
+
+  dc_contact_unref(dc_contact);
+}
+
+static void dcn_contact_json_clear(void* data) {
+  dcn_contact_json_t* json = (dcn_contact_json_t*)data;
+  free(json->addr);
+  free(json->display_name);
+  free(json->first_name);
+  free(json->name);
+  free(json->profile_image);
+  free(json->name_n_addr);
+  memset(json, 0, sizeof(dcn_contact_json_t));
+}
+
+/**
+ * Creates the same object as Contact.toJson(), null for a missing contact
+ */
+static napi_value dcn_contact_json_to_js(napi_env env, dcn_strings_t* strings, const void* data) {
+  const dcn_contact_json_t* json = (const dcn_contact_json_t*)data;
+  napi_value result;
+  if (!json->exists) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &result));
+    return result;
+  }
+
+  NAPI_PROPS_BEGIN(10);
+  NAPI_PROP_STRING(strings, DCN_KEY_ADDRESS, json->addr, 1);
+  NAPI_PROP_UINT32(strings, DCN_KEY_COLOR, json->color);
+  NAPI_PROP_STRING(strings, DCN_KEY_DISPLAY_NAME, json->display_name, 1);
+  NAPI_PROP_STRING(strings, DCN_KEY_FIRST_NAME, json->first_name, 1);
+  NAPI_PROP_UINT32(strings, DCN_KEY_ID, json->id);
+  NAPI_PROP_STRING(strings, DCN_KEY_NAME, json->name, 1);
+  NAPI_PROP_STRING(strings, DCN_KEY_PROFILE_IMAGE, json->profile_image, 1);
+  NAPI_PROP_STRING(strings, DCN_KEY_NAME_AND_ADDR, json->name_n_addr, 1);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_BLOCKED, json->is_blocked);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_VERIFIED, json->is_verified);
+  NAPI_PROPS_DEFINE(result);
+
+  return result;
+}
+
+/**
+ * Everything Chat.toJson() returns, see dcn_msg_json_t
+ */
+typedef struct dcn_chat_json_t {
+  int exists;
+  uint32_t id;
+  int archived;
+  uint32_t color;
+  char* name;
+  char* profile_image;
+  char* subtitle;
+  int is_verified;
+  int type;
+  int is_unpromoted;
+  int is_self_talk;
+} dcn_chat_json_t;
+
+static void dcn_chat_json_load(dc_context_t* dc_context, uint32_t chat_id, void* data) {
+  dcn_chat_json_t* json = (dcn_chat_json_t*)data;
+  memset(json, 0, sizeof(dcn_chat_json_t));
+
+  dc_chat_t* dc_chat = dc_get_chat(dc_context, chat_id);
+  if (dc_chat == NULL) {
+    return;
+  }
+
+  json->exists = 1;
+  json->id = dc_chat_get_id(dc_chat);
+  json->archived = dc_chat_get_archived(dc_chat);
+  json->color = dc_chat_get_color(dc_chat);
+  json->name = dc_chat_get_name(dc_chat);
+  json->profile_image = dc_chat_get_profile_image(dc_chat);
+  json->subtitle = dc_chat_get_subtitle(dc_chat);
+  json->is_verified = dc_chat_is_verified(dc_chat);
+  json->type = dc_chat_get_type(dc_chat);
+  json->is_unpromoted = dc_chat_is_unpromoted(dc_chat);
+  json->is_self_talk = dc_chat_is_self_talk(dc_chat);
+
+  dc_chat_unref(dc_chat);
+}
+
+static void dcn_chat_json_clear(void* data) {
+  dcn_chat_json_t* json = (dcn_chat_json_t*)data;
+  free(json->name);
+  free(json->profile_image);
+  free(json->subtitle);
+  memset(json, 0, sizeof(dcn_chat_json_t));
+}
+
+/**
+ * Creates the same object as Chat.toJson(), null for a missing chat
+ */
+static napi_value dcn_chat_json_to_js(napi_env env, dcn_strings_t* strings, const void* data) {
+  const dcn_chat_json_t* json = (const dcn_chat_json_t*)data;
+  napi_value result;
+  if (!json->exists) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &result));
+    return result;
+  }
+
+  NAPI_PROPS_BEGIN(10);
+  NAPI_PROP_INT32(strings, DCN_KEY_ARCHIVED, json->archived);
+  NAPI_PROP_UINT32(strings, DCN_KEY_COLOR, json->color);
+  NAPI_PROP_UINT32(strings, DCN_KEY_ID, json->id);
+  NAPI_PROP_STRING(strings, DCN_KEY_NAME, json->name, 1);
+  NAPI_PROP_STRING(strings, DCN_KEY_PROFILE_IMAGE, json->profile_image, 1);
+  NAPI_PROP_STRING(strings, DCN_KEY_SUBTITLE, json->subtitle, 1);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_VERIFIED, json->is_verified);
+  NAPI_PROP_INT32(strings, DCN_KEY_TYPE, json->type);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_UNPROMOTED, json->is_unpromoted);
+  NAPI_PROP_BOOL(strings, DCN_KEY_IS_SELF_TALK, json->is_self_talk);
+  NAPI_PROPS_DEFINE(result);
+
+  return result;
+}
+
+/**
+ * The objects the bulk getters create, loaded on a worker thread and
+ * turned into JS on the main thread
+ */
+typedef enum {
+  DCN_JSON_MSG,
+  DCN_JSON_CONTACT,
+  DCN_JSON_CHAT
+} dcn_json_kind_t;
+
+static const struct {
+  size_t size;
+  void (*load) (dc_context_t* dc_context, uint32_t id, void* json);
+  void (*clear) (void* json);
+  napi_value (*to_js) (napi_env env, dcn_strings_t* strings, const void* json);
+} dcn_json_types[] = {
+  [DCN_JSON_MSG] = { sizeof(dcn_msg_json_t), dcn_msg_json_load, dcn_msg_json_clear, dcn_msg_json_to_js },
+  [DCN_JSON_CONTACT] = { sizeof(dcn_contact_json_t), dcn_contact_json_load, dcn_contact_json_clear, dcn_contact_json_to_js },
+  [DCN_JSON_CHAT] = { sizeof(dcn_chat_json_t), dcn_chat_json_load, dcn_chat_json_clear, dcn_chat_json_to_js }
+};
+
+static void* dcn_jsons_load(dc_context_t* dc_context, dcn_json_kind_t kind,
+                            const uint32_t* ids, uint32_t length) {
+  char* jsons = calloc(length ? length : 1, dcn_json_types[kind].size);
+  for (uint32_t i = 0; i < length; i++) {
+    dcn_json_types[kind].load(dc_context, ids[i], jsons + i * dcn_json_types[kind].size);
+  }
+  return jsons;
+}
+
+static void dcn_jsons_free(dcn_json_kind_t kind, void* jsons, uint32_t length) {
+  if (jsons == NULL) {
+    return;
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    dcn_json_types[kind].clear((char*)jsons + i * dcn_json_types[kind].size);
+  }
+  free(jsons);
+}
+
+/**
+ * An array of the objects, null for the missing ones. The jsons are left
+ * to dcn_jsons_free().
+ */
+static napi_value dcn_jsons_to_js(napi_env env, dcn_json_kind_t kind, const void* jsons, uint32_t length) {
+  dcn_strings_t strings;
+  if (dcn_strings_init(env, &strings) == NULL) {
+    return NULL;
+  }
+
+  napi_value js_array;
+  NAPI_STATUS_THROWS(napi_create_array_with_length(env, length, &js_array));
+
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value element = dcn_json_types[kind].to_js(env, &strings,
+                                                    (const char*)jsons + i * dcn_json_types[kind].size);
+    if (element == NULL) {
+      return NULL;
+    }
+    NAPI_STATUS_THROWS(napi_set_element(env, js_array, i, element));
+  }
+
+  return js_array;
+}
+
+/**
+ * States of the window a cursor reads ahead
+ */
+#define DCN_PREFETCH_EMPTY 0
+#define DCN_PREFETCH_PENDING 1
+#define DCN_PREFETCH_READY 2
+
+/**
+ * Windowed iterator over the messages of a chat. Only the ids are kept,
+ * messages are read a window at a time, the next one in advance.
+ */
+typedef struct dcn_msg_cursor_t {
+  dcn_context_t* dcn_context;
+  uint32_t* msg_ids;
+  uint32_t cnt;
+
+  // The last window handed out, only used on the main thread
+  uint32_t begin;
+  uint32_t end;
+
+  // The window read ahead, guarded by prefetch_mutex which is also held
+  // while reading it, so asking for the same window waits for it
+  pthread_mutex_t prefetch_mutex;
+  int prefetch_state;
+  uint32_t prefetch_generation;
+  uint32_t prefetch_start;
+  uint32_t prefetch_cnt;
+  dcn_msg_json_t* prefetch_jsons;
+} dcn_msg_cursor_t;
+
+static void dcn_msg_cursor_load(dcn_msg_cursor_t* cursor, uint32_t start, uint32_t cnt,
+                                dcn_msg_json_t* jsons) {
+  for (uint32_t i = 0; i < cnt; i++) {
+    dcn_msg_json_load(cursor->dcn_context->dc_context, cursor->msg_ids[start + i], &jsons[i]);
+  }
+}
+
+/**
+ * Drops the window read ahead, must be called with prefetch_mutex held
+ */
+static void dcn_msg_cursor_drop_prefetch(dcn_msg_cursor_t* cursor) {
+  dcn_jsons_free(DCN_JSON_MSG, cursor->prefetch_jsons, cursor->prefetch_cnt);
+  cursor->prefetch_jsons = NULL;
+  cursor->prefetch_state = DCN_PREFETCH_EMPTY;
+}
+
+static void finalize_msg_cursor(napi_env env, void* data, void* hint) {
+  if (data) {
+    dcn_msg_cursor_t* cursor = (dcn_msg_cursor_t*)data;
+    dcn_msg_cursor_drop_prefetch(cursor);
+    pthread_mutex_destroy(&cursor->prefetch_mutex);
+    free(cursor->msg_ids);
+    free(cursor);
+  }
+}
+
+static napi_value histogram_to_js(napi_env env, const histogram_t* histogram) {
+  napi_value result;
+  napi_value count;
+  napi_value p50;
+  napi_value p99;
+  napi_value max;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)histogram_count(histogram), &count));
+  // microseconds to milliseconds
+  NAPI_STATUS_THROWS(napi_create_double(env, histogram_percentile(histogram, 50.0) / 1000.0, &p50));
+  NAPI_STATUS_THROWS(napi_create_double(env, histogram_percentile(histogram, 99.0) / 1000.0, &p99));
+  NAPI_STATUS_THROWS(napi_create_double(env, histogram_max(histogram) / 1000.0, &max));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "count", count));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "p50", p50));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "p99", p99));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "max", max));
+
+  return result;
+}
+
+/**
+ * Main context.
+ */
+
+NAPI_METHOD(dcn_context_new) {
+  NAPI_ARGV(4);
+  NAPI_ARGV_UINT32(event_queue_capacity, 0);
+  NAPI_ARGV_INT32(event_queue_policy, 1);
+  NAPI_ARGV_UINT32(http_get_timeout_ms, 2);
+  NAPI_ARGV_INT32(event_stats, 3);
+
+  dcn_context_t* dcn_context = calloc(1, sizeof(dcn_context_t));
+  dcn_context->dc_context = dc_context_new(dc_event_handler, dcn_context, NULL);
+  dcn_context->event_queue = eventqueue_new(event_queue_capacity, event_queue_policy);
+  // Measuring costs two clock reads per event, only done when asked for
+  dcn_context->event_stats = event_stats ? eventstats_new() : NULL;
+  // The async handle only keeps the loop alive while an event
+  // handler is set, see dcn_set_event_handler()
+  uv_loop_t* loop = NULL;
+  NAPI_STATUS_THROWS(napi_get_uv_event_loop(env, &loop));
+  dcn_context->event_async = calloc(1, sizeof(uv_async_t));
+  uv_async_init(loop, dcn_context->event_async, dcn_event_async_cb);
+  dcn_context->event_async->data = dcn_context;
+  uv_unref((uv_handle_t*)dcn_context->event_async);
+
+  napi_value async_resource;
+  napi_value async_resource_name;
+  NAPI_STATUS_THROWS(napi_create_object(env, &async_resource));
+  NAPI_STATUS_THROWS(napi_create_string_utf8(env, "dc_event_callback", NAPI_AUTO_LENGTH, &async_resource_name));
+  NAPI_STATUS_THROWS(napi_async_init(env, async_resource, async_resource_name,
+                                     &dcn_context->event_async_context));
+  dcn_context->event_env = env;
+  dcn_context->event_handler_ref = NULL;
+  for (int i = 0; i < DCN_EVENT_MASK_WORDS; i++) {
+    atomic_init(&dcn_context->event_mask[i], ~0u);
+  }
+  dcn_context->journal = NULL;
+  atomic_init(&dcn_context->journal_active, 0);
+  atomic_init(&dcn_context->stop_generation, 0);
+  dcn_context->replay = NULL;
+  pthread_rwlock_init(&dcn_context->journal_lock, NULL);
+  dcn_context->strtable = strtable_new();
+
+  dcn_context->imap_thread = 0;
+  dcn_context->smtp_thread = 0;
+  dcn_context->mvbox_thread = 0;
+  dcn_context->sentbox_thread = 0;
+
+  dcn_context->loop_thread = 0;
+
+  dcn_context->http_wait = httpwait_new(http_get_timeout_ms);
+
+  // Like event_async, only referenced while work is pending
+  uv_loop_t* work_loop = NULL;
+  NAPI_STATUS_THROWS(napi_get_uv_event_loop(env, &work_loop));
+  dcn_context->work_async = calloc(1, sizeof(uv_async_t));
+  uv_async_init(work_loop, dcn_context->work_async, dcn_work_async_cb);
+  dcn_context->work_async->data = dcn_context;
+  uv_unref((uv_handle_t*)dcn_context->work_async);
+  pthread_mutex_init(&dcn_context->work_mutex, NULL);
+  dcn_context->work_done = NULL;
+  dcn_context->work_pending = 0;
+  dcn_context->work_env = env;
+
+  napi_value work_resource;
+  napi_value work_resource_name;
+  NAPI_STATUS_THROWS(napi_create_object(env, &work_resource));
+  NAPI_STATUS_THROWS(napi_create_string_utf8(env, "dcn_work", NAPI_AUTO_LENGTH, &work_resource_name));
+  NAPI_STATUS_THROWS(napi_create_reference(env, work_resource, 1, &dcn_context->work_resource_ref));
+  NAPI_STATUS_THROWS(napi_async_init(env, work_resource, work_resource_name,
+                                     &dcn_context->work_async_context));
+
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_external(env, dcn_context,
+                                          finalize_context,
+                                          NULL, &result));
+  // Weak until work is queued, see dcn_work_queue()
+  NAPI_STATUS_THROWS(napi_create_reference(env, result, 0, &dcn_context->work_context_ref));
+  return result;
+}
+
+/**
+ * Static functions
+ */
+
+NAPI_METHOD(dcn_clear_http_cache) {
+  httpcache_clear(http_cache);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_configure_http_cache) {
+  NAPI_ARGV(4);
+  NAPI_ARGV_UINT32(capacity, 0);
+  NAPI_ARGV_UINT32(ttl_ms, 1);
+  NAPI_ARGV_UINT32(negative_ttl_ms, 2);
+  NAPI_ARGV_UTF8_MALLOC(dir, 3);
+
+  httpcache_configure(http_cache, capacity, ttl_ms, negative_ttl_ms, dir);
+
+  free(dir);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_configure_work_pool) {
+  NAPI_ARGV(2);
+  NAPI_ARGV_UINT32(threads, 0);
+  double aging_ms;
+  NAPI_STATUS_THROWS(napi_get_value_double(env, argv[1], &aging_ms));
+
+  workpool_set_threads(work_pool, threads);
+  workpool_set_aging(work_pool, aging_ms > 0 ? (uint64_t)(aging_ms * 1000) : 0);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_get_http_cache_stats) {
+  httpcache_stats_t stats;
+  httpcache_get_stats(http_cache, &stats);
+
+  napi_value result;
+  napi_value value;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.capacity, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "capacity", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.entries, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "entries", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.hits, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "hits", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.negative_hits, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "negativeHits", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.disk_hits, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "diskHits", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.misses, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "misses", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.evictions, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "evictions", value));
+
+  return result;
+}
+
+static const char* dcn_work_priorities[WORKPOOL_PRIORITIES] = {
+  [WORKPOOL_INTERACTIVE] = "interactive",
+  [WORKPOOL_BACKGROUND] = "background"
+};
+
+NAPI_METHOD(dcn_get_work_pool_stats) {
+  workpool_stats_t stats;
+  histogram_t* wait = histogram_new();
+  histogram_t* class_wait[WORKPOOL_PRIORITIES];
+  for (int i = 0; i < WORKPOOL_PRIORITIES; i++) {
+    class_wait[i] = histogram_new();
+  }
+  workpool_get_stats(work_pool, &stats, wait, class_wait);
+
+  napi_value result;
+  napi_value value;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.threads, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "threads", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.started, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "started", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.depth, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "depth", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.max_depth, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "maxDepth", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.running, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "running", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.completed, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "completed", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.aging_us / 1000, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "aging", value));
+
+  napi_value wait_value = histogram_to_js(env, wait);
+  histogram_unref(wait);
+  napi_value class_values[WORKPOOL_PRIORITIES];
+  for (int i = 0; i < WORKPOOL_PRIORITIES; i++) {
+    class_values[i] = histogram_to_js(env, class_wait[i]);
+    histogram_unref(class_wait[i]);
+  }
+  if (wait_value == NULL) {
+    return NULL;
+  }
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "wait", wait_value));
+
+  for (int i = 0; i < WORKPOOL_PRIORITIES; i++) {
+    napi_value class_stats;
+    if (class_values[i] == NULL) {
+      return NULL;
+    }
+    NAPI_STATUS_THROWS(napi_create_object(env, &class_stats));
+    NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.classes[i].depth, &value));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, class_stats, "depth", value));
+    NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.classes[i].max_depth, &value));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, class_stats, "maxDepth", value));
+    NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.classes[i].completed, &value));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, class_stats, "completed", value));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, class_stats, "wait", class_values[i]));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, result, dcn_work_priorities[i], class_stats));
+  }
+
+  return result;
+}
+
+NAPI_METHOD(dcn_maybe_valid_addr) {
+  NAPI_ARGV(1);
+  NAPI_ARGV_UTF8_MALLOC(addr, 0);
+
+  int result = dc_may_be_valid_addr(addr);
+
+  free(addr);
+
+  NAPI_RETURN_INT32(result);
+}
+
+/**
+ * dcn_context_t
+ */
+
+/**
+ * Context calls that can run on work_pool. Each has a `_async`
+ * binding taking the same arguments plus a callback, which is called
+ * with the result converted like the synchronous binding does.
+ */
+typedef enum {
+  DCN_CALL_ADD_ADDRESS_BOOK,
+  DCN_CALL_ADD_CONTACT_TO_CHAT,
+  DCN_CALL_ARCHIVE_CHAT,
+  DCN_CALL_BLOCK_CONTACT,
+  DCN_CALL_CHECK_PASSWORD,
+  DCN_CALL_CHECK_QR,
+  DCN_CALL_CREATE_CHAT_BY_CONTACT_ID,
+  DCN_CALL_CREATE_CHAT_BY_MSG_ID,
+  DCN_CALL_CREATE_CONTACT,
+  DCN_CALL_CREATE_GROUP_CHAT,
+  DCN_CALL_DELETE_CHAT,
+  DCN_CALL_DELETE_CONTACT,
+  DCN_CALL_GET_BLOCKED_CNT,
+  DCN_CALL_GET_BLOCKED_CONTACTS,
+  DCN_CALL_GET_CHAT,
+  DCN_CALL_GET_CHAT_CONTACTS,
+  DCN_CALL_GET_CHAT_ID_BY_CONTACT_ID,
+  DCN_CALL_GET_CHAT_MEDIA,
+  DCN_CALL_GET_CHAT_MSGS,
+  DCN_CALL_GET_CHATLIST,
+  DCN_CALL_GET_CONFIG,
+  DCN_CALL_GET_CONTACT,
+  DCN_CALL_GET_CONTACT_ENCRINFO,
+  DCN_CALL_GET_CONTACTS,
+  DCN_CALL_GET_DRAFT,
+  DCN_CALL_GET_FRESH_MSG_CNT,
+  DCN_CALL_GET_FRESH_MSGS,
+  DCN_CALL_GET_INFO,
+  DCN_CALL_GET_MIME_HEADERS,
+  DCN_CALL_GET_MSG,
+  DCN_CALL_GET_MSG_CNT,
+  DCN_CALL_GET_MSG_INFO,
+  DCN_CALL_GET_NEXT_MEDIA,
+  DCN_CALL_GET_SECUREJOIN_QR,
+  DCN_CALL_IMEX_HAS_BACKUP,
+  DCN_CALL_IS_CONFIGURED,
+  DCN_CALL_IS_CONTACT_IN_CHAT,
+  DCN_CALL_JOIN_SECUREJOIN,
+  DCN_CALL_LOOKUP_CONTACT_ID_BY_ADDR,
+  DCN_CALL_MARKNOTICED_ALL_CHATS,
+  DCN_CALL_MARKNOTICED_CHAT,
+  DCN_CALL_MARKNOTICED_CONTACT,
+  DCN_CALL_REMOVE_CONTACT_FROM_CHAT,
+  DCN_CALL_SEARCH_MSGS,
+  DCN_CALL_SET_CHAT_NAME,
+  DCN_CALL_SET_CHAT_PROFILE_IMAGE,
+  DCN_CALL_SET_CONFIG,
+  DCN_CALL_COUNT
+} dcn_call_t;
+
+enum {
+  DCN_RESULT_NONE,
+  DCN_RESULT_INT32,
+  DCN_RESULT_UINT32,
+  DCN_RESULT_STRING,
+  DCN_RESULT_ARRAY,
+  DCN_RESULT_CHAT,
+  DCN_RESULT_CHATLIST,
+  DCN_RESULT_CONTACT,
+  DCN_RESULT_LOT,
+  DCN_RESULT_MSG
+};
+
+/**
+ * Arguments after the context, `u` for uint32, `i` for int32 and `s` for
+ * a string, the kind of result and the default priority of every call.
+ * Calls a UI doesn't wait for are background work.
+ */
+#define DCN_CALL_MAX_ARGS 5
+
+static const struct {
+  const char* args;
+  int result;
+  int priority;
+} dcn_calls[DCN_CALL_COUNT] = {
+  [DCN_CALL_ADD_ADDRESS_BOOK] = { "s", DCN_RESULT_INT32, WORKPOOL_BACKGROUND },
+  [DCN_CALL_ADD_CONTACT_TO_CHAT] = { "uu", DCN_RESULT_INT32 },
+  [DCN_CALL_ARCHIVE_CHAT] = { "ui", DCN_RESULT_NONE },
+  [DCN_CALL_BLOCK_CONTACT] = { "ui", DCN_RESULT_NONE },
+  [DCN_CALL_CHECK_PASSWORD] = { "s", DCN_RESULT_INT32 },
+  [DCN_CALL_CHECK_QR] = { "s", DCN_RESULT_LOT },
+  [DCN_CALL_CREATE_CHAT_BY_CONTACT_ID] = { "i", DCN_RESULT_UINT32 },
+  [DCN_CALL_CREATE_CHAT_BY_MSG_ID] = { "i", DCN_RESULT_UINT32 },
+  [DCN_CALL_CREATE_CONTACT] = { "ss", DCN_RESULT_UINT32 },
+  [DCN_CALL_CREATE_GROUP_CHAT] = { "is", DCN_RESULT_UINT32 },
+  [DCN_CALL_DELETE_CHAT] = { "u", DCN_RESULT_NONE },
+  [DCN_CALL_DELETE_CONTACT] = { "u", DCN_RESULT_INT32 },
+  [DCN_CALL_GET_BLOCKED_CNT] = { "", DCN_RESULT_INT32 },
+  [DCN_CALL_GET_BLOCKED_CONTACTS] = { "", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_CHAT] = { "u", DCN_RESULT_CHAT },
+  [DCN_CALL_GET_CHAT_CONTACTS] = { "u", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_CHAT_ID_BY_CONTACT_ID] = { "u", DCN_RESULT_UINT32 },
+  [DCN_CALL_GET_CHAT_MEDIA] = { "uiii", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_CHAT_MSGS] = { "uuu", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_CHATLIST] = { "isu", DCN_RESULT_CHATLIST },
+  [DCN_CALL_GET_CONFIG] = { "s", DCN_RESULT_STRING },
+  [DCN_CALL_GET_CONTACT] = { "u", DCN_RESULT_CONTACT },
+  [DCN_CALL_GET_CONTACT_ENCRINFO] = { "u", DCN_RESULT_STRING },
+  [DCN_CALL_GET_CONTACTS] = { "us", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_DRAFT] = { "u", DCN_RESULT_MSG },
+  [DCN_CALL_GET_FRESH_MSG_CNT] = { "u", DCN_RESULT_INT32 },
+  [DCN_CALL_GET_FRESH_MSGS] = { "", DCN_RESULT_ARRAY },
+  [DCN_CALL_GET_INFO] = { "", DCN_RESULT_STRING },
+  [DCN_CALL_GET_MIME_HEADERS] = { "u", DCN_RESULT_STRING },
+  [DCN_CALL_GET_MSG] = { "u", DCN_RESULT_MSG },
+  [DCN_CALL_GET_MSG_CNT] = { "u", DCN_RESULT_INT32 },
+  [DCN_CALL_GET_MSG_INFO] = { "u", DCN_RESULT_STRING },
+  [DCN_CALL_GET_NEXT_MEDIA] = { "uiiii", DCN_RESULT_UINT32 },
+  [DCN_CALL_GET_SECUREJOIN_QR] = { "u", DCN_RESULT_STRING },
+  [DCN_CALL_IMEX_HAS_BACKUP] = { "s", DCN_RESULT_STRING, WORKPOOL_BACKGROUND },
+  [DCN_CALL_IS_CONFIGURED] = { "", DCN_RESULT_INT32 },
+  [DCN_CALL_IS_CONTACT_IN_CHAT] = { "uu", DCN_RESULT_INT32 },
+  [DCN_CALL_JOIN_SECUREJOIN] = { "s", DCN_RESULT_UINT32 },
+  [DCN_CALL_LOOKUP_CONTACT_ID_BY_ADDR] = { "s", DCN_RESULT_UINT32 },
+  [DCN_CALL_MARKNOTICED_ALL_CHATS] = { "", DCN_RESULT_NONE, WORKPOOL_BACKGROUND },
+  [DCN_CALL_MARKNOTICED_CHAT] = { "u", DCN_RESULT_NONE },
+  [DCN_CALL_MARKNOTICED_CONTACT] = { "u", DCN_RESULT_NONE },
+  [DCN_CALL_REMOVE_CONTACT_FROM_CHAT] = { "uu", DCN_RESULT_INT32 },
+  [DCN_CALL_SEARCH_MSGS] = { "us", DCN_RESULT_ARRAY },
+  [DCN_CALL_SET_CHAT_NAME] = { "us", DCN_RESULT_INT32 },
+  [DCN_CALL_SET_CHAT_PROFILE_IMAGE] = { "us", DCN_RESULT_INT32 },
+  [DCN_CALL_SET_CONFIG] = { "ss", DCN_RESULT_INT32 }
+};
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_call)
+  dcn_call_t call;
+  uint32_t numbers[DCN_CALL_MAX_ARGS];
+  char* strings[DCN_CALL_MAX_ARGS];
+  uint32_t number;
+  char* str;
+  dc_array_t* array;
+  void* object;
+NAPI_ASYNC_CARRIER_END(dcn_call)
+
+NAPI_ASYNC_EXECUTE(dcn_call) {
+  NAPI_ASYNC_GET_CARRIER(dcn_call)
+  dc_context_t* dc_context = carrier->dcn_context->dc_context;
+  switch (carrier->call) {
+    case DCN_CALL_ADD_ADDRESS_BOOK:
+      carrier->number = dc_add_address_book(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_ADD_CONTACT_TO_CHAT:
+      carrier->number = dc_add_contact_to_chat(dc_context, carrier->numbers[0], carrier->numbers[1]);
+      break;
+    case DCN_CALL_ARCHIVE_CHAT:
+      dc_archive_chat(dc_context, carrier->numbers[0], (int32_t)carrier->numbers[1]);
+      break;
+    case DCN_CALL_BLOCK_CONTACT:
+      dc_block_contact(dc_context, carrier->numbers[0], (int32_t)carrier->numbers[1]);
+      break;
+    case DCN_CALL_CHECK_PASSWORD:
+      carrier->number = dc_check_password(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_CHECK_QR:
+      carrier->object = dc_check_qr(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_CREATE_CHAT_BY_CONTACT_ID:
+      carrier->number = dc_create_chat_by_contact_id(dc_context, (int32_t)carrier->numbers[0]);
+      break;
+    case DCN_CALL_CREATE_CHAT_BY_MSG_ID:
+      carrier->number = dc_create_chat_by_msg_id(dc_context, (int32_t)carrier->numbers[0]);
+      break;
+    case DCN_CALL_CREATE_CONTACT:
+      carrier->number = dc_create_contact(dc_context, carrier->strings[0], carrier->strings[1]);
+      break;
+    case DCN_CALL_CREATE_GROUP_CHAT:
+      carrier->number = dc_create_group_chat(dc_context, (int32_t)carrier->numbers[0], carrier->strings[1]);
+      break;
+    case DCN_CALL_DELETE_CHAT:
+      dc_delete_chat(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_DELETE_CONTACT:
+      carrier->number = dc_delete_contact(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_BLOCKED_CNT:
+      carrier->number = dc_get_blocked_cnt(dc_context);
+      break;
+    case DCN_CALL_GET_BLOCKED_CONTACTS:
+      carrier->array = dc_get_blocked_contacts(dc_context);
+      break;
+    case DCN_CALL_GET_CHAT:
+      carrier->object = dc_get_chat(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_CHAT_CONTACTS:
+      carrier->array = dc_get_chat_contacts(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_CHAT_ID_BY_CONTACT_ID:
+      carrier->number = dc_get_chat_id_by_contact_id(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_CHAT_MEDIA:
+      carrier->array = dc_get_chat_media(dc_context, carrier->numbers[0], (int32_t)carrier->numbers[1], (int32_t)carrier->numbers[2], (int32_t)carrier->numbers[3]);
+      break;
+    case DCN_CALL_GET_CHAT_MSGS:
+      carrier->array = dc_get_chat_msgs(dc_context, carrier->numbers[0], carrier->numbers[1], carrier->numbers[2]);
+      break;
+    case DCN_CALL_GET_CHATLIST:
+      carrier->object = dc_get_chatlist(dc_context, (int32_t)carrier->numbers[0], (carrier->strings[1] && carrier->strings[1][0] ? carrier->strings[1] : NULL), carrier->numbers[2]);
+      break;
+    case DCN_CALL_GET_CONFIG:
+      carrier->str = dc_get_config(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_GET_CONTACT:
+      carrier->object = dc_get_contact(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_CONTACT_ENCRINFO:
+      carrier->str = dc_get_contact_encrinfo(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_CONTACTS:
+      carrier->array = dc_get_contacts(dc_context, carrier->numbers[0], (carrier->strings[1] && carrier->strings[1][0] ? carrier->strings[1] : NULL));
+      break;
+    case DCN_CALL_GET_DRAFT:
+      carrier->object = dc_get_draft(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_FRESH_MSG_CNT:
+      carrier->number = dc_get_fresh_msg_cnt(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_FRESH_MSGS:
+      carrier->array = dc_get_fresh_msgs(dc_context);
+      break;
+    case DCN_CALL_GET_INFO:
+      carrier->str = dc_get_info(dc_context);
+      break;
+    case DCN_CALL_GET_MIME_HEADERS:
+      carrier->str = dc_get_mime_headers(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_MSG:
+      carrier->object = dc_get_msg(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_MSG_CNT:
+      carrier->number = dc_get_msg_cnt(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_MSG_INFO:
+      carrier->str = dc_get_msg_info(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_GET_NEXT_MEDIA:
+      carrier->number = dc_get_next_media(dc_context, carrier->numbers[0], (int32_t)carrier->numbers[1], (int32_t)carrier->numbers[2], (int32_t)carrier->numbers[3], (int32_t)carrier->numbers[4]);
+      break;
+    case DCN_CALL_GET_SECUREJOIN_QR:
+      carrier->str = dc_get_securejoin_qr(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_IMEX_HAS_BACKUP:
+      carrier->str = dc_imex_has_backup(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_IS_CONFIGURED:
+      carrier->number = dc_is_configured(dc_context);
+      break;
+    case DCN_CALL_IS_CONTACT_IN_CHAT:
+      carrier->number = dc_is_contact_in_chat(dc_context, carrier->numbers[0], carrier->numbers[1]);
+      break;
+    case DCN_CALL_JOIN_SECUREJOIN:
+      carrier->number = dc_join_securejoin(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_LOOKUP_CONTACT_ID_BY_ADDR:
+      carrier->number = dc_lookup_contact_id_by_addr(dc_context, carrier->strings[0]);
+      break;
+    case DCN_CALL_MARKNOTICED_ALL_CHATS:
+      dc_marknoticed_all_chats(dc_context);
+      break;
+    case DCN_CALL_MARKNOTICED_CHAT:
+      dc_marknoticed_chat(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_MARKNOTICED_CONTACT:
+      dc_marknoticed_contact(dc_context, carrier->numbers[0]);
+      break;
+    case DCN_CALL_REMOVE_CONTACT_FROM_CHAT:
+      carrier->number = dc_remove_contact_from_chat(dc_context, carrier->numbers[0], carrier->numbers[1]);
+      break;
+    case DCN_CALL_SEARCH_MSGS:
+      carrier->array = dc_search_msgs(dc_context, carrier->numbers[0], carrier->strings[1]);
+      break;
+    case DCN_CALL_SET_CHAT_NAME:
+      carrier->number = dc_set_chat_name(dc_context, carrier->numbers[0], carrier->strings[1]);
+      break;
+    case DCN_CALL_SET_CHAT_PROFILE_IMAGE:
+      carrier->number = dc_set_chat_profile_image(dc_context, carrier->numbers[0], (carrier->strings[1] && carrier->strings[1][0] ? carrier->strings[1] : NULL));
+      break;
+    case DCN_CALL_SET_CONFIG:
+      carrier->number = dc_set_config(dc_context, carrier->strings[0], (carrier->strings[1] && carrier->strings[1][0] ? carrier->strings[1] : NULL));
+      break;
+    case DCN_CALL_COUNT:
+      break;
+  }
+}
+
+/**
+ * Frees the object of a call returning one, the external takes this
+ * over once created
+ */
+static napi_finalize dcn_call_finalizer(dcn_call_carrier_t* carrier) {
+  switch (dcn_calls[carrier->call].result) {
+    case DCN_RESULT_CHAT:
+      return finalize_chat;
+    case DCN_RESULT_CHATLIST:
+      return finalize_chatlist;
+    case DCN_RESULT_CONTACT:
+      return finalize_contact;
+    case DCN_RESULT_LOT:
+      return finalize_lot;
+    case DCN_RESULT_MSG:
+      return finalize_msg;
+    default:
+      return NULL;
+  }
+}
+
+static napi_value dcn_call_result_to_js(napi_env env, dcn_call_carrier_t* carrier) {
+  napi_value result;
+  switch (dcn_calls[carrier->call].result) {
+    case DCN_RESULT_NONE:
+      NAPI_STATUS_THROWS(napi_get_undefined(env, &result));
+      return result;
+    case DCN_RESULT_INT32:
+      NAPI_STATUS_THROWS(napi_create_int32(env, (int32_t)carrier->number, &result));
+      return result;
+    case DCN_RESULT_UINT32:
+      NAPI_STATUS_THROWS(napi_create_uint32(env, carrier->number, &result));
+      return result;
+    case DCN_RESULT_STRING:
+      if (carrier->str == NULL) {
+        NAPI_STATUS_THROWS(napi_get_null(env, &result));
+      } else {
+        NAPI_STATUS_THROWS(napi_create_string_utf8(env, carrier->str, NAPI_AUTO_LENGTH, &result));
+      }
+      return result;
+    case DCN_RESULT_ARRAY:
+      return dc_array_to_uint32_array(env, carrier->array);
+    default:
+      break;
+  }
+
+  if (carrier->object == NULL) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &result));
+  } else {
+    NAPI_STATUS_THROWS(napi_create_external(env, carrier->object,
+                                            dcn_call_finalizer(carrier),
+                                            NULL, &result));
+    // Owned by the external from now on
+    carrier->object = NULL;
+  }
+  return result;
+}
+
+static void dcn_call_free(napi_env env, dcn_call_carrier_t* carrier) {
+  for (int i = 0; i < DCN_CALL_MAX_ARGS; i++) {
+    free(carrier->strings[i]);
+  }
+  free(carrier->str);
+  if (carrier->array) {
+    dc_array_unref(carrier->array);
+  }
+  // Left over if the conversion failed
+  if (carrier->object) {
+    dcn_call_finalizer(carrier)(env, carrier->object, NULL);
+  }
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_call) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 1;
+  napi_value argv[1];
+  argv[0] = dcn_call_result_to_js(env, carrier);
+  if (argv[0] == NULL) {
+    return;
+  }
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
+}
+
+/**
+ * Reads the arguments of a call from argv[1..] and queues it, the
+ * callback and optionally the priority follow the arguments
+ */
+static napi_value dcn_call_queue(napi_env env, napi_value* argv, dcn_call_t call) {
+  NAPI_DCN_CONTEXT();
+
+  // Read into locals first, nothing is allocated for arguments that throw
+  uint32_t numbers[DCN_CALL_MAX_ARGS] = { 0 };
+  char* strings[DCN_CALL_MAX_ARGS] = { NULL };
+  const char* args = dcn_calls[call].args;
+  size_t i = 0;
+  for (; args[i]; i++) {
+    napi_value arg = argv[1 + i];
+    napi_status status;
+    if (args[i] == 'u') {
+      status = napi_get_value_uint32(env, arg, &numbers[i]);
+    } else if (args[i] == 'i') {
+      status = napi_get_value_int32(env, arg, (int32_t*)&numbers[i]);
+    } else {
+      size_t size;
+      status = napi_get_value_string_utf8(env, arg, NULL, 0, &size);
+      if (status == napi_ok) {
+        strings[i] = malloc(size + 1);
+        status = napi_get_value_string_utf8(env, arg, strings[i], size + 1, &size);
+      }
+    }
+    if (status != napi_ok) {
+      for (size_t j = 0; j <= i; j++) {
+        free(strings[j]);
+      }
+      napi_throw_type_error(env, NULL, args[i] == 's' ? "Expected string" : "Expected number");
+      return NULL;
+    }
+  }
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_call)
+  carrier->call = call;
+  carrier->work.priority = dcn_calls[call].priority;
+  memcpy(carrier->numbers, numbers, sizeof(numbers));
+  memcpy(carrier->strings, strings, sizeof(strings));
 
-  NAPI_RETURN_INT32(result);
+  NAPI_ASYNC_QUEUE_WORK(dcn_call, argv[1 + i], argv[2 + i]);
+  NAPI_ASYNC_RETURN();
 }
 
-/**
- * dcn_context_t
- */
-
 NAPI_METHOD(dcn_add_address_book) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -398,6 +2303,11 @@ NAPI_METHOD(dcn_add_address_book) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_add_address_book_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_ADD_ADDRESS_BOOK);
+}
+
 NAPI_METHOD(dcn_add_contact_to_chat) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -410,6 +2320,11 @@ NAPI_METHOD(dcn_add_contact_to_chat) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_add_contact_to_chat_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_ADD_CONTACT_TO_CHAT);
+}
+
 NAPI_METHOD(dcn_archive_chat) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -421,6 +2336,11 @@ NAPI_METHOD(dcn_archive_chat) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_archive_chat_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_ARCHIVE_CHAT);
+}
+
 NAPI_METHOD(dcn_block_contact) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -432,6 +2352,309 @@ NAPI_METHOD(dcn_block_contact) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_block_contact_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_BLOCK_CONTACT);
+}
+
+/**
+ * Loads the message ids of a chat for a new cursor, on work_pool as a
+ * long chat has many of them
+ */
+NAPI_ASYNC_CARRIER_BEGIN(dcn_chat_msgs_cursor)
+  uint32_t chat_id;
+  uint32_t flags;
+  uint32_t marker1before;
+  dcn_msg_cursor_t* cursor;
+NAPI_ASYNC_CARRIER_END(dcn_chat_msgs_cursor)
+
+NAPI_ASYNC_EXECUTE(dcn_chat_msgs_cursor) {
+  NAPI_ASYNC_GET_CARRIER(dcn_chat_msgs_cursor)
+  dc_array_t* msg_ids = dc_get_chat_msgs(carrier->dcn_context->dc_context,
+                                         carrier->chat_id,
+                                         carrier->flags,
+                                         carrier->marker1before);
+
+  dcn_msg_cursor_t* cursor = calloc(1, sizeof(dcn_msg_cursor_t));
+  cursor->dcn_context = carrier->dcn_context;
+  cursor->cnt = dc_array_get_cnt(msg_ids);
+  cursor->msg_ids = calloc(cursor->cnt ? cursor->cnt : 1, sizeof(uint32_t));
+  for (uint32_t i = 0; i < cursor->cnt; i++) {
+    cursor->msg_ids[i] = dc_array_get_id(msg_ids, i);
+  }
+  dc_array_unref(msg_ids);
+  pthread_mutex_init(&cursor->prefetch_mutex, NULL);
+  carrier->cursor = cursor;
+}
+
+static void dcn_chat_msgs_cursor_free(napi_env env, dcn_chat_msgs_cursor_carrier_t* carrier) {
+  // Left over if the external could not be created
+  finalize_msg_cursor(env, carrier->cursor, NULL);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_chat_msgs_cursor) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 1;
+  napi_value argv[argc];
+  NAPI_STATUS_THROWS(napi_create_external(env, carrier->cursor,
+                                          finalize_msg_cursor,
+                                          NULL, &argv[0]));
+  carrier->cursor = NULL;
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
+}
+
+NAPI_METHOD(dcn_chat_msgs_cursor_async) {
+  NAPI_ARGV(6);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UINT32(chat_id, 1);
+  NAPI_ARGV_UINT32(flags, 2);
+  NAPI_ARGV_UINT32(marker1before, 3);
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_chat_msgs_cursor)
+  carrier->chat_id = chat_id;
+  carrier->flags = flags;
+  carrier->marker1before = marker1before;
+
+  NAPI_ASYNC_QUEUE_WORK(dcn_chat_msgs_cursor, argv[4], argv[5]);
+  NAPI_ASYNC_RETURN();
+}
+
+/**
+ * Numbers of the chatlist snapshot, one column of `rows` values each
+ */
+enum {
+  DCN_SNAPSHOT_CHAT_ID,
+  DCN_SNAPSHOT_MSG_ID,
+  DCN_SNAPSHOT_TYPE,
+  DCN_SNAPSHOT_COLOR,
+  DCN_SNAPSHOT_ARCHIVED,
+  DCN_SNAPSHOT_FLAGS,
+  DCN_SNAPSHOT_SUMMARY_STATE,
+  DCN_SNAPSHOT_SUMMARY_TEXT1_MEANING,
+  DCN_SNAPSHOT_SUMMARY_TIMESTAMP,
+  DCN_SNAPSHOT_NUMBERS
+};
+
+/**
+ * Strings of the chatlist snapshot, one array of `rows` values each
+ */
+enum {
+  DCN_SNAPSHOT_NAME,
+  DCN_SNAPSHOT_SUBTITLE,
+  DCN_SNAPSHOT_PROFILE_IMAGE,
+  DCN_SNAPSHOT_SUMMARY_TEXT1,
+  DCN_SNAPSHOT_SUMMARY_TEXT2,
+  DCN_SNAPSHOT_STRINGS
+};
+
+#define DCN_SNAPSHOT_IS_VERIFIED   0x01
+#define DCN_SNAPSHOT_IS_UNPROMOTED 0x02
+#define DCN_SNAPSHOT_IS_SELF_TALK  0x04
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_chatlist_snapshot)
+  int listflags;
+  char* query;
+  uint32_t query_contact_id;
+  uint32_t offset;
+  uint32_t limit;
+  uint32_t count;
+  uint32_t rows;
+  int32_t* numbers;
+  char** strings;
+NAPI_ASYNC_CARRIER_END(dcn_chatlist_snapshot)
+
+NAPI_ASYNC_EXECUTE(dcn_chatlist_snapshot) {
+  NAPI_ASYNC_GET_CARRIER(dcn_chatlist_snapshot)
+  dc_context_t* dc_context = carrier->dcn_context->dc_context;
+  dc_chatlist_t* chatlist = dc_get_chatlist(dc_context,
+                                            carrier->listflags,
+                                            carrier->query && carrier->query[0] ? carrier->query : NULL,
+                                            carrier->query_contact_id);
+
+  carrier->count = dc_chatlist_get_cnt(chatlist);
+  uint32_t rows = 0;
+  if (carrier->offset < carrier->count) {
+    rows = carrier->count - carrier->offset;
+    if (carrier->limit && rows > carrier->limit) {
+      rows = carrier->limit;
+    }
+  }
+  carrier->rows = rows;
+  carrier->numbers = calloc(rows * DCN_SNAPSHOT_NUMBERS + 1, sizeof(int32_t));
+  carrier->strings = calloc(rows * DCN_SNAPSHOT_STRINGS + 1, sizeof(char*));
+
+  for (uint32_t row = 0; row < rows; row++) {
+    const size_t index = carrier->offset + row;
+    int32_t* numbers = carrier->numbers;
+    char** strings = carrier->strings;
+
+    uint32_t chat_id = dc_chatlist_get_chat_id(chatlist, index);
+    dc_chat_t* chat = dc_get_chat(dc_context, chat_id);
+    dc_lot_t* summary = dc_chatlist_get_summary(chatlist, index, chat);
+
+    numbers[DCN_SNAPSHOT_CHAT_ID * rows + row] = chat_id;
+    numbers[DCN_SNAPSHOT_MSG_ID * rows + row] = dc_chatlist_get_msg_id(chatlist, index);
+    numbers[DCN_SNAPSHOT_TYPE * rows + row] = dc_chat_get_type(chat);
+    numbers[DCN_SNAPSHOT_COLOR * rows + row] = dc_chat_get_color(chat);
+    numbers[DCN_SNAPSHOT_ARCHIVED * rows + row] = dc_chat_get_archived(chat);
+    numbers[DCN_SNAPSHOT_FLAGS * rows + row] =
+      (dc_chat_is_verified(chat) ? DCN_SNAPSHOT_IS_VERIFIED : 0) |
+      (dc_chat_is_unpromoted(chat) ? DCN_SNAPSHOT_IS_UNPROMOTED : 0) |
+      (dc_chat_is_self_talk(chat) ? DCN_SNAPSHOT_IS_SELF_TALK : 0);
+    numbers[DCN_SNAPSHOT_SUMMARY_STATE * rows + row] = dc_lot_get_state(summary);
+    numbers[DCN_SNAPSHOT_SUMMARY_TEXT1_MEANING * rows + row] = dc_lot_get_text1_meaning(summary);
+    numbers[DCN_SNAPSHOT_SUMMARY_TIMESTAMP * rows + row] = dc_lot_get_timestamp(summary);
+
+    strings[DCN_SNAPSHOT_NAME * rows + row] = dc_chat_get_name(chat);
+    strings[DCN_SNAPSHOT_SUBTITLE * rows + row] = dc_chat_get_subtitle(chat);
+    strings[DCN_SNAPSHOT_PROFILE_IMAGE * rows + row] = dc_chat_get_profile_image(chat);
+    strings[DCN_SNAPSHOT_SUMMARY_TEXT1 * rows + row] = dc_lot_get_text1(summary);
+    strings[DCN_SNAPSHOT_SUMMARY_TEXT2 * rows + row] = dc_lot_get_text2(summary);
+
+    dc_lot_unref(summary);
+    dc_chat_unref(chat);
+  }
+
+  dc_chatlist_unref(chatlist);
+}
+
+static void finalize_snapshot_numbers(napi_env env, void* data, void* hint) {
+  free(data);
+}
+
+static napi_value snapshot_column(napi_env env, napi_value arraybuffer,
+                                  napi_typedarray_type type,
+                                  uint32_t rows, int column) {
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, type, rows, arraybuffer,
+                                            column * rows * sizeof(int32_t),
+                                            &result));
+  return result;
+}
+
+static napi_value snapshot_strings(napi_env env, dcn_strings_t* js_strings,
+                                   char** strings, uint32_t rows,
+                                   int column, int intern) {
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_array_with_length(env, rows, &result));
+  for (uint32_t row = 0; row < rows; row++) {
+    napi_value value = dcn_string(js_strings, strings[column * rows + row], intern);
+    if (value == NULL) {
+      return NULL;
+    }
+    NAPI_STATUS_THROWS(napi_set_element(env, result, row, value));
+  }
+  return result;
+}
+
+static void dcn_chatlist_snapshot_free(napi_env env, dcn_chatlist_snapshot_carrier_t* carrier) {
+  for (uint32_t i = 0; i < carrier->rows * DCN_SNAPSHOT_STRINGS; i++) {
+    free(carrier->strings[i]);
+  }
+  free(carrier->strings);
+  free(carrier->numbers);
+  free(carrier->query);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_chatlist_snapshot) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const uint32_t rows = carrier->rows;
+
+  // The numbers are handed over without a copy, the typed arrays are
+  // views on one buffer that frees them once garbage collected
+  napi_value arraybuffer;
+  NAPI_STATUS_THROWS(napi_create_external_arraybuffer(env, carrier->numbers,
+                                                      (rows * DCN_SNAPSHOT_NUMBERS + 1) * sizeof(int32_t),
+                                                      finalize_snapshot_numbers,
+                                                      NULL, &arraybuffer));
+  carrier->numbers = NULL;
+
+  napi_value snapshot;
+  NAPI_STATUS_THROWS(napi_create_object(env, &snapshot));
+  NAPI_SET_UINT32(snapshot, "count", carrier->count);
+  NAPI_SET_UINT32(snapshot, "offset", carrier->offset);
+  NAPI_SET_UINT32(snapshot, "rows", rows);
+
+  static const struct {
+    const char* name;
+    napi_typedarray_type type;
+    int column;
+  } numbers[] = {
+    { "chatId", napi_uint32_array, DCN_SNAPSHOT_CHAT_ID },
+    { "msgId", napi_uint32_array, DCN_SNAPSHOT_MSG_ID },
+    { "type", napi_int32_array, DCN_SNAPSHOT_TYPE },
+    { "color", napi_uint32_array, DCN_SNAPSHOT_COLOR },
+    { "archived", napi_int32_array, DCN_SNAPSHOT_ARCHIVED },
+    { "flags", napi_uint32_array, DCN_SNAPSHOT_FLAGS },
+    { "summaryState", napi_int32_array, DCN_SNAPSHOT_SUMMARY_STATE },
+    { "summaryText1Meaning", napi_int32_array, DCN_SNAPSHOT_SUMMARY_TEXT1_MEANING },
+    { "summaryTimestamp", napi_int32_array, DCN_SNAPSHOT_SUMMARY_TIMESTAMP }
+  };
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+    napi_value column = snapshot_column(env, arraybuffer, numbers[i].type,
+                                        rows, numbers[i].column);
+    if (column == NULL) {
+      return;
+    }
+    NAPI_STATUS_THROWS(napi_set_named_property(env, snapshot, numbers[i].name, column));
+  }
+
+  dcn_strings_t js_strings;
+  if (dcn_strings_init(env, &js_strings) == NULL) {
+    return;
+  }
+
+  static const struct {
+    const char* name;
+    int column;
+    int intern;
+  } strings[] = {
+    { "name", DCN_SNAPSHOT_NAME, 1 },
+    { "subtitle", DCN_SNAPSHOT_SUBTITLE, 1 },
+    { "profileImage", DCN_SNAPSHOT_PROFILE_IMAGE, 1 },
+    { "summaryText1", DCN_SNAPSHOT_SUMMARY_TEXT1, 1 },
+    { "summaryText2", DCN_SNAPSHOT_SUMMARY_TEXT2, 0 }
+  };
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+    napi_value column = snapshot_strings(env, &js_strings, carrier->strings, rows,
+                                         strings[i].column, strings[i].intern);
+    if (column == NULL) {
+      return;
+    }
+    NAPI_STATUS_THROWS(napi_set_named_property(env, snapshot, strings[i].name, column));
+  }
+
+  const int argc = 1;
+  napi_value argv[argc];
+  argv[0] = snapshot;
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
+}
+
+NAPI_METHOD(dcn_chatlist_snapshot) {
+  NAPI_ARGV(8);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_INT32(listflags, 1);
+  NAPI_ARGV_UTF8_MALLOC(query, 2);
+  NAPI_ARGV_UINT32(query_contact_id, 3);
+  NAPI_ARGV_UINT32(offset, 4);
+  NAPI_ARGV_UINT32(limit, 5);
+  NAPI_ASYNC_NEW_CARRIER(dcn_chatlist_snapshot)
+  carrier->listflags = listflags;
+  carrier->query = query;
+  carrier->query_contact_id = query_contact_id;
+  carrier->offset = offset;
+  carrier->limit = limit;
+
+  NAPI_ASYNC_QUEUE_WORK(dcn_chatlist_snapshot, argv[6], argv[7]);
+  NAPI_ASYNC_RETURN();
+}
+
 NAPI_METHOD(dcn_check_password) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -444,6 +2667,11 @@ NAPI_METHOD(dcn_check_password) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_check_password_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_CHECK_PASSWORD);
+}
+
 NAPI_METHOD(dcn_check_qr) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -465,6 +2693,11 @@ NAPI_METHOD(dcn_check_qr) {
   return result;
 }
 
+NAPI_METHOD(dcn_check_qr_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_CHECK_QR);
+}
+
 NAPI_METHOD(dcn_clear_string_table) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -505,24 +2738,23 @@ NAPI_ASYNC_EXECUTE(dcn_continue_key_transfer) {
                                         carrier->msg_id, carrier->setup_code);
 }
 
+static void dcn_continue_key_transfer_free(napi_env env, dcn_continue_key_transfer_carrier_t* carrier) {
+  free(carrier->setup_code);
+  free(carrier);
+}
+
 NAPI_ASYNC_COMPLETE(dcn_continue_key_transfer) {
-  NAPI_ASYNC_GET_CARRIER(dcn_continue_key_transfer)
-  if (status != napi_ok) {
-    napi_throw_type_error(env, NULL, "Execute callback failed.");
-    return;
-  }
+  NAPI_ASYNC_CHECK_STATUS()
 
   const int argc = 1;
   napi_value argv[argc];
   NAPI_STATUS_THROWS(napi_create_int32(env, carrier->result, &argv[0]));
 
   NAPI_ASYNC_CALL_AND_DELETE_CB()
-  free(carrier->setup_code);
-  free(carrier);
 }
 
 NAPI_METHOD(dcn_continue_key_transfer) {
-  NAPI_ARGV(4);
+  NAPI_ARGV(5);
   NAPI_DCN_CONTEXT();
   NAPI_ARGV_UINT32(msg_id, 1);
   NAPI_ARGV_UTF8_MALLOC(setup_code, 2);
@@ -530,8 +2762,8 @@ NAPI_METHOD(dcn_continue_key_transfer) {
   carrier->msg_id = msg_id;
   carrier->setup_code = setup_code;
 
-  NAPI_ASYNC_QUEUE_WORK(dcn_continue_key_transfer, argv[3]);
-  NAPI_RETURN_UNDEFINED();
+  NAPI_ASYNC_QUEUE_WORK(dcn_continue_key_transfer, argv[3], argv[4]);
+  NAPI_ASYNC_RETURN();
 }
 
 NAPI_METHOD(dcn_create_chat_by_contact_id) {
@@ -544,6 +2776,11 @@ NAPI_METHOD(dcn_create_chat_by_contact_id) {
   NAPI_RETURN_UINT32(chat_id);
 }
 
+NAPI_METHOD(dcn_create_chat_by_contact_id_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_CREATE_CHAT_BY_CONTACT_ID);
+}
+
 NAPI_METHOD(dcn_create_chat_by_msg_id) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -554,6 +2791,11 @@ NAPI_METHOD(dcn_create_chat_by_msg_id) {
   NAPI_RETURN_UINT32(chat_id);
 }
 
+NAPI_METHOD(dcn_create_chat_by_msg_id_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_CREATE_CHAT_BY_MSG_ID);
+}
+
 NAPI_METHOD(dcn_create_contact) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -568,6 +2810,11 @@ NAPI_METHOD(dcn_create_contact) {
   NAPI_RETURN_UINT32(contact_id);
 }
 
+NAPI_METHOD(dcn_create_contact_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_CREATE_CONTACT);
+}
+
 NAPI_METHOD(dcn_create_group_chat) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -581,6 +2828,11 @@ NAPI_METHOD(dcn_create_group_chat) {
   NAPI_RETURN_UINT32(chat_id);
 }
 
+NAPI_METHOD(dcn_create_group_chat_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_CREATE_GROUP_CHAT);
+}
+
 NAPI_METHOD(dcn_delete_chat) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -591,6 +2843,11 @@ NAPI_METHOD(dcn_delete_chat) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_delete_chat_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_DELETE_CHAT);
+}
+
 NAPI_METHOD(dcn_delete_contact) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -601,19 +2858,110 @@ NAPI_METHOD(dcn_delete_contact) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_delete_contact_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_DELETE_CONTACT);
+}
+
+/**
+ * Async work for the bulk message operations. The ids are always copied,
+ * JS may change a typed array while the work runs on the pool.
+ */
+enum {
+  DCN_MSGS_DELETE,
+  DCN_MSGS_FORWARD,
+  DCN_MSGS_MARKSEEN,
+  DCN_MSGS_STAR
+};
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_msgs_op)
+  int op;
+  uint32_t* msg_ids;
+  uint32_t length;
+  uint32_t chat_id;
+  int star;
+NAPI_ASYNC_CARRIER_END(dcn_msgs_op)
+
+NAPI_ASYNC_EXECUTE(dcn_msgs_op) {
+  NAPI_ASYNC_GET_CARRIER(dcn_msgs_op)
+  dc_context_t* dc_context = carrier->dcn_context->dc_context;
+  switch (carrier->op) {
+    case DCN_MSGS_DELETE:
+      dc_delete_msgs(dc_context, carrier->msg_ids, carrier->length);
+      break;
+    case DCN_MSGS_FORWARD:
+      dc_forward_msgs(dc_context, carrier->msg_ids, carrier->length, carrier->chat_id);
+      break;
+    case DCN_MSGS_MARKSEEN:
+      dc_markseen_msgs(dc_context, carrier->msg_ids, carrier->length);
+      break;
+    case DCN_MSGS_STAR:
+      dc_star_msgs(dc_context, carrier->msg_ids, carrier->length, carrier->star);
+      break;
+  }
+}
+
+static void dcn_msgs_op_free(napi_env env, dcn_msgs_op_carrier_t* carrier) {
+  free(carrier->msg_ids);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_msgs_op) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 0;
+  napi_value argv[1];
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
+}
+
+static napi_value dcn_msgs_op_queue(napi_env env, dcn_context_t* dcn_context,
+                                    int op, napi_value js_array,
+                                    uint32_t chat_id, int star,
+                                    napi_value cb, napi_value priority) {
+  // Nothing is queued if the ids are invalid, the exception is pending
+  uint32_t length;
+  uint32_t* msg_ids = js_to_uint32_ids_copy(env, js_array, &length);
+  if (msg_ids == NULL) {
+    return NULL;
+  }
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_msgs_op)
+  carrier->op = op;
+  carrier->chat_id = chat_id;
+  carrier->star = star;
+  carrier->work.priority = op == DCN_MSGS_MARKSEEN ? WORKPOOL_BACKGROUND : WORKPOOL_INTERACTIVE;
+  carrier->msg_ids = msg_ids;
+  carrier->length = length;
+
+  NAPI_ASYNC_QUEUE_WORK(dcn_msgs_op, cb, priority);
+  NAPI_ASYNC_RETURN();
+}
+
 NAPI_METHOD(dcn_delete_msgs) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
   napi_value js_array = argv[1];
 
   uint32_t length;
-  uint32_t* msg_ids = js_array_to_uint32(env, js_array, &length);
+  int owned;
+  uint32_t* msg_ids = js_to_uint32_ids(env, js_array, &length, &owned);
+  if (msg_ids == NULL) {
+    return NULL;
+  }
   dc_delete_msgs(dcn_context->dc_context, msg_ids, length);
-  free(msg_ids);
+  if (owned) free(msg_ids);
 
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_delete_msgs_async) {
+  NAPI_ARGV(4);
+  NAPI_DCN_CONTEXT();
+
+  return dcn_msgs_op_queue(env, dcn_context, DCN_MSGS_DELETE, argv[1], 0, 0, argv[2], argv[3]);
+}
+
 NAPI_METHOD(dcn_forward_msgs) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -621,13 +2969,25 @@ NAPI_METHOD(dcn_forward_msgs) {
   NAPI_ARGV_UINT32(chat_id, 2);
 
   uint32_t length;
-  uint32_t* msg_ids = js_array_to_uint32(env, js_array, &length);
+  int owned;
+  uint32_t* msg_ids = js_to_uint32_ids(env, js_array, &length, &owned);
+  if (msg_ids == NULL) {
+    return NULL;
+  }
   dc_forward_msgs(dcn_context->dc_context, msg_ids, length, chat_id);
-  free(msg_ids);
+  if (owned) free(msg_ids);
 
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_forward_msgs_async) {
+  NAPI_ARGV(5);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UINT32(chat_id, 2);
+
+  return dcn_msgs_op_queue(env, dcn_context, DCN_MSGS_FORWARD, argv[1], chat_id, 0, argv[3], argv[4]);
+}
+
 NAPI_METHOD(dcn_get_blobdir) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -646,17 +3006,27 @@ NAPI_METHOD(dcn_get_blocked_cnt) {
   NAPI_RETURN_INT32(blocked_cnt);
 }
 
+NAPI_METHOD(dcn_get_blocked_cnt_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_BLOCKED_CNT);
+}
+
 NAPI_METHOD(dcn_get_blocked_contacts) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
 
   dc_array_t* contacts = dc_get_blocked_contacts(dcn_context->dc_context);
-  napi_value js_array = dc_array_to_js_array(env, contacts);
+  napi_value js_array = dc_array_to_uint32_array(env, contacts);
   dc_array_unref(contacts);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_get_blocked_contacts_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_BLOCKED_CONTACTS);
+}
+
 NAPI_METHOD(dcn_get_chat) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -675,18 +3045,28 @@ NAPI_METHOD(dcn_get_chat) {
   return result;
 }
 
+NAPI_METHOD(dcn_get_chat_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHAT);
+}
+
 NAPI_METHOD(dcn_get_chat_contacts) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
   NAPI_ARGV_UINT32(chat_id, 1);
 
   dc_array_t* contacts = dc_get_chat_contacts(dcn_context->dc_context, chat_id);
-  napi_value js_array = dc_array_to_js_array(env, contacts);
+  napi_value js_array = dc_array_to_uint32_array(env, contacts);
   dc_array_unref(contacts);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_get_chat_contacts_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHAT_CONTACTS);
+}
+
 NAPI_METHOD(dcn_get_chat_id_by_contact_id) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -698,6 +3078,11 @@ NAPI_METHOD(dcn_get_chat_id_by_contact_id) {
   NAPI_RETURN_UINT32(chat_id);
 }
 
+NAPI_METHOD(dcn_get_chat_id_by_contact_id_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHAT_ID_BY_CONTACT_ID);
+}
+
 NAPI_METHOD(dcn_get_chat_media) {
   NAPI_ARGV(5);
   NAPI_DCN_CONTEXT();
@@ -711,12 +3096,17 @@ NAPI_METHOD(dcn_get_chat_media) {
                                           msg_type1,
                                           msg_type2,
                                           msg_type3);
-  napi_value js_array = dc_array_to_js_array(env, msg_ids);
+  napi_value js_array = dc_array_to_uint32_array(env, msg_ids);
   dc_array_unref(msg_ids);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_get_chat_media_async) {
+  NAPI_ARGV(7);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHAT_MEDIA);
+}
+
 NAPI_METHOD(dcn_get_mime_headers) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -724,47 +3114,145 @@ NAPI_METHOD(dcn_get_mime_headers) {
 
   char* headers = dc_get_mime_headers(dcn_context->dc_context, msg_id);
 
-  NAPI_RETURN_AND_FREE_STRING(headers);
+  NAPI_RETURN_AND_FREE_STRING(headers);
+}
+
+NAPI_METHOD(dcn_get_mime_headers_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_MIME_HEADERS);
+}
+
+NAPI_METHOD(dcn_get_chat_msgs) {
+  NAPI_ARGV(4);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UINT32(chat_id, 1);
+  NAPI_ARGV_UINT32(flags, 2);
+  NAPI_ARGV_UINT32(marker1before, 3);
+
+  dc_array_t* msg_ids = dc_get_chat_msgs(dcn_context->dc_context,
+                                         chat_id,
+                                         flags,
+                                         marker1before);
+  napi_value js_array = dc_array_to_uint32_array(env, msg_ids);
+  dc_array_unref(msg_ids);
+
+  return js_array;
+}
+
+NAPI_METHOD(dcn_get_chat_msgs_async) {
+  NAPI_ARGV(6);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHAT_MSGS);
+}
+
+NAPI_METHOD(dcn_get_chatlist) {
+  NAPI_ARGV(4);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_INT32(listflags, 1);
+  NAPI_ARGV_UTF8_MALLOC(query, 2);
+  NAPI_ARGV_UINT32(query_contact_id, 3);
+
+  dc_chatlist_t* chatlist = dc_get_chatlist(dcn_context->dc_context,
+                                            listflags,
+                                            query && query[0] ? query : NULL,
+                                            query_contact_id);
+
+  free(query);
+
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_external(env,
+                                          chatlist,
+                                          finalize_chatlist,
+                                          NULL,
+                                          &result));
+  return result;
+}
+
+NAPI_METHOD(dcn_get_chatlist_async) {
+  NAPI_ARGV(6);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CHATLIST);
+}
+
+/**
+ * The ids of a bulk getter are read without a copy on the main thread and
+ * copied for the worker thread
+ */
+static napi_value dcn_get_jsons(napi_env env, napi_value* argv, dcn_json_kind_t kind) {
+  NAPI_DCN_CONTEXT();
+
+  uint32_t length;
+  int owned;
+  uint32_t* ids = js_to_uint32_ids(env, argv[1], &length, &owned);
+  if (ids == NULL) {
+    return NULL;
+  }
+  void* jsons = dcn_jsons_load(dcn_context->dc_context, kind, ids, length);
+  if (owned) free(ids);
+
+  napi_value result = dcn_jsons_to_js(env, kind, jsons, length);
+  dcn_jsons_free(kind, jsons, length);
+
+  return result;
+}
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_get_jsons)
+  dcn_json_kind_t kind;
+  uint32_t* ids;
+  uint32_t length;
+  void* jsons;
+NAPI_ASYNC_CARRIER_END(dcn_get_jsons)
+
+NAPI_ASYNC_EXECUTE(dcn_get_jsons) {
+  NAPI_ASYNC_GET_CARRIER(dcn_get_jsons)
+  carrier->jsons = dcn_jsons_load(carrier->dcn_context->dc_context, carrier->kind,
+                                  carrier->ids, carrier->length);
+}
+
+static void dcn_get_jsons_free(napi_env env, dcn_get_jsons_carrier_t* carrier) {
+  dcn_jsons_free(carrier->kind, carrier->jsons, carrier->length);
+  free(carrier->ids);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_get_jsons) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 1;
+  napi_value argv[argc];
+  argv[0] = dcn_jsons_to_js(env, carrier->kind, carrier->jsons, carrier->length);
+  if (argv[0] == NULL) {
+    return;
+  }
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
 }
 
-NAPI_METHOD(dcn_get_chat_msgs) {
-  NAPI_ARGV(4);
+static napi_value dcn_get_jsons_queue(napi_env env, napi_value* argv, dcn_json_kind_t kind) {
   NAPI_DCN_CONTEXT();
-  NAPI_ARGV_UINT32(chat_id, 1);
-  NAPI_ARGV_UINT32(flags, 2);
-  NAPI_ARGV_UINT32(marker1before, 3);
 
-  dc_array_t* msg_ids = dc_get_chat_msgs(dcn_context->dc_context,
-                                         chat_id,
-                                         flags,
-                                         marker1before);
-  napi_value js_array = dc_array_to_js_array(env, msg_ids);
-  dc_array_unref(msg_ids);
-
-  return js_array;
-}
+  // Nothing is queued if the ids are invalid, the exception is pending
+  uint32_t length;
+  uint32_t* ids = js_to_uint32_ids_copy(env, argv[1], &length);
+  if (ids == NULL) {
+    return NULL;
+  }
 
-NAPI_METHOD(dcn_get_chatlist) {
-  NAPI_ARGV(4);
-  NAPI_DCN_CONTEXT();
-  NAPI_ARGV_INT32(listflags, 1);
-  NAPI_ARGV_UTF8_MALLOC(query, 2);
-  NAPI_ARGV_UINT32(query_contact_id, 3);
+  NAPI_ASYNC_NEW_CARRIER(dcn_get_jsons)
+  carrier->kind = kind;
+  carrier->ids = ids;
+  carrier->length = length;
 
-  dc_chatlist_t* chatlist = dc_get_chatlist(dcn_context->dc_context,
-                                            listflags,
-                                            query && query[0] ? query : NULL,
-                                            query_contact_id);
+  NAPI_ASYNC_QUEUE_WORK(dcn_get_jsons, argv[2], argv[3]);
+  NAPI_ASYNC_RETURN();
+}
 
-  free(query);
+NAPI_METHOD(dcn_get_chats_info) {
+  NAPI_ARGV(2);
+  return dcn_get_jsons(env, argv, DCN_JSON_CHAT);
+}
 
-  napi_value result;
-  NAPI_STATUS_THROWS(napi_create_external(env,
-                                          chatlist,
-                                          finalize_chatlist,
-                                          NULL,
-                                          &result));
-  return result;
+NAPI_METHOD(dcn_get_chats_info_async) {
+  NAPI_ARGV(4);
+  return dcn_get_jsons_queue(env, argv, DCN_JSON_CHAT);
 }
 
 NAPI_METHOD(dcn_get_config) {
@@ -779,6 +3267,11 @@ NAPI_METHOD(dcn_get_config) {
   NAPI_RETURN_AND_FREE_STRING(value);
 }
 
+NAPI_METHOD(dcn_get_config_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CONFIG);
+}
+
 NAPI_METHOD(dcn_get_contact) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -798,6 +3291,11 @@ NAPI_METHOD(dcn_get_contact) {
   return result;
 }
 
+NAPI_METHOD(dcn_get_contact_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CONTACT);
+}
+
 NAPI_METHOD(dcn_get_contact_encrinfo) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -809,6 +3307,11 @@ NAPI_METHOD(dcn_get_contact_encrinfo) {
   NAPI_RETURN_AND_FREE_STRING(encr_info);
 }
 
+NAPI_METHOD(dcn_get_contact_encrinfo_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CONTACT_ENCRINFO);
+}
+
 NAPI_METHOD(dcn_get_contacts) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -817,13 +3320,28 @@ NAPI_METHOD(dcn_get_contacts) {
 
   dc_array_t* contacts = dc_get_contacts(dcn_context->dc_context, listflags,
                                          query && query[0] ? query : NULL);
-  napi_value js_array = dc_array_to_js_array(env, contacts);
+  napi_value js_array = dc_array_to_uint32_array(env, contacts);
   free(query);
   dc_array_unref(contacts);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_get_contacts_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_CONTACTS);
+}
+
+NAPI_METHOD(dcn_get_contacts_info) {
+  NAPI_ARGV(2);
+  return dcn_get_jsons(env, argv, DCN_JSON_CONTACT);
+}
+
+NAPI_METHOD(dcn_get_contacts_info_async) {
+  NAPI_ARGV(4);
+  return dcn_get_jsons_queue(env, argv, DCN_JSON_CONTACT);
+}
+
 NAPI_METHOD(dcn_get_draft) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -842,6 +3360,87 @@ NAPI_METHOD(dcn_get_draft) {
   return result;
 }
 
+NAPI_METHOD(dcn_get_draft_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_DRAFT);
+}
+
+NAPI_METHOD(dcn_get_event_queue_stats) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  eventqueue_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  eventqueue_get_stats(dcn_context->event_queue, &stats);
+
+  napi_value result;
+  napi_value capacity;
+  napi_value depth;
+  napi_value max_depth;
+  napi_value delivered;
+  napi_value batches;
+  napi_value dropped;
+  napi_value coalesced;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.capacity, &capacity));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.depth, &depth));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.max_depth, &max_depth));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.delivered, &delivered));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.batches, &batches));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.dropped, &dropped));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.coalesced, &coalesced));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "capacity", capacity));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "depth", depth));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "maxDepth", max_depth));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "delivered", delivered));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "batches", batches));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "dropped", dropped));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "coalesced", coalesced));
+
+  napi_value strings;
+  napi_value allocs;
+  napi_value reused;
+  napi_value mallocs;
+  napi_value bytes;
+  NAPI_STATUS_THROWS(napi_create_object(env, &strings));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.strings.allocs, &allocs));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.strings.reused, &reused));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.strings.mallocs, &mallocs));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)stats.strings.bytes, &bytes));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, strings, "allocs", allocs));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, strings, "reused", reused));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, strings, "mallocs", mallocs));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, strings, "bytes", bytes));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "strings", strings));
+
+  return result;
+}
+
+NAPI_METHOD(dcn_get_event_stats) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+
+  eventstats_t* stats = dcn_context->event_stats;
+  for (int i = 0; i < eventstats_get_cnt(stats); i++) {
+    napi_value key;
+    napi_value entry;
+    napi_value queued;
+    napi_value dispatch;
+    NAPI_STATUS_THROWS(napi_create_int32(env, eventstats_get_event(stats, i), &key));
+    NAPI_STATUS_THROWS(napi_create_object(env, &entry));
+    queued = histogram_to_js(env, eventstats_get_histogram(stats, i, EVENTSTATS_QUEUED));
+    dispatch = histogram_to_js(env, eventstats_get_histogram(stats, i, EVENTSTATS_DISPATCH));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, entry, "queued", queued));
+    NAPI_STATUS_THROWS(napi_set_named_property(env, entry, "dispatch", dispatch));
+    NAPI_STATUS_THROWS(napi_set_property(env, result, key, entry));
+  }
+
+  return result;
+}
+
 NAPI_METHOD(dcn_get_fresh_msg_cnt) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -852,17 +3451,27 @@ NAPI_METHOD(dcn_get_fresh_msg_cnt) {
   NAPI_RETURN_INT32(msg_cnt);
 }
 
+NAPI_METHOD(dcn_get_fresh_msg_cnt_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_FRESH_MSG_CNT);
+}
+
 NAPI_METHOD(dcn_get_fresh_msgs) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
 
   dc_array_t* msg_ids = dc_get_fresh_msgs(dcn_context->dc_context);
-  napi_value js_array = dc_array_to_js_array(env, msg_ids);
+  napi_value js_array = dc_array_to_uint32_array(env, msg_ids);
   dc_array_unref(msg_ids);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_get_fresh_msgs_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_FRESH_MSGS);
+}
+
 NAPI_METHOD(dcn_get_info) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -872,6 +3481,11 @@ NAPI_METHOD(dcn_get_info) {
   NAPI_RETURN_AND_FREE_STRING(str);
 }
 
+NAPI_METHOD(dcn_get_info_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_INFO);
+}
+
 NAPI_METHOD(dcn_get_msg) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -890,6 +3504,11 @@ NAPI_METHOD(dcn_get_msg) {
   return result;
 }
 
+NAPI_METHOD(dcn_get_msg_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_MSG);
+}
+
 NAPI_METHOD(dcn_get_msg_cnt) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -900,6 +3519,11 @@ NAPI_METHOD(dcn_get_msg_cnt) {
   NAPI_RETURN_INT32(msg_cnt);
 }
 
+NAPI_METHOD(dcn_get_msg_cnt_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_MSG_CNT);
+}
+
 NAPI_METHOD(dcn_get_msg_info) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -910,6 +3534,21 @@ NAPI_METHOD(dcn_get_msg_info) {
   NAPI_RETURN_AND_FREE_STRING(msg_info);
 }
 
+NAPI_METHOD(dcn_get_msg_info_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_MSG_INFO);
+}
+
+NAPI_METHOD(dcn_get_msgs) {
+  NAPI_ARGV(2);
+  return dcn_get_jsons(env, argv, DCN_JSON_MSG);
+}
+
+NAPI_METHOD(dcn_get_msgs_async) {
+  NAPI_ARGV(4);
+  return dcn_get_jsons_queue(env, argv, DCN_JSON_MSG);
+}
+
 NAPI_METHOD(dcn_get_next_media) {
   NAPI_ARGV(6);
   NAPI_DCN_CONTEXT();
@@ -929,6 +3568,11 @@ NAPI_METHOD(dcn_get_next_media) {
   NAPI_RETURN_UINT32(next_id);
 }
 
+NAPI_METHOD(dcn_get_next_media_async) {
+  NAPI_ARGV(8);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_NEXT_MEDIA);
+}
+
 NAPI_METHOD(dcn_get_securejoin_qr) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -940,6 +3584,11 @@ NAPI_METHOD(dcn_get_securejoin_qr) {
   NAPI_RETURN_AND_FREE_STRING(code);
 }
 
+NAPI_METHOD(dcn_get_securejoin_qr_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_GET_SECUREJOIN_QR);
+}
+
 NAPI_METHOD(dcn_imex) {
   NAPI_ARGV(4);
   NAPI_DCN_CONTEXT();
@@ -958,6 +3607,77 @@ NAPI_METHOD(dcn_imex) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_ASYNC_CARRIER_BEGIN(dcn_imex_async)
+  int what;
+  char* param1;
+  char* param2;
+  int result;
+  int cancelled;
+NAPI_ASYNC_CARRIER_END(dcn_imex_async)
+
+NAPI_ASYNC_EXECUTE(dcn_imex_async) {
+  NAPI_ASYNC_GET_CARRIER(dcn_imex_async)
+  dcn_context_t* dcn_context = carrier->dcn_context;
+  unsigned int generation = atomic_load(&dcn_context->stop_generation);
+  carrier->result = dc_imex(dcn_context->dc_context,
+                            carrier->what,
+                            carrier->param1,
+                            carrier->param2[0] ? carrier->param2 : NULL);
+  // dc_imex() does not tell why it failed, but core only stops an
+  // ongoing process when asked to while this one was running
+  carrier->cancelled = !carrier->result &&
+    atomic_load(&dcn_context->stop_generation) != generation;
+}
+
+static void dcn_imex_async_free(napi_env env, dcn_imex_async_carrier_t* carrier) {
+  free(carrier->param1);
+  free(carrier->param2);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_imex_async) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 1;
+  napi_value argv[argc];
+
+  if (carrier->result) {
+    NAPI_STATUS_THROWS(napi_get_null(env, &argv[0]));
+  } else {
+    napi_value message;
+    const char* text = carrier->cancelled ? "Import/export cancelled"
+                                          : "Import/export failed";
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, text,
+                                               NAPI_AUTO_LENGTH, &message));
+    NAPI_STATUS_THROWS(napi_create_error(env, NULL, message, &argv[0]));
+  }
+
+  NAPI_ASYNC_CALL_ERRBACK_AND_DELETE_CB()
+}
+
+/**
+ * Runs dc_imex() on work_pool, a backup can take minutes. It is
+ * cancelled with dc_stop_ongoing_process().
+ */
+NAPI_METHOD(dcn_imex_async) {
+  NAPI_ARGV(6);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_INT32(what, 1);
+  NAPI_ARGV_UTF8_MALLOC(param1, 2);
+  NAPI_ARGV_UTF8_MALLOC(param2, 3);
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_imex_async)
+  carrier->what = what;
+  carrier->param1 = param1;
+  carrier->param2 = param2;
+  // Importing a backup replaces the database under the other calls
+  carrier->work.exclusive = what == DC_IMEX_IMPORT_BACKUP;
+  carrier->work.priority = WORKPOOL_BACKGROUND;
+
+  NAPI_ASYNC_QUEUE_WORK(dcn_imex_async, argv[4], argv[5]);
+  NAPI_ASYNC_RETURN();
+}
+
 NAPI_METHOD(dcn_imex_has_backup) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -970,6 +3690,11 @@ NAPI_METHOD(dcn_imex_has_backup) {
   NAPI_RETURN_AND_FREE_STRING(file);
 }
 
+NAPI_METHOD(dcn_imex_has_backup_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_IMEX_HAS_BACKUP);
+}
+
 NAPI_ASYNC_CARRIER_BEGIN(dcn_initiate_key_transfer)
   char* result;
 NAPI_ASYNC_CARRIER_END(dcn_initiate_key_transfer)
@@ -979,12 +3704,13 @@ NAPI_ASYNC_EXECUTE(dcn_initiate_key_transfer) {
   carrier->result = dc_initiate_key_transfer(carrier->dcn_context->dc_context);
 }
 
+static void dcn_initiate_key_transfer_free(napi_env env, dcn_initiate_key_transfer_carrier_t* carrier) {
+  free(carrier->result);
+  free(carrier);
+}
+
 NAPI_ASYNC_COMPLETE(dcn_initiate_key_transfer) {
-  NAPI_ASYNC_GET_CARRIER(dcn_initiate_key_transfer);
-   if (status != napi_ok) {
-    napi_throw_type_error(env, NULL, "Execute callback failed.");
-    return;
-  }
+  NAPI_ASYNC_CHECK_STATUS()
 
   const int argc = 1;
   napi_value argv[argc];
@@ -994,19 +3720,17 @@ NAPI_ASYNC_COMPLETE(dcn_initiate_key_transfer) {
     NAPI_STATUS_THROWS(napi_get_null(env, &argv[0]));
   }
 
-  NAPI_ASYNC_CALL_AND_DELETE_CB();
-  free(carrier->result);
-  free(carrier);
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
 }
 
 NAPI_METHOD(dcn_initiate_key_transfer) {
-  NAPI_ARGV(2);
+  NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
 
   NAPI_ASYNC_NEW_CARRIER(dcn_initiate_key_transfer);
 
-  NAPI_ASYNC_QUEUE_WORK(dcn_initiate_key_transfer, argv[1]);
-  NAPI_RETURN_UNDEFINED();
+  NAPI_ASYNC_QUEUE_WORK(dcn_initiate_key_transfer, argv[1], argv[2]);
+  NAPI_ASYNC_RETURN();
 }
 
 NAPI_METHOD(dcn_is_configured) {
@@ -1018,6 +3742,11 @@ NAPI_METHOD(dcn_is_configured) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_is_configured_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_IS_CONFIGURED);
+}
+
 NAPI_METHOD(dcn_is_contact_in_chat) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -1030,6 +3759,11 @@ NAPI_METHOD(dcn_is_contact_in_chat) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_is_contact_in_chat_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_IS_CONTACT_IN_CHAT);
+}
+
 NAPI_METHOD(dcn_is_open) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -1051,6 +3785,30 @@ NAPI_METHOD(dcn_join_securejoin) {
   NAPI_RETURN_UINT32(chat_id);
 }
 
+NAPI_METHOD(dcn_join_securejoin_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_JOIN_SECUREJOIN);
+}
+
+NAPI_METHOD(dcn_load_string_table) {
+  NAPI_ARGV(2);
+  NAPI_DCN_CONTEXT();
+
+  return js_array_to_strtable(env, dcn_context->strtable, argv[1], 0);
+}
+
+NAPI_METHOD(dcn_load_string_table_file) {
+  NAPI_ARGV(2);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UTF8_MALLOC(path, 1);
+
+  int result = strtable_load_file(dcn_context->strtable, path);
+
+  free(path);
+
+  NAPI_RETURN_INT32(result);
+}
+
 NAPI_METHOD(dcn_lookup_contact_id_by_addr) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -1063,6 +3821,11 @@ NAPI_METHOD(dcn_lookup_contact_id_by_addr) {
   NAPI_RETURN_UINT32(res);
 }
 
+NAPI_METHOD(dcn_lookup_contact_id_by_addr_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_LOOKUP_CONTACT_ID_BY_ADDR);
+}
+
 NAPI_METHOD(dcn_marknoticed_chat) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -1073,6 +3836,11 @@ NAPI_METHOD(dcn_marknoticed_chat) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_marknoticed_chat_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_MARKNOTICED_CHAT);
+}
+
 NAPI_METHOD(dcn_marknoticed_all_chats) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -1082,6 +3850,11 @@ NAPI_METHOD(dcn_marknoticed_all_chats) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_marknoticed_all_chats_async) {
+  NAPI_ARGV(3);
+  return dcn_call_queue(env, argv, DCN_CALL_MARKNOTICED_ALL_CHATS);
+}
+
 NAPI_METHOD(dcn_marknoticed_contact) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -1092,19 +3865,35 @@ NAPI_METHOD(dcn_marknoticed_contact) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_marknoticed_contact_async) {
+  NAPI_ARGV(4);
+  return dcn_call_queue(env, argv, DCN_CALL_MARKNOTICED_CONTACT);
+}
+
 NAPI_METHOD(dcn_markseen_msgs) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
   napi_value js_array = argv[1];
 
   uint32_t length;
-  uint32_t* msg_ids = js_array_to_uint32(env, js_array, &length);
+  int owned;
+  uint32_t* msg_ids = js_to_uint32_ids(env, js_array, &length, &owned);
+  if (msg_ids == NULL) {
+    return NULL;
+  }
   dc_markseen_msgs(dcn_context->dc_context, msg_ids, length);
-  free(msg_ids);
+  if (owned) free(msg_ids);
 
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_markseen_msgs_async) {
+  NAPI_ARGV(4);
+  NAPI_DCN_CONTEXT();
+
+  return dcn_msgs_op_queue(env, dcn_context, DCN_MSGS_MARKSEEN, argv[1], 0, 0, argv[2], argv[3]);
+}
+
 NAPI_METHOD(dcn_maybe_network) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -1114,6 +3903,13 @@ NAPI_METHOD(dcn_maybe_network) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_merge_string_table) {
+  NAPI_ARGV(2);
+  NAPI_DCN_CONTEXT();
+
+  return js_array_to_strtable(env, dcn_context->strtable, argv[1], 1);
+}
+
 NAPI_METHOD(dcn_msg_new) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
@@ -1127,30 +3923,27 @@ NAPI_METHOD(dcn_msg_new) {
   return result;
 }
 
-typedef struct dcn_open_carrier_t {
-  dcn_context_t* dcn_context;
+NAPI_ASYNC_CARRIER_BEGIN(dcn_open)
   char* dbfile;
   char* blobdir;
-  napi_ref callback_ref;
-  napi_async_work async_work;
   int result;
-} dcn_open_carrier_t;
-
-static void dcn_open_execute(napi_env env, void* data) {
-  dcn_open_carrier_t* carrier = (dcn_open_carrier_t*)data;
+NAPI_ASYNC_CARRIER_END(dcn_open)
 
+NAPI_ASYNC_EXECUTE(dcn_open) {
+  NAPI_ASYNC_GET_CARRIER(dcn_open)
   carrier->result = dc_open(carrier->dcn_context->dc_context,
                             carrier->dbfile,
                             carrier->blobdir);
 }
 
-static void dcn_open_complete(napi_env env, napi_status status, void* data) {
-  dcn_open_carrier_t* carrier = (dcn_open_carrier_t*)data;
+static void dcn_open_free(napi_env env, dcn_open_carrier_t* carrier) {
+  free(carrier->dbfile);
+  free(carrier->blobdir);
+  free(carrier);
+}
 
-  if (status != napi_ok) {
-    napi_throw_type_error(env, NULL, "Execute callback failed.");
-    return;
-  }
+NAPI_ASYNC_COMPLETE(dcn_open) {
+  NAPI_ASYNC_CHECK_STATUS()
 
   const int argc = 1;
   napi_value argv[argc];
@@ -1164,102 +3957,277 @@ static void dcn_open_complete(napi_env env, napi_status status, void* data) {
     NAPI_STATUS_THROWS(napi_create_error(env, NULL, msg, &argv[0]));
   }
 
-  napi_value global;
-  NAPI_STATUS_THROWS(napi_get_global(env, &global));
-  napi_value callback;
-  NAPI_STATUS_THROWS(napi_get_reference_value(env, carrier->callback_ref, &callback));
-  NAPI_STATUS_THROWS(napi_call_function(env, global, callback, argc, argv, NULL));
+  NAPI_ASYNC_CALL_ERRBACK_AND_DELETE_CB()
+}
+
+NAPI_METHOD(dcn_open) {
+  NAPI_ARGV(5);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UTF8_MALLOC(dbfile, 1);
+  NAPI_ARGV_UTF8_MALLOC(blobdir, 2);
 
-  NAPI_STATUS_THROWS(napi_delete_reference(env, carrier->callback_ref));
-  NAPI_STATUS_THROWS(napi_delete_async_work(env, carrier->async_work));
+  NAPI_ASYNC_NEW_CARRIER(dcn_open)
+  carrier->dbfile = dbfile;
+  carrier->blobdir = blobdir;
+  carrier->work.exclusive = 1;
 
-  free(carrier->dbfile);
-  free(carrier->blobdir);
-  free(carrier);
+  NAPI_ASYNC_QUEUE_WORK(dcn_open, argv[3], argv[4]);
+  NAPI_ASYNC_RETURN();
 }
 
-NAPI_METHOD(dcn_open) {
-  NAPI_ARGV(4);
+/**
+ * The object dcn_poll_event() returns, { event, data1, data2 }
+ */
+static napi_value dcn_event_to_js(napi_env env, const eventqueue_item_t* item) {
+  dcn_strings_t strings;
+  if (dcn_strings_init(env, &strings) == NULL) {
+    return NULL;
+  }
+
+  NAPI_PROPS_BEGIN(3);
+  NAPI_PROP_INT32(&strings, DCN_KEY_EVENT, item->event);
+
+  napi_value data1;
+  if (DC_EVENT_DATA1_IS_STRING(item->event) && item->data1) {
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data1,
+                                               NAPI_AUTO_LENGTH, &data1));
+  } else {
+    NAPI_STATUS_THROWS(napi_create_int32(env, item->data1, &data1));
+  }
+  NAPI_PROP_VALUE(&strings, DCN_KEY_DATA1, data1);
+
+  napi_value data2;
+  if (DC_EVENT_DATA2_IS_STRING(item->event) && item->data2) {
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data2,
+                                               NAPI_AUTO_LENGTH, &data2));
+  } else {
+    NAPI_STATUS_THROWS(napi_create_int32(env, item->data2, &data2));
+  }
+  NAPI_PROP_VALUE(&strings, DCN_KEY_DATA2, data2);
+
+  napi_value obj;
+  NAPI_PROPS_DEFINE(obj);
+
+  return obj;
+}
+
+NAPI_METHOD(dcn_poll_event) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  eventqueue_t* queue = dcn_context->event_queue;
+  if (queue) {
+    eventqueue_item_t item;
+    if (dcn_take_event(dcn_context, &item)) {
+      // The strings go back to the queue whether the conversion worked
+      // or threw
+      napi_value obj = dcn_event_to_js(env, &item);
+      eventqueue_item_clear(queue, &item);
+      return obj;
+    }
+  }
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_poll_events) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  eventqueue_t* queue = dcn_context->event_queue;
+  if (queue) {
+    eventqueue_item_t* items = NULL;
+    int owned = 0;
+    size_t cnt = dcn_take_events(dcn_context, &items, &owned);
+    if (cnt) {
+      // On failure the exception is thrown and the items stay for the next poll
+      napi_value batch = eventqueue_items_to_js(env, items, cnt, NULL, NULL);
+      dcn_release_events(dcn_context, items, cnt, owned, batch);
+      return batch;
+    }
+  }
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_remove_contact_from_chat) {
+  NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
-  NAPI_ARGV_UTF8_MALLOC(dbfile, 1);
-  NAPI_ARGV_UTF8_MALLOC(blobdir, 2);
-  napi_value callback = argv[3];
+  NAPI_ARGV_UINT32(chat_id, 1);
+  NAPI_ARGV_UINT32(contact_id, 2);
 
-  dcn_open_carrier_t* carrier = calloc(1, sizeof(dcn_open_carrier_t));
-  carrier->dcn_context = dcn_context;
-  carrier->dbfile = strdup(dbfile);
-  carrier->blobdir = strdup(blobdir);
+  int result = dc_remove_contact_from_chat(dcn_context->dc_context,
+                                           chat_id, contact_id);
 
-  napi_value async_resource_name;
-  NAPI_STATUS_THROWS(napi_create_reference(env, callback, 1, &carrier->callback_ref));
-  NAPI_STATUS_THROWS(napi_create_string_utf8(env, "dcn_open_callback",
-                                             NAPI_AUTO_LENGTH,
-                                             &async_resource_name));
-  NAPI_STATUS_THROWS(napi_create_async_work(env, callback, async_resource_name,
-                                            dcn_open_execute, dcn_open_complete,
-                                            carrier, &carrier->async_work));
-  NAPI_STATUS_THROWS(napi_queue_async_work(env, carrier->async_work));
-
-  free(dbfile);
-  free(blobdir);
+  NAPI_RETURN_INT32(result);
+}
 
-  NAPI_RETURN_UNDEFINED();
+NAPI_METHOD(dcn_remove_contact_from_chat_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_REMOVE_CONTACT_FROM_CHAT);
 }
 
-NAPI_METHOD(dcn_poll_event) {
-  NAPI_ARGV(1);
-  NAPI_DCN_CONTEXT();
+/**
+ * Replays a journal on the main loop, a timer fires when the next record is
+ * due. Nothing runs on work_pool, the work is only counted as pending so
+ * that the result is handed back like that of any other async binding.
+ */
+#define DCN_REPLAY_BATCH 256
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_replay_event_journal)
+  journal_reader_t* reader;
+  uv_timer_t* timer;
+  double speed;
+  uint64_t start;
+  journal_record_t record;
+  int has_record;
+  int error;
+  uint32_t count;
+NAPI_ASYNC_CARRIER_END(dcn_replay_event_journal)
+
+static void dcn_replay_timer_close_cb(uv_handle_t* handle)
+{
+  free(handle);
+}
 
-#ifndef NODE_10_6
-  eventqueue_t* queue = dcn_context->event_queue;
-  if (queue) {
-    eventqueue_item_t* item = eventqueue_pop(queue);
-    if (item) {
-      napi_value obj;
-      NAPI_STATUS_THROWS(napi_create_object(env, &obj));
+/**
+ * Ends the replay, the result is passed on by dcn_work_async_cb()
+ */
+static void dcn_replay_finish(dcn_replay_event_journal_carrier_t* carrier)
+{
+  dcn_context_t* dcn_context = carrier->dcn_context;
+  if (dcn_context->replay == carrier) {
+    dcn_context->replay = NULL;
+  }
 
-      napi_value event;
-      NAPI_STATUS_THROWS(napi_create_int32(env, item->event, &event));
-      NAPI_STATUS_THROWS(napi_set_named_property(env, obj, "event", event));
+  if (carrier->has_record) {
+    journal_record_clear(&carrier->record);
+    carrier->has_record = 0;
+  }
+  journal_reader_unref(carrier->reader);
+  carrier->reader = NULL;
 
-      napi_value data1;
-      if (DC_EVENT_DATA1_IS_STRING(item->event) && item->data1) {
-        NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data1,
-                                                   NAPI_AUTO_LENGTH, &data1));
-      } else {
-        NAPI_STATUS_THROWS(napi_create_int32(env, item->data1, &data1));
+  if (carrier->timer) {
+    uv_close((uv_handle_t*)carrier->timer, dcn_replay_timer_close_cb);
+    carrier->timer = NULL;
+  }
+
+  dcn_work_done(&carrier->work);
+}
+
+static void dcn_replay_timer_cb(uv_timer_t* timer)
+{
+  dcn_replay_event_journal_carrier_t* carrier = timer->data;
+  const uint64_t now = eventqueue_now();
+
+  for (int i = 0; ; i++) {
+    if (!carrier->has_record) {
+      if (!journal_reader_next(carrier->reader, &carrier->record)) {
+        dcn_replay_finish(carrier);
+        return;
       }
-      NAPI_STATUS_THROWS(napi_set_named_property(env, obj, "data1", data1));
+      carrier->has_record = 1;
+    }
 
-      napi_value data2;
-      if (DC_EVENT_DATA2_IS_STRING(item->event) && item->data2) {
-        NAPI_STATUS_THROWS(napi_create_string_utf8(env, (char*)item->data2,
-                                                   NAPI_AUTO_LENGTH, &data2));
-      } else {
-        NAPI_STATUS_THROWS(napi_create_int32(env, item->data2, &data2));
+    // Keep the recorded pace, a speed of 0 replays as fast as possible
+    if (carrier->speed > 0) {
+      uint64_t due = carrier->start + (uint64_t)(carrier->record.timestamp / carrier->speed);
+      if (due > now) {
+        uv_timer_start(timer, dcn_replay_timer_cb, (due - now + 999999) / 1000000, 0);
+        return;
       }
-      NAPI_STATUS_THROWS(napi_set_named_property(env, obj, "data2", data2));
+    }
 
-      eventqueue_item_unref(item);
+    // Lets the events queued so far be emitted
+    if (i == DCN_REPLAY_BATCH) {
+      uv_timer_start(timer, dcn_replay_timer_cb, 0, 0);
+      return;
+    }
 
-      return obj;
+    // Nobody would answer a replayed request, the core isn't waiting
+    const journal_record_t* record = &carrier->record;
+    if (record->event != DC_EVENT_HTTP_GET &&
+        record->event != DC_EVENT_GET_STRING) {
+      dcn_queue_event(carrier->dcn_context, record->event, record->data1, record->data2);
+      carrier->count++;
     }
+    journal_record_clear(&carrier->record);
+    carrier->has_record = 0;
   }
-#endif
+}
 
-  NAPI_RETURN_UNDEFINED();
+static void dcn_replay_event_journal_free(napi_env env, dcn_replay_event_journal_carrier_t* carrier) {
+  free(carrier);
 }
 
-NAPI_METHOD(dcn_remove_contact_from_chat) {
-  NAPI_ARGV(3);
+NAPI_ASYNC_COMPLETE(dcn_replay_event_journal) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  const int argc = 2;
+  napi_value argv[argc];
+  if (carrier->error) {
+    napi_value message;
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, "Cannot read event journal",
+                                               NAPI_AUTO_LENGTH, &message));
+    NAPI_STATUS_THROWS(napi_create_error(env, NULL, message, &argv[0]));
+  } else {
+    NAPI_STATUS_THROWS(napi_get_null(env, &argv[0]));
+  }
+  NAPI_STATUS_THROWS(napi_create_uint32(env, carrier->count, &argv[1]));
+
+  NAPI_ASYNC_CALL_ERRBACK_AND_DELETE_CB()
+}
+
+NAPI_METHOD(dcn_replay_event_journal) {
+  NAPI_ARGV(4);
   NAPI_DCN_CONTEXT();
-  NAPI_ARGV_UINT32(chat_id, 1);
-  NAPI_ARGV_UINT32(contact_id, 2);
+  double speed;
+  NAPI_STATUS_THROWS(napi_get_value_double(env, argv[2], &speed));
+  uv_loop_t* loop = NULL;
+  NAPI_STATUS_THROWS(napi_get_uv_event_loop(env, &loop));
 
-  int result = dc_remove_contact_from_chat(dcn_context->dc_context,
-                                           chat_id, contact_id);
+  // Everything that may throw comes before the carrier and the reader
+  napi_value callback = argv[3];
+  napi_value async_result;
+  napi_valuetype callback_type;
+  napi_ref callback_ref = NULL;
+  napi_deferred deferred = NULL;
+  NAPI_STATUS_THROWS(napi_typeof(env, callback, &callback_type));
+  if (callback_type == napi_function) {
+    NAPI_STATUS_THROWS(napi_get_undefined(env, &async_result));
+    NAPI_STATUS_THROWS(napi_create_reference(env, callback, 1, &callback_ref));
+  } else {
+    NAPI_STATUS_THROWS(napi_create_promise(env, &deferred, &async_result));
+  }
+  NAPI_ARGV_UTF8_MALLOC(path, 1);
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_replay_event_journal)
+  carrier->callback_ref = callback_ref;
+  carrier->deferred = deferred;
+  carrier->speed = speed;
+  carrier->reader = journal_reader_new(path);
+  free(path);
+  dcn_work_begin(dcn_context, &carrier->work, dcn_replay_event_journal_complete, carrier);
+
+  if (carrier->reader == NULL) {
+    carrier->error = 1;
+    dcn_replay_finish(carrier);
+    return async_result;
+  }
 
-  NAPI_RETURN_INT32(result);
+  // Replaces a replay that is still running
+  if (dcn_context->replay) {
+    dcn_replay_finish(dcn_context->replay);
+  }
+  dcn_context->replay = carrier;
+
+  carrier->timer = calloc(1, sizeof(uv_timer_t));
+  uv_timer_init(loop, carrier->timer);
+  carrier->timer->data = carrier;
+  carrier->start = eventqueue_now();
+  uv_timer_start(carrier->timer, dcn_replay_timer_cb, 0, 0);
+
+  return async_result;
 }
 
 NAPI_METHOD(dcn_search_msgs) {
@@ -1270,13 +4238,18 @@ NAPI_METHOD(dcn_search_msgs) {
 
   dc_array_t* msg_ids = dc_search_msgs(dcn_context->dc_context,
                                        chat_id, query);
-  napi_value js_array = dc_array_to_js_array(env, msg_ids);
+  napi_value js_array = dc_array_to_uint32_array(env, msg_ids);
   dc_array_unref(msg_ids);
   free(query);
 
   return js_array;
 }
 
+NAPI_METHOD(dcn_search_msgs_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_SEARCH_MSGS);
+}
+
 NAPI_METHOD(dcn_send_msg) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -1305,6 +4278,11 @@ NAPI_METHOD(dcn_set_chat_name) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_set_chat_name_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_SET_CHAT_NAME);
+}
+
 NAPI_METHOD(dcn_set_chat_profile_image) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -1320,6 +4298,11 @@ NAPI_METHOD(dcn_set_chat_profile_image) {
   NAPI_RETURN_INT32(result);
 }
 
+NAPI_METHOD(dcn_set_chat_profile_image_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_SET_CHAT_PROFILE_IMAGE);
+}
+
 NAPI_METHOD(dcn_set_config) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -1335,6 +4318,11 @@ NAPI_METHOD(dcn_set_config) {
   NAPI_RETURN_INT32(status);
 }
 
+NAPI_METHOD(dcn_set_config_async) {
+  NAPI_ARGV(5);
+  return dcn_call_queue(env, argv, DCN_CALL_SET_CONFIG);
+}
+
 NAPI_METHOD(dcn_set_draft) {
   NAPI_ARGV(3);
   NAPI_DCN_CONTEXT();
@@ -1352,41 +4340,79 @@ NAPI_METHOD(dcn_set_event_handler) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
 
-#ifdef NODE_10_6
-  napi_value callback = argv[1];
+  if (dcn_context->event_handler_ref) {
+    NAPI_STATUS_THROWS(napi_delete_reference(env, dcn_context->event_handler_ref));
+  }
+  NAPI_STATUS_THROWS(napi_create_reference(env, argv[1], 1, &dcn_context->event_handler_ref));
+  uv_ref((uv_handle_t*)dcn_context->event_async);
 
-  napi_value async_resource_name;
-  NAPI_STATUS_THROWS(napi_create_string_utf8(env, "dc_event_callback", NAPI_AUTO_LENGTH, &async_resource_name));
+  // Deliver whatever was queued before the handler was set
+  uv_async_send(dcn_context->event_async);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_set_event_mask) {
+  NAPI_ARGV(2);
+  NAPI_DCN_CONTEXT();
+  napi_value js_array = argv[1];
 
-  NAPI_STATUS_THROWS(napi_create_threadsafe_function(
-    env,
-    callback,
-    0,
-    async_resource_name,
-    100,
-    1,
-    NULL,
-    NULL,
-    dcn_context,
-    call_js_event_handler,
-    &dcn_context->threadsafe_event_handler));
-#endif
+  uint32_t length;
+  uint32_t* events = js_array_to_uint32(env, js_array, &length);
+  if (events == NULL) {
+    return NULL;
+  }
+
+  unsigned int mask[DCN_EVENT_MASK_WORDS] = { 0 };
+  for (uint32_t i = 0; i < length; i++) {
+    if (events[i] < DCN_EVENT_MASK_BITS) {
+      mask[events[i] / 32] |= 1u << (events[i] % 32);
+    }
+  }
+  free(events);
+
+  for (int i = 0; i < DCN_EVENT_MASK_WORDS; i++) {
+    atomic_store_explicit(&dcn_context->event_mask[i], mask[i],
+                          memory_order_relaxed);
+  }
 
   NAPI_RETURN_UNDEFINED();
 }
 
 NAPI_METHOD(dcn_set_http_get_response) {
+  NAPI_ARGV(3);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UINT32(request_id, 1);
+
+  // null for a failed request, an empty string is an empty response
+  char* response = NULL;
+  napi_valuetype response_type;
+  NAPI_STATUS_THROWS(napi_typeof(env, argv[2], &response_type));
+  if (response_type == napi_string) {
+    NAPI_ARGV_UTF8_MALLOC(body, 2);
+    response = body;
+  }
+
+  // Nobody is waiting any longer if it timed out or was answered twice
+  int result = httpwait_answer(dcn_context->http_wait, request_id, response);
+
+  NAPI_RETURN_INT32(result);
+}
+
+NAPI_METHOD(dcn_set_shared_string_table) {
   NAPI_ARGV(2);
   NAPI_DCN_CONTEXT();
-  NAPI_ARGV_UTF8_MALLOC(response, 1);
 
-  pthread_mutex_lock(&dcn_context->dc_event_http_mutex);
-    dcn_context->dc_event_http_done = 1;
-    dcn_context->dc_event_http_response = response;
-    pthread_cond_signal(&dcn_context->dc_event_http_cond);
-  pthread_mutex_unlock(&dcn_context->dc_event_http_mutex);
+  strtable_t* shared = NULL;
+  napi_valuetype type;
+  NAPI_STATUS_THROWS(napi_typeof(env, argv[1], &type));
+  if (type == napi_external) {
+    NAPI_STATUS_THROWS(napi_get_value_external(env, argv[1], (void**)&shared));
+  }
+
+  int result = strtable_attach(dcn_context->strtable, shared);
 
-  NAPI_RETURN_UNDEFINED();
+  NAPI_RETURN_INT32(result);
 }
 
 NAPI_METHOD(dcn_set_string_table) {
@@ -1409,13 +4435,45 @@ NAPI_METHOD(dcn_star_msgs) {
   NAPI_ARGV_INT32(star, 2);
 
   uint32_t length;
-  uint32_t* msg_ids = js_array_to_uint32(env, js_array, &length);
+  int owned;
+  uint32_t* msg_ids = js_to_uint32_ids(env, js_array, &length, &owned);
+  if (msg_ids == NULL) {
+    return NULL;
+  }
   dc_star_msgs(dcn_context->dc_context, msg_ids, length, star);
-  free(msg_ids);
+  if (owned) free(msg_ids);
 
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_star_msgs_async) {
+  NAPI_ARGV(5);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_INT32(star, 2);
+
+  return dcn_msgs_op_queue(env, dcn_context, DCN_MSGS_STAR, argv[1], 0, star, argv[3], argv[4]);
+}
+
+NAPI_METHOD(dcn_start_event_journal) {
+  NAPI_ARGV(2);
+  NAPI_DCN_CONTEXT();
+  NAPI_ARGV_UTF8_MALLOC(path, 1);
+
+  journal_writer_t* journal = journal_writer_new(path);
+  free(path);
+
+  // Replaces a journal that is still recording
+  atomic_store(&dcn_context->journal_active, 0);
+  pthread_rwlock_wrlock(&dcn_context->journal_lock);
+    journal_writer_t* previous = dcn_context->journal;
+    dcn_context->journal = journal;
+  pthread_rwlock_unlock(&dcn_context->journal_lock);
+  atomic_store(&dcn_context->journal_active, journal != NULL);
+  journal_writer_unref(previous);
+
+  NAPI_RETURN_INT32(journal != NULL);
+}
+
 NAPI_METHOD(dcn_start_threads) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -1429,6 +4487,43 @@ NAPI_METHOD(dcn_start_threads) {
   NAPI_RETURN_UNDEFINED();
 }
 
+NAPI_METHOD(dcn_stop_event_journal) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  atomic_store(&dcn_context->journal_active, 0);
+  pthread_rwlock_wrlock(&dcn_context->journal_lock);
+    journal_writer_t* journal = dcn_context->journal;
+    dcn_context->journal = NULL;
+  pthread_rwlock_unlock(&dcn_context->journal_lock);
+
+  uint64_t records;
+  uint64_t dropped;
+  journal_writer_get_stats(journal, &records, &dropped);
+  journal_writer_unref(journal);
+
+  napi_value result;
+  napi_value value;
+  NAPI_STATUS_THROWS(napi_create_object(env, &result));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)records, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "records", value));
+  NAPI_STATUS_THROWS(napi_create_double(env, (double)dropped, &value));
+  NAPI_STATUS_THROWS(napi_set_named_property(env, result, "dropped", value));
+
+  return result;
+}
+
+NAPI_METHOD(dcn_stop_event_replay) {
+  NAPI_ARGV(1);
+  NAPI_DCN_CONTEXT();
+
+  if (dcn_context->replay) {
+    dcn_replay_finish(dcn_context->replay);
+  }
+
+  NAPI_RETURN_UNDEFINED();
+}
+
 NAPI_METHOD(dcn_stop_threads) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
@@ -1463,6 +4558,8 @@ NAPI_METHOD(dcn_stop_ongoing_process) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
 
+  // Lets a running dcn_imex_async() tell a cancel from a failure
+  atomic_fetch_add(&dcn_context->stop_generation, 1);
   dc_stop_ongoing_process(dcn_context->dc_context);
 
   NAPI_RETURN_UNDEFINED();
@@ -1473,9 +4570,11 @@ NAPI_METHOD(dcn_unset_event_handler) {
   NAPI_ARGV(1);
   NAPI_DCN_CONTEXT();
 
-#ifdef NODE_10_6
-  napi_release_threadsafe_function(dcn_context->threadsafe_event_handler, napi_tsfn_release);
-#endif
+  if (dcn_context->event_handler_ref) {
+    NAPI_STATUS_THROWS(napi_delete_reference(env, dcn_context->event_handler_ref));
+    dcn_context->event_handler_ref = NULL;
+  }
+  uv_unref((uv_handle_t*)dcn_context->event_async);
 
   NAPI_RETURN_UNDEFINED();
 }
@@ -2096,7 +5195,295 @@ NAPI_METHOD(dcn_msg_set_text) {
   NAPI_RETURN_UNDEFINED();
 }
 
+/**
+ * dcn_msg_cursor_t
+ */
+
+typedef struct dcn_msg_cursor_prefetch_carrier_t {
+  dcn_msg_cursor_t* cursor;
+  napi_ref cursor_ref;
+  dcn_work_t work;
+  uint32_t generation;
+} dcn_msg_cursor_prefetch_carrier_t;
+
+static void dcn_msg_cursor_prefetch_execute(napi_env env, void* data) {
+  dcn_msg_cursor_prefetch_carrier_t* carrier = (dcn_msg_cursor_prefetch_carrier_t*)data;
+  dcn_msg_cursor_t* cursor = carrier->cursor;
+
+  pthread_mutex_lock(&cursor->prefetch_mutex);
+  // Skip if a window was asked for before this one even started
+  if (cursor->prefetch_state == DCN_PREFETCH_PENDING &&
+      cursor->prefetch_generation == carrier->generation) {
+    cursor->prefetch_jsons = calloc(cursor->prefetch_cnt, sizeof(dcn_msg_json_t));
+    dcn_msg_cursor_load(cursor, cursor->prefetch_start, cursor->prefetch_cnt,
+                        cursor->prefetch_jsons);
+    cursor->prefetch_state = DCN_PREFETCH_READY;
+  }
+  pthread_mutex_unlock(&cursor->prefetch_mutex);
+}
+
+static void dcn_msg_cursor_prefetch_complete(napi_env env, napi_status status, void* data) {
+  dcn_msg_cursor_prefetch_carrier_t* carrier = (dcn_msg_cursor_prefetch_carrier_t*)data;
+  napi_delete_reference(env, carrier->cursor_ref);
+  free(carrier);
+}
+
+/**
+ * Reads the window [start, start + cnt) on work_pool, replacing
+ * whatever was read ahead before
+ */
+static napi_value dcn_msg_cursor_prefetch(napi_env env, dcn_msg_cursor_t* cursor,
+                                          napi_value js_cursor,
+                                          uint32_t start, uint32_t cnt) {
+  // Before anything is allocated or the pending window is replaced
+  napi_ref cursor_ref;
+  NAPI_STATUS_THROWS(napi_create_reference(env, js_cursor, 1, &cursor_ref));
+
+  dcn_msg_cursor_prefetch_carrier_t* carrier = calloc(1, sizeof(dcn_msg_cursor_prefetch_carrier_t));
+  carrier->cursor = cursor;
+  carrier->cursor_ref = cursor_ref;
+
+  pthread_mutex_lock(&cursor->prefetch_mutex);
+  dcn_msg_cursor_drop_prefetch(cursor);
+  cursor->prefetch_state = DCN_PREFETCH_PENDING;
+  cursor->prefetch_start = start;
+  cursor->prefetch_cnt = cnt;
+  carrier->generation = ++cursor->prefetch_generation;
+  pthread_mutex_unlock(&cursor->prefetch_mutex);
+
+  // Only read in case it is needed, windows asked for go first
+  carrier->work.priority = WORKPOOL_BACKGROUND;
+  dcn_work_queue(cursor->dcn_context, &carrier->work,
+                 dcn_msg_cursor_prefetch_execute,
+                 dcn_msg_cursor_prefetch_complete, carrier);
+
+  return js_cursor;
+}
+
+NAPI_ASYNC_CARRIER_BEGIN(dcn_msg_cursor_window)
+  dcn_msg_cursor_t* cursor;
+  napi_ref cursor_ref;
+  int forward;
+  uint32_t start;
+  uint32_t cnt;
+  dcn_msg_json_t* jsons;
+NAPI_ASYNC_CARRIER_END(dcn_msg_cursor_window)
+
+NAPI_ASYNC_EXECUTE(dcn_msg_cursor_window) {
+  NAPI_ASYNC_GET_CARRIER(dcn_msg_cursor_window)
+  dcn_msg_cursor_t* cursor = carrier->cursor;
+
+  pthread_mutex_lock(&cursor->prefetch_mutex);
+  if (cursor->prefetch_state == DCN_PREFETCH_READY &&
+      cursor->prefetch_start == carrier->start &&
+      cursor->prefetch_cnt == carrier->cnt) {
+    carrier->jsons = cursor->prefetch_jsons;
+    cursor->prefetch_jsons = NULL;
+    cursor->prefetch_state = DCN_PREFETCH_EMPTY;
+    pthread_mutex_unlock(&cursor->prefetch_mutex);
+    return;
+  }
+  // Not read ahead or another window, a pending read is not needed anymore
+  dcn_msg_cursor_drop_prefetch(cursor);
+  pthread_mutex_unlock(&cursor->prefetch_mutex);
+
+  carrier->jsons = calloc(carrier->cnt ? carrier->cnt : 1, sizeof(dcn_msg_json_t));
+  dcn_msg_cursor_load(cursor, carrier->start, carrier->cnt, carrier->jsons);
+}
+
+static void dcn_msg_cursor_window_free(napi_env env, dcn_msg_cursor_window_carrier_t* carrier) {
+  dcn_jsons_free(DCN_JSON_MSG, carrier->jsons, carrier->cnt);
+  napi_delete_reference(env, carrier->cursor_ref);
+  free(carrier);
+}
+
+NAPI_ASYNC_COMPLETE(dcn_msg_cursor_window) {
+  NAPI_ASYNC_CHECK_STATUS()
+
+  dcn_msg_cursor_t* cursor = carrier->cursor;
+  napi_value js_cursor;
+  NAPI_STATUS_THROWS(napi_get_reference_value(env, carrier->cursor_ref, &js_cursor));
+
+  const int argc = 2;
+  napi_value argv[argc];
+  argv[0] = dcn_jsons_to_js(env, DCN_JSON_MSG, carrier->jsons, carrier->cnt);
+  if (argv[0] == NULL) {
+    return;
+  }
+
+  uint32_t* ids = NULL;
+  napi_value arraybuffer;
+  NAPI_STATUS_THROWS(napi_create_arraybuffer(env, carrier->cnt * sizeof(uint32_t),
+                                             (void**)&ids, &arraybuffer));
+  memcpy(ids, &cursor->msg_ids[carrier->start], carrier->cnt * sizeof(uint32_t));
+  NAPI_STATUS_THROWS(napi_create_typedarray(env, napi_uint32_array, carrier->cnt,
+                                            arraybuffer, 0, &argv[1]));
+
+  // Read the following window in the same direction while this one is shown
+  if (carrier->forward && cursor->end < cursor->cnt) {
+    uint32_t cnt = cursor->cnt - cursor->end;
+    dcn_msg_cursor_prefetch(env, cursor, js_cursor, cursor->end,
+                            cnt < carrier->cnt ? cnt : carrier->cnt);
+  } else if (!carrier->forward && cursor->begin > 0) {
+    uint32_t cnt = cursor->begin < carrier->cnt ? cursor->begin : carrier->cnt;
+    dcn_msg_cursor_prefetch(env, cursor, js_cursor, cursor->begin - cnt, cnt);
+  }
+
+  NAPI_ASYNC_CALL_AND_DELETE_CB()
+}
+
+/**
+ * Hands out the next window right away, so calls made before the
+ * previous one completed still get consecutive windows
+ */
+static napi_value dcn_msg_cursor_queue_window(napi_env env, napi_value js_cursor,
+                                              int forward, uint32_t n,
+                                              napi_value cb) {
+  dcn_msg_cursor_t* cursor;
+  NAPI_STATUS_THROWS(napi_get_value_external(env, js_cursor, (void**)&cursor));
+  dcn_context_t* dcn_context = cursor->dcn_context;
+
+  NAPI_ASYNC_NEW_CARRIER(dcn_msg_cursor_window)
+  carrier->cursor = cursor;
+  carrier->forward = forward;
+  if (forward) {
+    uint32_t cnt = cursor->cnt - cursor->end;
+    carrier->start = cursor->end;
+    carrier->cnt = cnt < n ? cnt : n;
+  } else {
+    carrier->cnt = cursor->begin < n ? cursor->begin : n;
+    carrier->start = cursor->begin - carrier->cnt;
+  }
+  cursor->begin = carrier->start;
+  cursor->end = carrier->start + carrier->cnt;
+  NAPI_STATUS_THROWS(napi_create_reference(env, js_cursor, 1, &carrier->cursor_ref));
+
+  NAPI_ASYNC_QUEUE_WORK(dcn_msg_cursor_window, cb, NULL);
+  NAPI_ASYNC_RETURN();
+}
+
+NAPI_METHOD(dcn_msg_cursor_get_cnt) {
+  NAPI_ARGV(1);
+  NAPI_DCN_MSG_CURSOR();
+
+  NAPI_RETURN_UINT32(cursor->cnt);
+}
+
+NAPI_METHOD(dcn_msg_cursor_next) {
+  NAPI_ARGV(3);
+  NAPI_ARGV_UINT32(n, 1);
+
+  return dcn_msg_cursor_queue_window(env, argv[0], 1, n, argv[2]);
+}
+
+NAPI_METHOD(dcn_msg_cursor_prev) {
+  NAPI_ARGV(3);
+  NAPI_ARGV_UINT32(n, 1);
+
+  return dcn_msg_cursor_queue_window(env, argv[0], 0, n, argv[2]);
+}
+
+NAPI_METHOD(dcn_msg_cursor_seek) {
+  NAPI_ARGV(2);
+  NAPI_DCN_MSG_CURSOR();
+  NAPI_ARGV_UINT32(msg_id, 1);
+
+  // Newest messages are at the end and the most likely to be looked for
+  for (uint32_t i = cursor->cnt; i > 0; i--) {
+    if (cursor->msg_ids[i - 1] == msg_id) {
+      cursor->begin = cursor->end = i - 1;
+      NAPI_RETURN_INT32(i - 1);
+    }
+  }
+
+  NAPI_RETURN_INT32(-1);
+}
+
+/**
+ * strtable_t
+ */
+
+NAPI_METHOD(dcn_strtable_clear) {
+  NAPI_ARGV(1);
+  NAPI_DCN_STRTABLE();
+
+  strtable_clear(strtable);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
+NAPI_METHOD(dcn_strtable_get_str) {
+  NAPI_ARGV(2);
+  NAPI_DCN_STRTABLE();
+  NAPI_ARGV_UINT32(index, 1);
+
+  char* str = strtable_get_str(strtable, index);
+
+  NAPI_RETURN_AND_FREE_STRING(str);
+}
+
+NAPI_METHOD(dcn_strtable_load) {
+  NAPI_ARGV(2);
+  NAPI_DCN_STRTABLE();
+
+  return js_array_to_strtable(env, strtable, argv[1], 0);
+}
+
+NAPI_METHOD(dcn_strtable_merge) {
+  NAPI_ARGV(2);
+  NAPI_DCN_STRTABLE();
+
+  return js_array_to_strtable(env, strtable, argv[1], 1);
+}
+
+NAPI_METHOD(dcn_strtable_load_file) {
+  NAPI_ARGV(2);
+  NAPI_DCN_STRTABLE();
+  NAPI_ARGV_UTF8_MALLOC(path, 1);
+
+  int result = strtable_load_file(strtable, path);
+
+  free(path);
+
+  NAPI_RETURN_INT32(result);
+}
+
+NAPI_METHOD(dcn_strtable_new) {
+  strtable_t* strtable = strtable_new();
+
+  napi_value result;
+  NAPI_STATUS_THROWS(napi_create_external(env, strtable,
+                                          finalize_strtable,
+                                          NULL, &result));
+  return result;
+}
+
+NAPI_METHOD(dcn_strtable_set_str) {
+  NAPI_ARGV(3);
+  NAPI_DCN_STRTABLE();
+  NAPI_ARGV_UINT32(index, 1);
+  NAPI_ARGV_UTF8_MALLOC(str, 2);
+
+  strtable_set_str(strtable, index, str);
+
+  free(str);
+
+  NAPI_RETURN_UNDEFINED();
+}
+
 NAPI_INIT() {
+  if (work_pool == NULL) {
+    work_pool = workpool_new(WORKPOOL_DEFAULT_THREADS);
+  }
+
+  if (http_cache == NULL) {
+    // Disabled until DeltaChat.configureHttpCache() is called
+    http_cache = httpcache_new(0,
+                               HTTPCACHE_DEFAULT_TTL_MS,
+                               HTTPCACHE_DEFAULT_NEGATIVE_TTL_MS,
+                               NULL);
+  }
+
   /**
    * Main context
    */
@@ -2107,6 +5494,11 @@ NAPI_INIT() {
    * Static functions
    */
 
+  NAPI_EXPORT_FUNCTION(dcn_clear_http_cache);
+  NAPI_EXPORT_FUNCTION(dcn_configure_http_cache);
+  NAPI_EXPORT_FUNCTION(dcn_configure_work_pool);
+  NAPI_EXPORT_FUNCTION(dcn_get_http_cache_stats);
+  NAPI_EXPORT_FUNCTION(dcn_get_work_pool_stats);
   NAPI_EXPORT_FUNCTION(dcn_maybe_valid_addr);
 
   /**
@@ -2114,74 +5506,146 @@ NAPI_INIT() {
    */
 
   NAPI_EXPORT_FUNCTION(dcn_add_address_book);
+  NAPI_EXPORT_FUNCTION(dcn_add_address_book_async);
   NAPI_EXPORT_FUNCTION(dcn_add_contact_to_chat);
+  NAPI_EXPORT_FUNCTION(dcn_add_contact_to_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_archive_chat);
+  NAPI_EXPORT_FUNCTION(dcn_archive_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_block_contact);
+  NAPI_EXPORT_FUNCTION(dcn_block_contact_async);
+  NAPI_EXPORT_FUNCTION(dcn_chat_msgs_cursor_async);
+  NAPI_EXPORT_FUNCTION(dcn_chatlist_snapshot);
   NAPI_EXPORT_FUNCTION(dcn_check_password);
+  NAPI_EXPORT_FUNCTION(dcn_check_password_async);
   NAPI_EXPORT_FUNCTION(dcn_check_qr);
+  NAPI_EXPORT_FUNCTION(dcn_check_qr_async);
   NAPI_EXPORT_FUNCTION(dcn_clear_string_table);
   NAPI_EXPORT_FUNCTION(dcn_close);
   NAPI_EXPORT_FUNCTION(dcn_configure);
   NAPI_EXPORT_FUNCTION(dcn_continue_key_transfer);
   NAPI_EXPORT_FUNCTION(dcn_create_chat_by_contact_id);
+  NAPI_EXPORT_FUNCTION(dcn_create_chat_by_contact_id_async);
   NAPI_EXPORT_FUNCTION(dcn_create_chat_by_msg_id);
+  NAPI_EXPORT_FUNCTION(dcn_create_chat_by_msg_id_async);
   NAPI_EXPORT_FUNCTION(dcn_create_contact);
+  NAPI_EXPORT_FUNCTION(dcn_create_contact_async);
   NAPI_EXPORT_FUNCTION(dcn_create_group_chat);
+  NAPI_EXPORT_FUNCTION(dcn_create_group_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_delete_chat);
+  NAPI_EXPORT_FUNCTION(dcn_delete_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_delete_contact);
+  NAPI_EXPORT_FUNCTION(dcn_delete_contact_async);
   NAPI_EXPORT_FUNCTION(dcn_delete_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_delete_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_forward_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_forward_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_get_blobdir);
   NAPI_EXPORT_FUNCTION(dcn_get_blocked_cnt);
+  NAPI_EXPORT_FUNCTION(dcn_get_blocked_cnt_async);
   NAPI_EXPORT_FUNCTION(dcn_get_blocked_contacts);
+  NAPI_EXPORT_FUNCTION(dcn_get_blocked_contacts_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chat);
+  NAPI_EXPORT_FUNCTION(dcn_get_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chat_contacts);
+  NAPI_EXPORT_FUNCTION(dcn_get_chat_contacts_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chat_id_by_contact_id);
+  NAPI_EXPORT_FUNCTION(dcn_get_chat_id_by_contact_id_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chat_media);
+  NAPI_EXPORT_FUNCTION(dcn_get_chat_media_async);
   NAPI_EXPORT_FUNCTION(dcn_get_mime_headers);
+  NAPI_EXPORT_FUNCTION(dcn_get_mime_headers_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chat_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_get_chat_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_get_chatlist);
+  NAPI_EXPORT_FUNCTION(dcn_get_chatlist_async);
+  NAPI_EXPORT_FUNCTION(dcn_get_chats_info);
+  NAPI_EXPORT_FUNCTION(dcn_get_chats_info_async);
   NAPI_EXPORT_FUNCTION(dcn_get_config);
+  NAPI_EXPORT_FUNCTION(dcn_get_config_async);
   NAPI_EXPORT_FUNCTION(dcn_get_contact);
+  NAPI_EXPORT_FUNCTION(dcn_get_contact_async);
   NAPI_EXPORT_FUNCTION(dcn_get_contact_encrinfo);
+  NAPI_EXPORT_FUNCTION(dcn_get_contact_encrinfo_async);
   NAPI_EXPORT_FUNCTION(dcn_get_contacts);
+  NAPI_EXPORT_FUNCTION(dcn_get_contacts_async);
+  NAPI_EXPORT_FUNCTION(dcn_get_contacts_info);
+  NAPI_EXPORT_FUNCTION(dcn_get_contacts_info_async);
   NAPI_EXPORT_FUNCTION(dcn_get_draft);
+  NAPI_EXPORT_FUNCTION(dcn_get_draft_async);
+  NAPI_EXPORT_FUNCTION(dcn_get_event_queue_stats);
+  NAPI_EXPORT_FUNCTION(dcn_get_event_stats);
   NAPI_EXPORT_FUNCTION(dcn_get_fresh_msg_cnt);
+  NAPI_EXPORT_FUNCTION(dcn_get_fresh_msg_cnt_async);
   NAPI_EXPORT_FUNCTION(dcn_get_fresh_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_get_fresh_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_get_info);
+  NAPI_EXPORT_FUNCTION(dcn_get_info_async);
   NAPI_EXPORT_FUNCTION(dcn_get_msg);
+  NAPI_EXPORT_FUNCTION(dcn_get_msg_async);
   NAPI_EXPORT_FUNCTION(dcn_get_msg_cnt);
+  NAPI_EXPORT_FUNCTION(dcn_get_msg_cnt_async);
   NAPI_EXPORT_FUNCTION(dcn_get_msg_info);
+  NAPI_EXPORT_FUNCTION(dcn_get_msg_info_async);
+  NAPI_EXPORT_FUNCTION(dcn_get_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_get_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_get_next_media);
+  NAPI_EXPORT_FUNCTION(dcn_get_next_media_async);
   NAPI_EXPORT_FUNCTION(dcn_get_securejoin_qr);
+  NAPI_EXPORT_FUNCTION(dcn_get_securejoin_qr_async);
   NAPI_EXPORT_FUNCTION(dcn_imex);
+  NAPI_EXPORT_FUNCTION(dcn_imex_async);
   NAPI_EXPORT_FUNCTION(dcn_imex_has_backup);
+  NAPI_EXPORT_FUNCTION(dcn_imex_has_backup_async);
   NAPI_EXPORT_FUNCTION(dcn_initiate_key_transfer);
   NAPI_EXPORT_FUNCTION(dcn_is_configured);
+  NAPI_EXPORT_FUNCTION(dcn_is_configured_async);
   NAPI_EXPORT_FUNCTION(dcn_is_contact_in_chat);
+  NAPI_EXPORT_FUNCTION(dcn_is_contact_in_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_is_open);
   NAPI_EXPORT_FUNCTION(dcn_join_securejoin);
+  NAPI_EXPORT_FUNCTION(dcn_join_securejoin_async);
+  NAPI_EXPORT_FUNCTION(dcn_load_string_table);
+  NAPI_EXPORT_FUNCTION(dcn_load_string_table_file);
   NAPI_EXPORT_FUNCTION(dcn_lookup_contact_id_by_addr);
+  NAPI_EXPORT_FUNCTION(dcn_lookup_contact_id_by_addr_async);
   NAPI_EXPORT_FUNCTION(dcn_marknoticed_chat);
+  NAPI_EXPORT_FUNCTION(dcn_marknoticed_chat_async);
   NAPI_EXPORT_FUNCTION(dcn_marknoticed_all_chats);
+  NAPI_EXPORT_FUNCTION(dcn_marknoticed_all_chats_async);
   NAPI_EXPORT_FUNCTION(dcn_marknoticed_contact);
+  NAPI_EXPORT_FUNCTION(dcn_marknoticed_contact_async);
   NAPI_EXPORT_FUNCTION(dcn_markseen_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_markseen_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_maybe_network);
+  NAPI_EXPORT_FUNCTION(dcn_merge_string_table);
   NAPI_EXPORT_FUNCTION(dcn_msg_new);
   NAPI_EXPORT_FUNCTION(dcn_open);
   NAPI_EXPORT_FUNCTION(dcn_poll_event);
+  NAPI_EXPORT_FUNCTION(dcn_poll_events);
   NAPI_EXPORT_FUNCTION(dcn_remove_contact_from_chat);
+  NAPI_EXPORT_FUNCTION(dcn_remove_contact_from_chat_async);
+  NAPI_EXPORT_FUNCTION(dcn_replay_event_journal);
   NAPI_EXPORT_FUNCTION(dcn_search_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_search_msgs_async);
   NAPI_EXPORT_FUNCTION(dcn_send_msg);
   NAPI_EXPORT_FUNCTION(dcn_set_chat_name);
+  NAPI_EXPORT_FUNCTION(dcn_set_chat_name_async);
   NAPI_EXPORT_FUNCTION(dcn_set_chat_profile_image);
+  NAPI_EXPORT_FUNCTION(dcn_set_chat_profile_image_async);
   NAPI_EXPORT_FUNCTION(dcn_set_config);
+  NAPI_EXPORT_FUNCTION(dcn_set_config_async);
   NAPI_EXPORT_FUNCTION(dcn_set_draft);
   NAPI_EXPORT_FUNCTION(dcn_set_event_handler);
+  NAPI_EXPORT_FUNCTION(dcn_set_event_mask);
   NAPI_EXPORT_FUNCTION(dcn_set_http_get_response);
+  NAPI_EXPORT_FUNCTION(dcn_set_shared_string_table);
   NAPI_EXPORT_FUNCTION(dcn_set_string_table);
   NAPI_EXPORT_FUNCTION(dcn_star_msgs);
+  NAPI_EXPORT_FUNCTION(dcn_star_msgs_async);
+  NAPI_EXPORT_FUNCTION(dcn_start_event_journal);
   NAPI_EXPORT_FUNCTION(dcn_start_threads);
+  NAPI_EXPORT_FUNCTION(dcn_stop_event_journal);
+  NAPI_EXPORT_FUNCTION(dcn_stop_event_replay);
   NAPI_EXPORT_FUNCTION(dcn_stop_threads);
   NAPI_EXPORT_FUNCTION(dcn_stop_ongoing_process);
   NAPI_EXPORT_FUNCTION(dcn_unset_event_handler);
@@ -2272,4 +5736,25 @@ NAPI_INIT() {
   NAPI_EXPORT_FUNCTION(dcn_msg_set_duration);
   NAPI_EXPORT_FUNCTION(dcn_msg_set_file);
   NAPI_EXPORT_FUNCTION(dcn_msg_set_text);
+
+  /**
+   * dcn_msg_cursor_t
+   */
+
+  NAPI_EXPORT_FUNCTION(dcn_msg_cursor_get_cnt);
+  NAPI_EXPORT_FUNCTION(dcn_msg_cursor_next);
+  NAPI_EXPORT_FUNCTION(dcn_msg_cursor_prev);
+  NAPI_EXPORT_FUNCTION(dcn_msg_cursor_seek);
+
+  /**
+   * strtable_t
+   */
+
+  NAPI_EXPORT_FUNCTION(dcn_strtable_clear);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_get_str);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_load);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_load_file);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_merge);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_new);
+  NAPI_EXPORT_FUNCTION(dcn_strtable_set_str);
 }
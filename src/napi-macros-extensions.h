@@ -24,6 +24,14 @@
   dc_msg_t* dc_msg; \
   NAPI_STATUS_THROWS(napi_get_value_external(env, argv[0], (void**)&dc_msg));
 
+#define NAPI_DCN_MSG_CURSOR() \
+  dcn_msg_cursor_t* cursor; \
+  NAPI_STATUS_THROWS(napi_get_value_external(env, argv[0], (void**)&cursor));
+
+#define NAPI_DCN_STRTABLE() \
+  strtable_t* strtable; \
+  NAPI_STATUS_THROWS(napi_get_value_external(env, argv[0], (void**)&strtable));
+
 #define NAPI_RETURN_UNDEFINED() \
   return 0;
 
@@ -42,10 +50,43 @@
   free(name); \
   return return_value;
 
+#define NAPI_SET_INT32(object, name, value) { \
+  napi_value set_value; \
+  NAPI_STATUS_THROWS(napi_create_int32(env, value, &set_value)); \
+  NAPI_STATUS_THROWS(napi_set_named_property(env, object, name, set_value)); \
+}
+
+#define NAPI_SET_UINT32(object, name, value) { \
+  napi_value set_value; \
+  NAPI_STATUS_THROWS(napi_create_uint32(env, value, &set_value)); \
+  NAPI_STATUS_THROWS(napi_set_named_property(env, object, name, set_value)); \
+}
+
+#define NAPI_SET_BOOL(object, name, value) { \
+  napi_value set_value; \
+  NAPI_STATUS_THROWS(napi_get_boolean(env, (value) != 0, &set_value)); \
+  NAPI_STATUS_THROWS(napi_set_named_property(env, object, name, set_value)); \
+}
+
+#define NAPI_SET_STRING(object, name, value) { \
+  napi_value set_value; \
+  if ((value) == NULL) { \
+    NAPI_STATUS_THROWS(napi_get_null(env, &set_value)); \
+  } else { \
+    NAPI_STATUS_THROWS(napi_create_string_utf8(env, value, NAPI_AUTO_LENGTH, &set_value)); \
+  } \
+  NAPI_STATUS_THROWS(napi_set_named_property(env, object, name, set_value)); \
+}
+
+/**
+ * Async work is settled either through a callback or, when the binding
+ * was called without one, through the promise it returned
+ */
 #define NAPI_ASYNC_CARRIER_BEGIN(name) \
   typedef struct name##_carrier_t { \
     napi_ref callback_ref; \
-    napi_async_work async_work; \
+    napi_deferred deferred; \
+    dcn_work_t work; \
     dcn_context_t* dcn_context;
 
 #define NAPI_ASYNC_CARRIER_END(name) \
@@ -57,30 +98,162 @@
 #define NAPI_ASYNC_GET_CARRIER(name) \
   name##_carrier_t* carrier = (name##_carrier_t*)data;
 
+/**
+ * The body converts the results and settles with one of the
+ * NAPI_ASYNC_CALL_*() macros. However it returns, the callback or promise
+ * gets the pending exception if it wasn't settled and name##_free() is
+ * called to free the carrier, it has to be defined before.
+ */
 #define NAPI_ASYNC_COMPLETE(name) \
-  static void name##_complete(napi_env env, napi_status status, void* data)
+  static void name##_settle(napi_env env, napi_status status, name##_carrier_t* carrier); \
+  static void name##_complete(napi_env env, napi_status status, void* data) { \
+    name##_carrier_t* carrier = (name##_carrier_t*)data; \
+    name##_settle(env, status, carrier); \
+    NAPI_ASYNC_SETTLE_PENDING(); \
+    name##_free(env, carrier); \
+  } \
+  static void name##_settle(napi_env env, napi_status status, name##_carrier_t* carrier)
 
-#define NAPI_ASYNC_CALL_AND_DELETE_CB() \
+#define NAPI_ASYNC_CHECK_STATUS() \
+  if (status != napi_ok) { \
+    napi_throw_error(env, NULL, "Execute callback failed."); \
+    return; \
+  }
+
+/**
+ * Rejects the promise or calls the callback with the pending exception
+ * as only argument, unless the work was settled already. Errors are
+ * ignored, the carrier is freed after this in any case.
+ */
+#define NAPI_ASYNC_SETTLE_PENDING() \
+  if (carrier->deferred || carrier->callback_ref) { \
+    napi_value pending = NULL; \
+    bool is_pending = false; \
+    napi_is_exception_pending(env, &is_pending); \
+    if (is_pending) { \
+      napi_get_and_clear_last_exception(env, &pending); \
+    } else { \
+      napi_value pending_message; \
+      napi_create_string_utf8(env, "Completing the work failed.", \
+                              NAPI_AUTO_LENGTH, &pending_message); \
+      napi_create_error(env, NULL, pending_message, &pending); \
+    } \
+    if (carrier->deferred) { \
+      napi_reject_deferred(env, carrier->deferred, pending); \
+      carrier->deferred = NULL; \
+    } else { \
+      napi_value global; \
+      napi_value callback; \
+      napi_get_global(env, &global); \
+      napi_get_reference_value(env, carrier->callback_ref, &callback); \
+      napi_delete_reference(env, carrier->callback_ref); \
+      carrier->callback_ref = NULL; \
+      napi_call_function(env, global, callback, 1, &pending, NULL); \
+    } \
+  }
+
+/**
+ * The reference is gone before the callback runs, so an exception
+ * thrown by it is not taken as a failure to settle
+ */
+#define NAPI_ASYNC_CALL_CB() { \
   napi_value global; \
   NAPI_STATUS_THROWS(napi_get_global(env, &global)); \
   napi_value callback; \
   NAPI_STATUS_THROWS(napi_get_reference_value(env, carrier->callback_ref, &callback)); \
-  NAPI_STATUS_THROWS(napi_call_function(env, global, callback, argc, argv, NULL)); \
   NAPI_STATUS_THROWS(napi_delete_reference(env, carrier->callback_ref)); \
-  NAPI_STATUS_THROWS(napi_delete_async_work(env, carrier->async_work));
+  carrier->callback_ref = NULL; \
+  NAPI_STATUS_THROWS(napi_call_function(env, global, callback, argc, argv, NULL)); \
+}
+
+#define NAPI_ASYNC_RESOLVE(value) { \
+  napi_deferred deferred = carrier->deferred; \
+  carrier->deferred = NULL; \
+  NAPI_STATUS_THROWS(napi_resolve_deferred(env, deferred, value)); \
+}
+
+#define NAPI_ASYNC_REJECT(value) { \
+  napi_deferred deferred = carrier->deferred; \
+  carrier->deferred = NULL; \
+  NAPI_STATUS_THROWS(napi_reject_deferred(env, deferred, value)); \
+}
+
+/**
+ * Calls back with argv. A promise is resolved with argv[0], or with an
+ * array of all of argv if there is more than one result.
+ */
+#define NAPI_ASYNC_CALL_AND_DELETE_CB() \
+  if (carrier->deferred) { \
+    napi_value resolution; \
+    if (argc > 1) { \
+      NAPI_STATUS_THROWS(napi_create_array_with_length(env, argc, &resolution)); \
+      for (int arg = 0; arg < argc; arg++) { \
+        NAPI_STATUS_THROWS(napi_set_element(env, resolution, arg, argv[arg])); \
+      } \
+    } else if (argc > 0) { \
+      resolution = argv[0]; \
+    } else { \
+      NAPI_STATUS_THROWS(napi_get_undefined(env, &resolution)); \
+    } \
+    NAPI_ASYNC_RESOLVE(resolution) \
+  } else { \
+    NAPI_ASYNC_CALL_CB() \
+  }
+
+/**
+ * Like NAPI_ASYNC_CALL_AND_DELETE_CB() for node style (error, result)
+ * arguments, a promise is rejected with argv[0] unless it is null and
+ * resolved with argv[1] otherwise
+ */
+#define NAPI_ASYNC_CALL_ERRBACK_AND_DELETE_CB() \
+  if (carrier->deferred) { \
+    napi_valuetype error_type; \
+    NAPI_STATUS_THROWS(napi_typeof(env, argv[0], &error_type)); \
+    if (error_type != napi_null) { \
+      NAPI_ASYNC_REJECT(argv[0]) \
+    } else { \
+      napi_value resolution; \
+      if (argc > 1) { \
+        resolution = argv[1]; \
+      } else { \
+        NAPI_STATUS_THROWS(napi_get_undefined(env, &resolution)); \
+      } \
+      NAPI_ASYNC_RESOLVE(resolution) \
+    } \
+  } else { \
+    NAPI_ASYNC_CALL_CB() \
+  }
 
 #define NAPI_ASYNC_NEW_CARRIER(name) \
   name##_carrier_t* carrier = calloc(1, sizeof(name##_carrier_t)); \
   carrier->dcn_context = dcn_context;
 
-#define NAPI_ASYNC_QUEUE_WORK(name, cb) \
+/**
+ * Queues the work on work_pool with cb as callback, or returns a promise
+ * from NAPI_ASYNC_RETURN() if cb is not a function. A number as prio
+ * overrides carrier->work.priority, prio may also be NULL.
+ */
+#define NAPI_ASYNC_QUEUE_WORK(name, cb, prio) \
   napi_value callback = cb; \
-  napi_value async_resource_name; \
-  NAPI_STATUS_THROWS(napi_create_reference(env, callback, 1, &carrier->callback_ref)); \
-  NAPI_STATUS_THROWS(napi_create_string_utf8(env, #name "_callback", \
-                                             NAPI_AUTO_LENGTH, \
-                                             &async_resource_name)); \
-  NAPI_STATUS_THROWS(napi_create_async_work(env, callback, async_resource_name, \
-                                            name##_execute, name##_complete, \
-                                            carrier, &carrier->async_work)); \
-  NAPI_STATUS_THROWS(napi_queue_async_work(env, carrier->async_work));
+  napi_value priority_value = prio; \
+  napi_value async_result; \
+  napi_valuetype callback_type; \
+  napi_valuetype priority_type = napi_undefined; \
+  if (priority_value != NULL) { \
+    NAPI_STATUS_THROWS(napi_typeof(env, priority_value, &priority_type)); \
+  } \
+  if (priority_type == napi_number) { \
+    NAPI_STATUS_THROWS(napi_get_value_int32(env, priority_value, &carrier->work.priority)); \
+  } \
+  NAPI_STATUS_THROWS(napi_typeof(env, callback, &callback_type)); \
+  if (callback_type == napi_function) { \
+    NAPI_STATUS_THROWS(napi_create_reference(env, callback, 1, &carrier->callback_ref)); \
+    NAPI_STATUS_THROWS(napi_get_undefined(env, &async_result)); \
+  } else { \
+    NAPI_STATUS_THROWS(napi_create_promise(env, &carrier->deferred, &async_result)); \
+  } \
+  dcn_work_queue(carrier->dcn_context, &carrier->work, \
+                 name##_execute, name##_complete, carrier);
+
+#define NAPI_ASYNC_RETURN() \
+  return async_result;
@@ -0,0 +1,241 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "strpool.h"
+
+
+/*
+ * The strpool hands out copies of event strings from size-classed slabs, so
+ * that the strings of a busy event queue are recycled instead of going
+ * through malloc() and free() on different threads all the time. Every
+ * string is preceded by a header telling its size class; strings that do not
+ * fit into the largest class are allocated with malloc() directly.
+ *
+ * Slabs are only released when the strpool is released, the memory held is
+ * bounded by the number of strings pending at the same time, which in turn
+ * is bounded by the capacity of the event queue.
+ */
+
+
+#define STRPOOL_CLASSES      6        // 32, 64, 128, 256, 512, 1024 bytes incl. header
+#define STRPOOL_MIN_SHIFT    5
+#define STRPOOL_SLAB_BLOCKS  64
+#define STRPOOL_LARGE        -1
+
+
+typedef union strpool_header_t {
+	int                         size_class;
+	union strpool_header_t*     next;      // while on a free list
+} strpool_header_t;
+
+
+typedef struct strpool_slab_t {
+	struct strpool_slab_t*      next;
+} strpool_slab_t;
+
+
+typedef struct strpool_class_t {
+	pthread_mutex_t             mutex;
+	strpool_header_t*           free;      // blocks given back by strpool_free()
+	char*                       fresh;     // blocks of the newest slab never handed out
+	int                         fresh_cnt;
+	strpool_slab_t*             slabs;
+} strpool_class_t;
+
+
+typedef struct strpool_t {
+	strpool_class_t             classes[STRPOOL_CLASSES];
+
+	atomic_uint_least64_t       allocs;
+	atomic_uint_least64_t       reused;
+	atomic_uint_least64_t       mallocs;
+	atomic_uint_least64_t       bytes;
+} strpool_t;
+
+
+static size_t class_size(int size_class)
+{
+	return (size_t)1 << (size_class+STRPOOL_MIN_SHIFT);
+}
+
+
+strpool_t* strpool_new()
+{
+	strpool_t* strpool = calloc(1, sizeof(strpool_t));
+	if (strpool==NULL) {
+		exit(666);
+	}
+
+	for (int i=0; i<STRPOOL_CLASSES; i++) {
+		pthread_mutex_init(&strpool->classes[i].mutex, NULL);
+	}
+
+	atomic_init(&strpool->allocs, 0);
+	atomic_init(&strpool->reused, 0);
+	atomic_init(&strpool->mallocs, 0);
+	atomic_init(&strpool->bytes, 0);
+
+	return strpool;
+}
+
+
+/**
+ * Release the strpool and all its slabs. All strings handed out by the
+ * strpool become invalid.
+ */
+void strpool_unref(strpool_t* strpool)
+{
+	if (strpool==NULL) {
+		return;
+	}
+
+	for (int i=0; i<STRPOOL_CLASSES; i++) {
+		strpool_slab_t* slab = strpool->classes[i].slabs;
+		while (slab) {
+			strpool_slab_t* next = slab->next;
+			free(slab);
+			slab = next;
+		}
+		pthread_mutex_destroy(&strpool->classes[i].mutex);
+	}
+
+	free(strpool);
+}
+
+
+/* Get a block of the given class, must be called with the class mutex held */
+static strpool_header_t* class_alloc(strpool_t* strpool, int size_class)
+{
+	strpool_class_t*  cls = &strpool->classes[size_class];
+	strpool_header_t* block = cls->free;
+
+	if (block) {
+		cls->free = block->next;
+		atomic_fetch_add_explicit(&strpool->reused, 1, memory_order_relaxed);
+		return block;
+	}
+
+	size_t size = class_size(size_class);
+	if (cls->fresh_cnt==0) {
+		strpool_slab_t* slab = malloc(sizeof(strpool_slab_t) + size*STRPOOL_SLAB_BLOCKS);
+		if (slab==NULL) {
+			exit(666);
+		}
+		slab->next = cls->slabs;
+		cls->slabs = slab;
+		cls->fresh = (char*)(slab+1);
+		cls->fresh_cnt = STRPOOL_SLAB_BLOCKS;
+		atomic_fetch_add_explicit(&strpool->mallocs, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&strpool->bytes, size*STRPOOL_SLAB_BLOCKS, memory_order_relaxed);
+	}
+
+	// blocks never used before are not counted as reused
+	block = (strpool_header_t*)cls->fresh;
+	cls->fresh += size;
+	cls->fresh_cnt--;
+	return block;
+}
+
+
+/**
+ * Copy a string into the strpool. May be called from any thread.
+ * The copy must be released using strpool_free().
+ */
+char* strpool_strdup(strpool_t* strpool, const char* str)
+{
+	if (str==NULL) {
+		return NULL;
+	}
+
+	size_t            len = strlen(str)+1;
+	size_t            needed = sizeof(strpool_header_t)+len;
+	strpool_header_t* block = NULL;
+	int               size_class = 0;
+
+	atomic_fetch_add_explicit(&strpool->allocs, 1, memory_order_relaxed);
+
+	while (size_class<STRPOOL_CLASSES && class_size(size_class)<needed) {
+		size_class++;
+	}
+
+	if (size_class==STRPOOL_CLASSES) {
+		block = malloc(needed);
+		if (block==NULL) {
+			exit(666);
+		}
+		atomic_fetch_add_explicit(&strpool->mallocs, 1, memory_order_relaxed);
+		block->size_class = STRPOOL_LARGE;
+	}
+	else {
+		pthread_mutex_lock(&strpool->classes[size_class].mutex);
+			block = class_alloc(strpool, size_class);
+		pthread_mutex_unlock(&strpool->classes[size_class].mutex);
+		block->size_class = size_class;
+	}
+
+	char* copy = (char*)(block+1);
+	memcpy(copy, str, len);
+	return copy;
+}
+
+
+/**
+ * Give a string returned by strpool_strdup() back to the strpool.
+ * May be called from any thread.
+ */
+void strpool_free(strpool_t* strpool, char* str)
+{
+	if (str==NULL) {
+		return;
+	}
+
+	strpool_header_t* block = ((strpool_header_t*)str)-1;
+	int               size_class = block->size_class;
+
+	if (size_class==STRPOOL_LARGE) {
+		free(block);
+		return;
+	}
+
+	strpool_class_t* cls = &strpool->classes[size_class];
+	pthread_mutex_lock(&cls->mutex);
+		block->next = cls->free;
+		cls->free = block;
+	pthread_mutex_unlock(&cls->mutex);
+}
+
+
+void strpool_get_stats(strpool_t* strpool, strpool_stats_t* stats)
+{
+	memset(stats, 0, sizeof(strpool_stats_t));
+	if (strpool==NULL) {
+		return;
+	}
+
+	stats->allocs  = atomic_load_explicit(&strpool->allocs, memory_order_relaxed);
+	stats->reused  = atomic_load_explicit(&strpool->reused, memory_order_relaxed);
+	stats->mallocs = atomic_load_explicit(&strpool->mallocs, memory_order_relaxed);
+	stats->bytes   = atomic_load_explicit(&strpool->bytes, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#ifndef __STRPOOL_H__
+#define __STRPOOL_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+
+
+typedef struct strpool_t strpool_t;
+
+typedef struct strpool_stats_t {
+	uint64_t allocs;   // strings handed out by strpool_strdup()
+	uint64_t reused;   // ... thereof blocks given back by strpool_free() before
+	uint64_t mallocs;  // calls to malloc(), for slabs and oversized strings
+	uint64_t bytes;    // bytes currently held in slabs
+} strpool_stats_t;
+
+strpool_t*          strpool_new         ();
+void                strpool_unref       (strpool_t*);
+
+char*               strpool_strdup      (strpool_t*, const char*);
+void                strpool_free        (strpool_t*, char*);
+
+void                strpool_get_stats   (strpool_t*, strpool_stats_t*);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __STRPOOL_H__ */
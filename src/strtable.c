@@ -22,17 +22,130 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "strtable.h"
 #include <deltachat.h>
 
 
-typedef struct strtable_t {
-	pthread_mutex_t mutex;
+/*
+ * Core asks for strings with DC_EVENT_GET_STRING all the time, so reading
+ * must not wait for a lock. The strings live in an immutable snapshot that
+ * writers replace as a whole.
+ *
+ * A replaced snapshot is freed once no reader can still use it: readers
+ * announce themselves in one of two counters, chosen by the current epoch.
+ * After swapping the snapshot, a writer flips the epoch and waits for the
+ * counter of the previous epoch to drain. Readers arriving later find the
+ * new snapshot.
+ *
+ * A reader may be preempted between reading the epoch and bumping the
+ * counter, a writer may flip the epoch and drain the counter meanwhile.
+ * The reader therefore reads the epoch again after bumping the counter and
+ * starts over if it changed: the counter it stays in is the one of the
+ * epoch current at its first load of the snapshot, which the next writer
+ * waits for before freeing anything. Writers hold the mutex until they
+ * are done waiting, so a later writer cannot free under that reader either.
+ *
+ * Tables are refcounted, so that one table holding a locale can be shared
+ * by many contexts: each context has a table of its own and attaches the
+ * shared one. Strings missing in the own table are looked up in the
+ * attached table, which is replaced the same way as a snapshot.
+ */
+
+
+typedef struct strtable_snapshot_t {
 	char*           str[DC_STR_COUNT];
+	size_t          len[DC_STR_COUNT];
+	char            blob[];   // all strings, NUL-terminated
+} strtable_snapshot_t;
+
+
+typedef struct strtable_t {
+	atomic_int      refcnt;
+	pthread_mutex_t mutex;    // serializes writers only
+	_Atomic(strtable_snapshot_t*) snapshot;
+	_Atomic(struct strtable_t*)   attached;
+	atomic_int      attached_to;  // tables this one is attached to, see strtable_attach()
+	atomic_uint     epoch;
+	atomic_uint     readers[2];
 } strtable_t;
 
 
+static strtable_snapshot_t* snapshot_new(const char* const* strs, const size_t* lens)
+{
+	size_t blob_len = 0;
+	for (int i=0; i<DC_STR_COUNT; i++) {
+		if (strs[i]) {
+			blob_len += lens[i]+1;
+		}
+	}
+
+	strtable_snapshot_t* snapshot = calloc(1, sizeof(strtable_snapshot_t)+blob_len);
+	if (snapshot==NULL) {
+		exit(666);
+	}
+
+	char* p = snapshot->blob;
+	for (int i=0; i<DC_STR_COUNT; i++) {
+		if (strs[i]) {
+			memcpy(p, strs[i], lens[i]);
+			p[lens[i]] = 0;
+			snapshot->str[i] = p;
+			snapshot->len[i] = lens[i];
+			p += lens[i]+1;
+		}
+	}
+
+	return snapshot;
+}
+
+
+/* Must be called with the writer mutex held, after replacing something
+ * readers may hold. */
+static void wait_for_readers(strtable_t* strtable)
+{
+	unsigned int epoch = atomic_fetch_add(&strtable->epoch, 1) & 1;
+	while (atomic_load(&strtable->readers[epoch])) {
+		sched_yield();
+	}
+}
+
+
+/* Announces a reader, returns the counter to pass to read_unlock(). */
+static unsigned int read_lock(strtable_t* strtable)
+{
+	while (1) {
+		unsigned int epoch = atomic_load(&strtable->epoch) & 1;
+		atomic_fetch_add(&strtable->readers[epoch], 1);
+		if ((atomic_load(&strtable->epoch) & 1)==epoch) {
+			return epoch;
+		}
+		atomic_fetch_sub(&strtable->readers[epoch], 1);
+	}
+}
+
+
+static void read_unlock(strtable_t* strtable, unsigned int epoch)
+{
+	atomic_fetch_sub(&strtable->readers[epoch], 1);
+}
+
+
+/* Must be called with the writer mutex held. */
+static void replace_snapshot(strtable_t* strtable, strtable_snapshot_t* snapshot)
+{
+	strtable_snapshot_t* old = atomic_exchange(&strtable->snapshot, snapshot);
+	wait_for_readers(strtable);
+	free(old);
+}
+
+
 strtable_t* strtable_new()
 {
 	strtable_t* strtable = calloc(1, sizeof(strtable_t));
@@ -40,20 +153,39 @@ strtable_t* strtable_new()
 		exit(666);
 	}
 
+	atomic_init(&strtable->refcnt, 1);
 	pthread_mutex_init(&strtable->mutex, NULL);
+	atomic_init(&strtable->snapshot, NULL);
+	atomic_init(&strtable->attached, NULL);
+	atomic_init(&strtable->attached_to, 0);
+	atomic_init(&strtable->epoch, 0);
+	atomic_init(&strtable->readers[0], 0);
+	atomic_init(&strtable->readers[1], 0);
+
+	return strtable;
+}
+
 
+strtable_t* strtable_ref(strtable_t* strtable)
+{
+	if (strtable) {
+		atomic_fetch_add(&strtable->refcnt, 1);
+	}
 	return strtable;
 }
 
 
 void strtable_unref(strtable_t* strtable)
 {
-	if (strtable==NULL) {
+	if (strtable==NULL || atomic_fetch_sub(&strtable->refcnt, 1)!=1) {
 		return;
 	}
 
-	for (int i=0; i<DC_STR_COUNT; i++) {
-		free(strtable->str[i]);
+	free(atomic_load(&strtable->snapshot));
+	strtable_t* attached = atomic_load(&strtable->attached);
+	if (attached) {
+		atomic_fetch_sub(&attached->attached_to, 1);
+		strtable_unref(attached);
 	}
 
 	pthread_mutex_destroy(&strtable->mutex);
@@ -62,6 +194,10 @@ void strtable_unref(strtable_t* strtable)
 }
 
 
+/**
+ * Sets a single string, NULL unsets it. Every call copies the whole table,
+ * use strtable_merge() to set many strings.
+ */
 void strtable_set_str(strtable_t* strtable, int i, const char* str)
 {
 	if (strtable==NULL || i<0 || i>=DC_STR_COUNT) {
@@ -69,12 +205,114 @@ void strtable_set_str(strtable_t* strtable, int i, const char* str)
 	}
 
 	pthread_mutex_lock(&strtable->mutex);
-		free(strtable->str[i]);
-		strtable->str[i] = str? strdup(str) : NULL;
+		// only writers replace the snapshot and they hold the mutex
+		strtable_snapshot_t* current = atomic_load(&strtable->snapshot);
+		const char* strs[DC_STR_COUNT] = { NULL };
+		size_t      lens[DC_STR_COUNT] = { 0 };
+		if (current) {
+			memcpy(strs, current->str, sizeof(strs));
+			memcpy(lens, current->len, sizeof(lens));
+		}
+		strs[i] = str;
+		lens[i] = str? strlen(str) : 0;
+		replace_snapshot(strtable, snapshot_new(strs, lens));
+	pthread_mutex_unlock(&strtable->mutex);
+}
+
+
+/**
+ * Sets the strings `strs[i]` that are not NULL in one go and keeps the
+ * others. Returns the number of strings set.
+ */
+int strtable_merge(strtable_t* strtable, const char* const* strs, int cnt)
+{
+	int merged = 0;
+
+	if (strtable==NULL) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&strtable->mutex);
+		strtable_snapshot_t* current = atomic_load(&strtable->snapshot);
+		const char* all[DC_STR_COUNT] = { NULL };
+		size_t      lens[DC_STR_COUNT] = { 0 };
+		if (current) {
+			memcpy(all, current->str, sizeof(all));
+			memcpy(lens, current->len, sizeof(lens));
+		}
+		for (int i=0; i<cnt && i<DC_STR_COUNT; i++) {
+			if (strs[i]) {
+				all[i] = strs[i];
+				lens[i] = strlen(strs[i]);
+				merged++;
+			}
+		}
+		if (merged) {
+			replace_snapshot(strtable, snapshot_new(all, lens));
+		}
 	pthread_mutex_unlock(&strtable->mutex);
+
+	return merged;
 }
 
 
+/**
+ * Use the strings of `shared` where the table has none of its own. `shared`
+ * is referenced until another table is attached, NULL detaches. Returns 0
+ * if `shared` has an attached table itself or if the table is attached to
+ * another one, only one level is supported.
+ *
+ * Attaching changes `attached` of the table and `attached_to` of `shared`,
+ * both are checked and changed with the mutexes of both tables held, so
+ * that two tables attached at the same time cannot form a chain. The
+ * mutexes are taken in the order of their addresses.
+ */
+int strtable_attach(strtable_t* strtable, strtable_t* shared)
+{
+	if (strtable==NULL || shared==strtable) {
+		return 0;
+	}
+
+	pthread_mutex_t* first = &strtable->mutex;
+	pthread_mutex_t* second = shared? &shared->mutex : NULL;
+	if (second && second < first) {
+		first = second;
+		second = &strtable->mutex;
+	}
+
+	pthread_mutex_lock(first);
+	if (second) {
+		pthread_mutex_lock(second);
+	}
+		int ok = shared==NULL
+		      || (atomic_load(&shared->attached)==NULL && atomic_load(&strtable->attached_to)==0);
+		strtable_t* old = NULL;
+		if (ok) {
+			if (shared) {
+				atomic_fetch_add(&shared->attached_to, 1);
+			}
+			old = atomic_exchange(&strtable->attached, strtable_ref(shared));
+			wait_for_readers(strtable);
+		}
+	if (second) {
+		pthread_mutex_unlock(second);
+	}
+	pthread_mutex_unlock(first);
+
+	if (old) {
+		// only ever too high for a moment, which rejects an attach at worst
+		atomic_fetch_sub(&old->attached_to, 1);
+		strtable_unref(old);
+	}
+	return ok;
+}
+
+
+/**
+ * Returns a copy of a string or NULL if it is not set. Never blocks. The
+ * copy is needed as core takes ownership of the strings it gets for
+ * DC_EVENT_GET_STRING and free()s them.
+ */
 char* strtable_get_str(strtable_t* strtable, int i)
 {
 	char* str = NULL;
@@ -83,9 +321,19 @@ char* strtable_get_str(strtable_t* strtable, int i)
 		return NULL;
 	}
 
-	pthread_mutex_lock(&strtable->mutex);
-		str = strtable->str[i]? strdup(strtable->str[i]) : NULL;
-	pthread_mutex_unlock(&strtable->mutex);
+	unsigned int epoch = read_lock(strtable);
+		strtable_snapshot_t* snapshot = atomic_load(&strtable->snapshot);
+		if (snapshot && snapshot->str[i]) {
+			str = malloc(snapshot->len[i]+1);
+			if (str==NULL) {
+				exit(666);
+			}
+			memcpy(str, snapshot->str[i], snapshot->len[i]+1);
+		}
+		else {
+			str = strtable_get_str(atomic_load(&strtable->attached), i);
+		}
+	read_unlock(strtable, epoch);
 
 	return str;
 }
@@ -93,10 +341,136 @@ char* strtable_get_str(strtable_t* strtable, int i)
 
 void strtable_clear(strtable_t* strtable)
 {
+	if (strtable==NULL) {
+		return;
+	}
+
 	pthread_mutex_lock(&strtable->mutex);
-		for (int i=0; i<DC_STR_COUNT; i++) {
-			free(strtable->str[i]);
-			strtable->str[i] = NULL;
+		replace_snapshot(strtable, NULL);
+	pthread_mutex_unlock(&strtable->mutex);
+}
+
+
+/**
+ * Replace all strings at once. `strs[i]` is the string for index i, NULL
+ * leaves it unset, so core uses its default. Returns the number of strings
+ * set.
+ */
+int strtable_load(strtable_t* strtable, const char* const* strs, int cnt)
+{
+	const char* all[DC_STR_COUNT] = { NULL };
+	size_t      lens[DC_STR_COUNT] = { 0 };
+	int         loaded = 0;
+
+	if (strtable==NULL) {
+		return 0;
+	}
+
+	for (int i=0; i<cnt && i<DC_STR_COUNT; i++) {
+		if (strs[i]) {
+			all[i] = strs[i];
+			lens[i] = strlen(strs[i]);
+			loaded++;
 		}
+	}
+
+	pthread_mutex_lock(&strtable->mutex);
+		replace_snapshot(strtable, snapshot_new(all, lens));
+	pthread_mutex_unlock(&strtable->mutex);
+
+	return loaded;
+}
+
+
+/* Unescapes \n, \t and \\ in place, returns the new length. */
+static size_t unescape(char* str, size_t len)
+{
+	size_t out = 0;
+	for (size_t in=0; in<len; in++) {
+		if (str[in]=='\\' && in+1<len) {
+			in++;
+			str[out++] = str[in]=='n'? '\n' : (str[in]=='t'? '\t' : str[in]);
+		}
+		else {
+			str[out++] = str[in];
+		}
+	}
+	return out;
+}
+
+
+/**
+ * Replace all strings with the ones from a locale file. The file is UTF-8
+ * with one `<index>=<string>` line per string, `#` starts a comment line
+ * and `\n`, `\t` and `\\` are unescaped. Returns the number of strings set
+ * or -1 if the file cannot be read, the table is unchanged then.
+ */
+int strtable_load_file(strtable_t* strtable, const char* path)
+{
+	struct stat st;
+	int         fd = open(path, O_RDONLY);
+	if (fd<0) {
+		return -1;
+	}
+	if (fstat(fd, &st)!=0) {
+		close(fd);
+		return -1;
+	}
+
+	char*  copy = NULL;
+	size_t size = (size_t)st.st_size;
+	if (size) {
+		const char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map==MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		// one copy for all strings, unescaped in place
+		copy = malloc(size);
+		if (copy==NULL) {
+			exit(666);
+		}
+		memcpy(copy, map, size);
+		munmap((void*)map, size);
+	}
+	close(fd);
+
+	const char* strs[DC_STR_COUNT] = { NULL };
+	size_t      lens[DC_STR_COUNT] = { 0 };
+	int         loaded = 0;
+
+	char* line = copy;
+	char* end = copy+size;
+	while (line < end) {
+		char* eol = memchr(line, '\n', end-line);
+		if (eol==NULL) {
+			eol = end;
+		}
+		size_t line_len = eol-line;
+		if (line_len && line[line_len-1]=='\r') {
+			line_len--;
+		}
+
+		char* eq = memchr(line, '=', line_len);
+		if (line_len && line[0]!='#' && eq && eq>line) {
+			char* index_end = NULL;
+			long  index = strtol(line, &index_end, 10);
+			if (index_end==eq && index>=0 && index<DC_STR_COUNT) {
+				if (strs[index]==NULL) {
+					loaded++;
+				}
+				strs[index] = eq+1;
+				lens[index] = unescape(eq+1, line+line_len-(eq+1));
+			}
+		}
+
+		line = eol+1;
+	}
+
+	pthread_mutex_lock(&strtable->mutex);
+		replace_snapshot(strtable, snapshot_new(strs, lens));
 	pthread_mutex_unlock(&strtable->mutex);
+
+	free(copy);
+	return loaded;
 }
@@ -30,12 +30,18 @@ extern "C" {
 typedef struct strtable_t strtable_t;
 
 strtable_t*         strtable_new        ();
+strtable_t*         strtable_ref        (strtable_t*);
 void                strtable_unref      (strtable_t*);
+int                 strtable_attach     (strtable_t*, strtable_t* shared);
 
 void                strtable_set_str    (strtable_t*, int, const char*);
+int                 strtable_merge      (strtable_t*, const char* const* strs, int cnt);
 char*               strtable_get_str    (strtable_t*, int);
 void                strtable_clear      (strtable_t*);
 
+int                 strtable_load       (strtable_t*, const char* const* strs, int cnt);
+int                 strtable_load_file  (strtable_t*, const char* path);
+
 
 #ifdef __cplusplus
 } /* /extern "C" */
@@ -0,0 +1,475 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "workpool.h"
+
+
+/*
+ * A fixed number of threads taking jobs from FIFO queues, so that the work
+ * queued by the bindings does not compete with fs and dns requests on the
+ * libuv threadpool. Threads are started on demand, up to the configured
+ * limit, and stay around once started.
+ *
+ * There is a queue per priority class. A free thread takes the job that
+ * would have been queued first if every class above WORKPOOL_INTERACTIVE
+ * had been pushed `aging_us` later per step, so interactive jobs overtake
+ * background jobs but a background job is never passed over for longer than
+ * that. This also holds within a group, only exclusive jobs order it: the
+ * queued jobs of a group are linked in the order of their sequence numbers,
+ * an exclusive job may only be taken at the head of that list while nothing
+ * else of the group runs, and no job pushed after the oldest queued
+ * exclusive job may be taken before it.
+ *
+ * Everything is guarded by `lock`. `cond` is signalled for idle threads when
+ * a job is pushed, and broadcast when a job of a group ends, as that may
+ * unblock jobs waiting for an exclusive job or for an exclusive turn.
+ */
+
+
+typedef struct workpool_job_t {
+	workpool_group_t*      group;
+	int                    exclusive;
+	uint64_t               seq;            // push order
+	workpool_cb_t          execute;
+	workpool_cb_t          done;
+	void*                  data;
+	int                    priority;
+	uint64_t               queued;         // workpool_now() at push
+	struct workpool_job_t* next;
+	struct workpool_job_t* group_prev;     // the group's queued jobs, oldest first
+	struct workpool_job_t* group_next;
+} workpool_job_t;
+
+
+typedef struct workpool_queue_t {
+	workpool_job_t*   head;
+	workpool_job_t*   tail;
+	size_t            depth;
+	size_t            max_depth;
+	uint64_t          completed;
+	histogram_t*      wait;
+} workpool_queue_t;
+
+
+typedef struct workpool_t {
+	pthread_mutex_t   lock;
+	pthread_cond_t    cond;
+	workpool_queue_t  queues[WORKPOOL_PRIORITIES];
+	uint64_t          aging_us;
+	uint64_t          seq;
+	int               stopping;
+
+	size_t            threads;
+	size_t            started;
+	size_t            idle;
+
+	size_t            depth;
+	size_t            max_depth;
+	size_t            running;
+	uint64_t          completed;
+	histogram_t*      wait;           // microseconds from push until a thread takes the job
+} workpool_t;
+
+
+static uint64_t workpool_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000ULL + (uint64_t)ts.tv_nsec/1000;
+}
+
+
+static int is_runnable(const workpool_job_t* job)
+{
+	const workpool_group_t* group = job->group;
+	if (group==NULL) {
+		return 1;
+	}
+
+	if (group->exclusive_running) {
+		return 0;
+	}
+
+	// an exclusive job waits for the jobs pushed before it
+	if (job->exclusive) {
+		return group->queued_head==job && group->running==0;
+	}
+
+	// other jobs only wait for exclusive jobs pushed before them
+	return group->exclusive_head==NULL || job->seq < group->exclusive_head->seq;
+}
+
+
+/* unlinks a job that is taken from the queued jobs of its group */
+static void group_unlink(workpool_group_t* group, workpool_job_t* job)
+{
+	if (job->group_prev) {
+		job->group_prev->group_next = job->group_next;
+	}
+	else {
+		group->queued_head = job->group_next;
+	}
+	if (job->group_next) {
+		job->group_next->group_prev = job->group_prev;
+	}
+	else {
+		group->queued_tail = job->group_prev;
+	}
+
+	if (group->exclusive_head==job) {
+		workpool_job_t* next = job->group_next;
+		while (next && !next->exclusive) {
+			next = next->group_next;
+		}
+		group->exclusive_head = next;
+	}
+
+	job->group_prev = NULL;
+	job->group_next = NULL;
+}
+
+
+/* the first runnable job of every queue competes, aged by its class */
+static workpool_job_t* take_job(workpool_t* workpool)
+{
+	workpool_queue_t* best_queue = NULL;
+	workpool_job_t*   best = NULL;
+	workpool_job_t*   best_prev = NULL;
+	uint64_t          best_due = 0;
+
+	for (int priority = 0; priority < WORKPOOL_PRIORITIES; priority++)
+	{
+		workpool_queue_t* queue = &workpool->queues[priority];
+		workpool_job_t*   prev = NULL;
+		workpool_job_t*   job = queue->head;
+		while (job && !is_runnable(job)) {
+			prev = job;
+			job = job->next;
+		}
+		if (job==NULL) {
+			continue;
+		}
+
+		// ties go to the higher priority, which comes first
+		uint64_t due = job->queued + (uint64_t)priority*workpool->aging_us;
+		if (best==NULL || due < best_due) {
+			best_queue = queue;
+			best = job;
+			best_prev = prev;
+			best_due = due;
+		}
+	}
+
+	if (best==NULL) {
+		return NULL;
+	}
+
+	if (best_prev) {
+		best_prev->next = best->next;
+	}
+	else {
+		best_queue->head = best->next;
+	}
+	if (best_queue->tail==best) {
+		best_queue->tail = best_prev;
+	}
+	best->next = NULL;
+	best_queue->depth--;
+	workpool->depth--;
+
+	if (best->group) {
+		group_unlink(best->group, best);
+		best->group->running++;
+		if (best->exclusive) {
+			best->group->exclusive_running = 1;
+		}
+	}
+	return best;
+}
+
+
+static void* worker_main(void* arg)
+{
+	workpool_t* workpool = (workpool_t*)arg;
+
+	pthread_mutex_lock(&workpool->lock);
+	workpool->idle--; // counted as idle since start_threads()
+	while (1)
+	{
+		// shrink to a lowered limit
+		if (workpool->started > workpool->threads) {
+			break;
+		}
+
+		workpool_job_t* job = take_job(workpool);
+		if (job==NULL) {
+			if (workpool->stopping && workpool->depth==0) {
+				break;
+			}
+			workpool->idle++;
+			pthread_cond_wait(&workpool->cond, &workpool->lock);
+			workpool->idle--;
+			continue;
+		}
+
+		uint64_t waited = workpool_now() - job->queued;
+		histogram_record(workpool->wait, waited);
+		histogram_record(workpool->queues[job->priority].wait, waited);
+		workpool->running++;
+		pthread_mutex_unlock(&workpool->lock);
+
+		job->execute(job->data);
+		job->done(job->data);
+
+		pthread_mutex_lock(&workpool->lock);
+		workpool->running--;
+		workpool->completed++;
+		workpool->queues[job->priority].completed++;
+		if (job->group) {
+			job->group->running--;
+			if (job->exclusive) {
+				job->group->exclusive_running = 0;
+			}
+			if (workpool->depth) {
+				pthread_cond_broadcast(&workpool->cond);
+			}
+		}
+		free(job);
+	}
+
+	workpool->started--;
+	pthread_cond_broadcast(&workpool->cond);
+	pthread_mutex_unlock(&workpool->lock);
+	return NULL;
+}
+
+
+/* starts threads for the jobs no idle thread can take, called with the lock */
+static void start_threads(workpool_t* workpool)
+{
+	while (workpool->depth > workpool->idle && workpool->started < workpool->threads)
+	{
+		pthread_t      thread;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		int failed = pthread_create(&thread, &attr, worker_main, workpool);
+		pthread_attr_destroy(&attr);
+		if (failed) {
+			// the threads we have will get to the jobs
+			if (workpool->started==0) {
+				exit(666);
+			}
+			return;
+		}
+		workpool->started++;
+		workpool->idle++; // about to take a job, see worker_main()
+	}
+}
+
+
+/*******************************************************************************
+ * Main interface
+ ******************************************************************************/
+
+
+workpool_t* workpool_new(size_t threads)
+{
+	workpool_t* workpool = calloc(1, sizeof(workpool_t));
+	if (workpool==NULL) {
+		exit(666);
+	}
+
+	pthread_mutex_init(&workpool->lock, NULL);
+	pthread_cond_init(&workpool->cond, NULL);
+	workpool->threads = threads? threads : 1;
+	workpool->aging_us = WORKPOOL_DEFAULT_AGING_US;
+	workpool->wait = histogram_new();
+	for (int priority = 0; priority < WORKPOOL_PRIORITIES; priority++) {
+		workpool->queues[priority].wait = histogram_new();
+	}
+
+	return workpool;
+}
+
+
+/**
+ * Runs the jobs that are still queued and waits for the threads to exit.
+ */
+void workpool_unref(workpool_t* workpool)
+{
+	if (workpool==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&workpool->lock);
+	workpool->stopping = 1;
+	pthread_cond_broadcast(&workpool->cond);
+	while (workpool->started > 0) {
+		pthread_cond_wait(&workpool->cond, &workpool->lock);
+	}
+	pthread_mutex_unlock(&workpool->lock);
+
+	pthread_cond_destroy(&workpool->cond);
+	pthread_mutex_destroy(&workpool->lock);
+	histogram_unref(workpool->wait);
+	for (int priority = 0; priority < WORKPOOL_PRIORITIES; priority++) {
+		histogram_unref(workpool->queues[priority].wait);
+	}
+	free(workpool);
+}
+
+
+/**
+ * Changes the number of threads. Threads above a lowered limit exit once
+ * they are done with their current job.
+ */
+void workpool_set_threads(workpool_t* workpool, size_t threads)
+{
+	if (workpool==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&workpool->lock);
+	workpool->threads = threads? threads : 1;
+	pthread_cond_broadcast(&workpool->cond);
+	start_threads(workpool);
+	pthread_mutex_unlock(&workpool->lock);
+}
+
+
+/**
+ * Changes how much longer a job waits for each step its class is below
+ * WORKPOOL_INTERACTIVE before it is taken ahead of the jobs of the classes
+ * above. 0 takes the jobs of all classes in the order they were pushed.
+ */
+void workpool_set_aging(workpool_t* workpool, uint64_t aging_us)
+{
+	if (workpool==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&workpool->lock);
+	workpool->aging_us = aging_us;
+	pthread_mutex_unlock(&workpool->lock);
+}
+
+
+/**
+ * Queues `execute(data)` to run on a thread of the pool. `done(data)` is
+ * called on the same thread right after, it should hand `data` back to the
+ * owner of the job. `flags` may be WORKPOOL_EXCLUSIVE, which only applies to
+ * jobs with a group. An unknown `priority` is taken as WORKPOOL_BACKGROUND.
+ */
+void workpool_push(workpool_t* workpool, workpool_group_t* group, int flags, int priority,
+                   workpool_cb_t execute, workpool_cb_t done, void* data)
+{
+	workpool_job_t* job = calloc(1, sizeof(workpool_job_t));
+	if (job==NULL) {
+		exit(666);
+	}
+	job->group = group;
+	job->exclusive = group && (flags & WORKPOOL_EXCLUSIVE);
+	job->execute = execute;
+	job->done = done;
+	job->data = data;
+	job->priority = (priority >= 0 && priority < WORKPOOL_PRIORITIES)? priority : WORKPOOL_BACKGROUND;
+	job->queued = workpool_now();
+
+	pthread_mutex_lock(&workpool->lock);
+	job->seq = workpool->seq++;
+	workpool_queue_t* queue = &workpool->queues[job->priority];
+	if (queue->tail) {
+		queue->tail->next = job;
+	}
+	else {
+		queue->head = job;
+	}
+	queue->tail = job;
+	queue->depth++;
+	if (queue->depth > queue->max_depth) {
+		queue->max_depth = queue->depth;
+	}
+	workpool->depth++;
+	if (workpool->depth > workpool->max_depth) {
+		workpool->max_depth = workpool->depth;
+	}
+	if (group) {
+		job->group_prev = group->queued_tail;
+		if (group->queued_tail) {
+			group->queued_tail->group_next = job;
+		}
+		else {
+			group->queued_head = job;
+		}
+		group->queued_tail = job;
+		if (job->exclusive && group->exclusive_head==NULL) {
+			group->exclusive_head = job;
+		}
+	}
+
+	start_threads(workpool);
+	pthread_cond_signal(&workpool->cond);
+	pthread_mutex_unlock(&workpool->lock);
+}
+
+
+/**
+ * Copies the counters and, unless `wait` is NULL, the histogram of the
+ * microseconds jobs waited for a thread. `class_wait`, if not NULL, gets
+ * the histograms of the single classes, its NULL entries are skipped.
+ */
+void workpool_get_stats(workpool_t* workpool, workpool_stats_t* stats, histogram_t* wait,
+                        histogram_t* class_wait[WORKPOOL_PRIORITIES])
+{
+	memset(stats, 0, sizeof(workpool_stats_t));
+	if (workpool==NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&workpool->lock);
+	stats->threads = workpool->threads;
+	stats->started = workpool->started;
+	stats->depth = workpool->depth;
+	stats->max_depth = workpool->max_depth;
+	stats->running = workpool->running;
+	stats->completed = workpool->completed;
+	stats->aging_us = workpool->aging_us;
+	for (int priority = 0; priority < WORKPOOL_PRIORITIES; priority++) {
+		const workpool_queue_t* queue = &workpool->queues[priority];
+		stats->classes[priority].depth = queue->depth;
+		stats->classes[priority].max_depth = queue->max_depth;
+		stats->classes[priority].completed = queue->completed;
+		if (class_wait && class_wait[priority]) {
+			histogram_copy(class_wait[priority], queue->wait);
+		}
+	}
+	if (wait) {
+		histogram_copy(wait, workpool->wait);
+	}
+	pthread_mutex_unlock(&workpool->lock);
+}
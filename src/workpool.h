@@ -0,0 +1,106 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+#ifndef __WORKPOOL_H__
+#define __WORKPOOL_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include "histogram.h"
+
+
+#define WORKPOOL_DEFAULT_THREADS      4
+
+
+/* Priority classes, a job of a lower class is taken first unless a job of a
+ * higher class has waited for longer than the aging time in addition. */
+#define WORKPOOL_INTERACTIVE          0
+#define WORKPOOL_BACKGROUND           1
+#define WORKPOOL_PRIORITIES           2
+
+#define WORKPOOL_DEFAULT_AGING_US     100000
+
+
+/* Flags for workpool_push() */
+#define WORKPOOL_EXCLUSIVE            0x01 // don't run alongside other jobs of the group
+
+
+typedef struct workpool_t workpool_t;
+
+typedef void (*workpool_cb_t) (void* data);
+
+
+/* Jobs of the same group, e.g. of one context, may run in parallel and in
+ * any order unless one of them is exclusive: an exclusive job waits until
+ * the jobs of its group pushed before it are done and the jobs pushed after
+ * it wait for it. Otherwise a job of a higher priority class overtakes the
+ * queued jobs of its group like any other. Jobs of different groups never
+ * wait for each other. The fields are owned by the workpool, a group must
+ * be zeroed before its first job is pushed and must outlive its jobs. */
+typedef struct workpool_group_t {
+	int       running;
+	int       exclusive_running;
+	struct workpool_job_t* queued_head;    // queued jobs of the group, oldest first
+	struct workpool_job_t* queued_tail;
+	struct workpool_job_t* exclusive_head; // the oldest queued exclusive job
+} workpool_group_t;
+
+
+typedef struct workpool_class_stats_t {
+	size_t    depth;
+	size_t    max_depth;
+	uint64_t  completed;
+} workpool_class_stats_t;
+
+
+typedef struct workpool_stats_t {
+	size_t    threads;        // the configured limit
+	size_t    started;        // threads running right now, they are started on demand
+	size_t    depth;          // jobs waiting for a thread right now
+	size_t    max_depth;
+	size_t    running;
+	uint64_t  completed;
+	uint64_t  aging_us;
+	workpool_class_stats_t classes[WORKPOOL_PRIORITIES];
+} workpool_stats_t;
+
+
+workpool_t*           workpool_new          (size_t threads);
+void                  workpool_unref        (workpool_t*);
+
+void                  workpool_set_threads  (workpool_t*, size_t threads);
+void                  workpool_set_aging    (workpool_t*, uint64_t aging_us);
+
+void                  workpool_push         (workpool_t*, workpool_group_t*, int flags, int priority,
+                                             workpool_cb_t execute, workpool_cb_t done, void* data);
+
+void                  workpool_get_stats    (workpool_t*, workpool_stats_t*, histogram_t* wait,
+                                             histogram_t* class_wait[WORKPOOL_PRIORITIES]);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __WORKPOOL_H__ */
@@ -0,0 +1,71 @@
+/* eslint-disable camelcase */
+
+const binding = require('./binding')
+const C = require('./constants')
+const debug = require('debug')('deltachat:stringtable')
+
+/**
+ * Wrapper around strtable_t*, a set of strings for DC_EVENT_GET_STRING
+ * that can be shared by many DeltaChat instances
+ */
+class StringTable {
+  constructor (strings) {
+    debug('StringTable constructor')
+    this.dc_strtable = binding.dcn_strtable_new()
+    if (strings) this.load(strings)
+  }
+
+  clear () {
+    debug('clear')
+    binding.dcn_strtable_clear(this.dc_strtable)
+  }
+
+  get (index) {
+    debug(`get ${index}`)
+    return binding.dcn_strtable_get_str(this.dc_strtable, Number(index))
+  }
+
+  load (strings) {
+    debug('load')
+    return binding.dcn_strtable_load(this.dc_strtable, toArray(strings))
+  }
+
+  loadFile (file) {
+    debug(`loadFile ${file}`)
+    const result = binding.dcn_strtable_load_file(this.dc_strtable, file)
+    if (result < 0) {
+      throw new Error(`Cannot read string table ${file}`)
+    }
+    return result
+  }
+
+  set (index, str) {
+    if (typeof index === 'object') {
+      debug('set')
+      return binding.dcn_strtable_merge(this.dc_strtable, toArray(index))
+    }
+    debug(`set ${index} ${str}`)
+    binding.dcn_strtable_set_str(this.dc_strtable, Number(index), str)
+  }
+}
+
+/**
+ * Turns an object keyed by DC_STR_* value or name into an array indexed
+ * by value, arrays are taken as is
+ */
+function toArray (strings) {
+  if (Array.isArray(strings)) return strings
+  const table = []
+  Object.keys(strings).forEach(key => {
+    const index = key.startsWith('DC_STR_') ? C[key] : Number(key)
+    if (!Number.isInteger(index)) {
+      throw new Error(`Unknown string ${key}`)
+    }
+    table[index] = strings[key]
+  })
+  return table
+}
+
+StringTable.toArray = toArray
+
+module.exports = StringTable
@@ -0,0 +1,178 @@
+/**
+ * Tests for src/httpcache.c
+ *
+ * Answers DC_EVENT_HTTP_GET requests from the cache the way dcn_http_get()
+ * in src/module.c does, without any network. Checks hits and misses,
+ * cached failures and their shorter lifetime, eviction of the least
+ * recently used url and responses shared through the cache directory.
+ * Run it with `npm run test-httpcache`, it exits with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "../src/httpcache.h"
+
+static int failed = 0;
+
+static void check(const char* what, int ok)
+{
+  printf("%s - %s\n", ok ? "ok" : "not ok", what);
+  if (!ok) {
+    failed = 1;
+  }
+}
+
+static int got(httpcache_t* cache, const char* url, const char* expected)
+{
+  char* response = NULL;
+  int hit = httpcache_get(cache, url, &response);
+  int ok = hit && (expected ? response && strcmp(response, expected) == 0 : response == NULL);
+  free(response);
+  return ok;
+}
+
+static int missed(httpcache_t* cache, const char* url)
+{
+  char* response = NULL;
+  int hit = httpcache_get(cache, url, &response);
+  free(response);
+  return !hit && response == NULL;
+}
+
+static void test_hits()
+{
+  httpcache_t* cache = httpcache_new(10, 60000, 60000, NULL);
+  httpcache_stats_t stats;
+
+  check("unknown url misses", missed(cache, "https://a.example/"));
+  httpcache_put(cache, "https://a.example/", "<xml/>");
+  check("repeated url hits", got(cache, "https://a.example/", "<xml/>"));
+  httpcache_put(cache, "https://b.example/", NULL);
+  check("failed request hits", got(cache, "https://b.example/", NULL));
+  httpcache_put(cache, "https://c.example/", "");
+  check("empty response hits", got(cache, "https://c.example/", ""));
+  httpcache_put(cache, "https://a.example/", "<new/>");
+  check("response replaced", got(cache, "https://a.example/", "<new/>"));
+
+  httpcache_get_stats(cache, &stats);
+  check("entries counted", stats.entries == 3);
+  check("hits counted", stats.hits == 4 && stats.negative_hits == 1);
+  check("misses counted", stats.misses == 1 && stats.disk_hits == 0);
+
+  httpcache_clear(cache);
+  httpcache_get_stats(cache, &stats);
+  check("clear resets counters", stats.entries == 0 && stats.hits == 0 && stats.misses == 0);
+  check("clear forgets responses", missed(cache, "https://a.example/"));
+
+  // A capacity of 0 turns the cache off
+  httpcache_get_stats(cache, &stats);
+  uint64_t misses = stats.misses;
+  httpcache_configure(cache, 0, 60000, 60000, NULL);
+  httpcache_put(cache, "https://a.example/", "<xml/>");
+  check("disabled cache misses", missed(cache, "https://a.example/"));
+  httpcache_get_stats(cache, &stats);
+  check("disabled cache counts nothing", stats.entries == 0 && stats.misses == misses);
+  httpcache_unref(cache);
+}
+
+static void test_expiry()
+{
+  httpcache_t* cache = httpcache_new(10, 60000, 20, NULL);
+  httpcache_put(cache, "https://ok.example/", "<xml/>");
+  httpcache_put(cache, "https://failed.example/", NULL);
+  check("failure hits before its ttl", got(cache, "https://failed.example/", NULL));
+
+  usleep(50 * 1000);
+  check("failure expires", missed(cache, "https://failed.example/"));
+  check("response outlives a failure", got(cache, "https://ok.example/", "<xml/>"));
+
+  httpcache_stats_t stats;
+  httpcache_get_stats(cache, &stats);
+  check("expired entry dropped", stats.entries == 1);
+  httpcache_unref(cache);
+}
+
+static void test_eviction()
+{
+  httpcache_t* cache = httpcache_new(2, 60000, 60000, NULL);
+  httpcache_put(cache, "https://1.example/", "1");
+  httpcache_put(cache, "https://2.example/", "2");
+  check("first url used again", got(cache, "https://1.example/", "1"));
+  httpcache_put(cache, "https://3.example/", "3");
+
+  check("least recently used evicted", missed(cache, "https://2.example/"));
+  check("recently used kept", got(cache, "https://1.example/", "1"));
+  check("new url kept", got(cache, "https://3.example/", "3"));
+
+  httpcache_stats_t stats;
+  httpcache_get_stats(cache, &stats);
+  check("eviction counted", stats.evictions == 1 && stats.entries == 2);
+
+  httpcache_configure(cache, 1, 60000, 60000, NULL);
+  httpcache_get_stats(cache, &stats);
+  check("shrinking evicts", stats.entries == 1 && stats.evictions == 2);
+  check("shrinking keeps the last used", got(cache, "https://3.example/", "3"));
+  httpcache_unref(cache);
+}
+
+static void remove_dir(const char* path)
+{
+  DIR* dir = opendir(path);
+  if (dir) {
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+      if (entry->d_name[0] != '.') {
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(path);
+}
+
+static void test_dir()
+{
+  char dir[] = "/tmp/test-httpcache-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    check("cache directory created", 0);
+    return;
+  }
+
+  // Another process provisioning the same domain
+  httpcache_t* writer = httpcache_new(10, 60000, 60000, dir);
+  httpcache_put(writer, "https://shared.example/", "line 1\nline 2\n");
+  httpcache_put(writer, "https://down.example/", NULL);
+  httpcache_unref(writer);
+
+  httpcache_t* cache = httpcache_new(10, 60000, 60000, dir);
+  check("response read from the directory", got(cache, "https://shared.example/", "line 1\nline 2\n"));
+  check("failure read from the directory", got(cache, "https://down.example/", NULL));
+  check("unknown url not in the directory", missed(cache, "https://other.example/"));
+  check("loaded response kept in memory", got(cache, "https://shared.example/", "line 1\nline 2\n"));
+
+  httpcache_stats_t stats;
+  httpcache_get_stats(cache, &stats);
+  check("disk hits counted", stats.disk_hits == 2 && stats.hits == 3 && stats.misses == 1);
+
+  // Without the directory only memory is left
+  httpcache_configure(cache, 10, 60000, 60000, NULL);
+  httpcache_clear(cache);
+  check("directory no longer used", missed(cache, "https://shared.example/"));
+  httpcache_unref(cache);
+
+  remove_dir(dir);
+}
+
+int main()
+{
+  test_hits();
+  test_expiry();
+  test_eviction();
+  test_dir();
+  return failed;
+}
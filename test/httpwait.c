@@ -0,0 +1,200 @@
+/**
+ * Tests for src/httpwait.c
+ *
+ * Core threads waiting for the answers to DC_EVENT_HTTP_GET requests, like
+ * dcn_http_get() and dcn_set_http_get_response() in src/module.c do. Checks
+ * that every request gets an id of its own, that concurrent requests get
+ * their own answers in whatever order they come, and that a request gives
+ * up after the timeout. Run it with `npm run test-httpwait`, it exits with 1
+ * if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "../src/httpwait.h"
+
+#define THREADS 8
+
+static int failed = 0;
+
+static void check(const char* what, int ok)
+{
+  printf("%s - %s\n", ok ? "ok" : "not ok", what);
+  if (!ok) {
+    failed = 1;
+  }
+}
+
+static uint64_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Requests passed on by send(), answered by the main thread */
+typedef struct sent_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int cnt;
+  uint32_t ids[THREADS];
+  const char* urls[THREADS];
+} sent_t;
+
+static int send_and_record(void* userdata, const char* url, uint32_t request_id)
+{
+  sent_t* sent = userdata;
+  pthread_mutex_lock(&sent->mutex);
+  sent->ids[sent->cnt] = request_id;
+  sent->urls[sent->cnt] = url;
+  sent->cnt++;
+  pthread_cond_signal(&sent->cond);
+  pthread_mutex_unlock(&sent->mutex);
+  return 1;
+}
+
+static int send_nothing(void* userdata, const char* url, uint32_t request_id)
+{
+  return 0;
+}
+
+typedef struct answerer_t {
+  httpwait_t* httpwait;
+  uint32_t id;
+} answerer_t;
+
+/* Answers right away, before the request even started to wait */
+static int send_and_answer(void* userdata, const char* url, uint32_t request_id)
+{
+  answerer_t* answerer = userdata;
+  answerer->id = request_id;
+  return httpwait_answer(answerer->httpwait, request_id, strdup(url));
+}
+
+typedef struct requester_t {
+  pthread_t thread;
+  httpwait_t* httpwait;
+  sent_t* sent;
+  char url[32];
+  int answered;
+  char* response;
+} requester_t;
+
+static void* request_thread(void* arg)
+{
+  requester_t* requester = arg;
+  requester->answered = httpwait_request(requester->httpwait, requester->url,
+                                         send_and_record, requester->sent,
+                                         &requester->response);
+  return NULL;
+}
+
+static void test_ids()
+{
+  answerer_t answerer;
+  answerer.httpwait = httpwait_new(0);
+
+  char* response = NULL;
+  int answered = httpwait_request(answerer.httpwait, "https://a.example/",
+                                  send_and_answer, &answerer, &response);
+  uint32_t first = answerer.id;
+  check("answer before waiting", answered && response && strcmp(response, "https://a.example/") == 0);
+  free(response);
+
+  answered = httpwait_request(answerer.httpwait, "https://b.example/",
+                              send_and_answer, &answerer, &response);
+  check("second request answered", answered && response && strcmp(response, "https://b.example/") == 0);
+  check("request ids are not 0", first != 0 && answerer.id != 0);
+  check("request ids differ", first != answerer.id);
+  check("answered request is gone", httpwait_answer(answerer.httpwait, first, strdup("late")) == 0);
+  free(response);
+
+  answered = httpwait_request(answerer.httpwait, "https://c.example/",
+                              send_nothing, NULL, &response);
+  check("unsent request doesn't wait", !answered && response == NULL);
+  httpwait_unref(answerer.httpwait);
+}
+
+static void test_concurrent()
+{
+  httpwait_t* httpwait = httpwait_new(0);
+  sent_t sent;
+  memset(&sent, 0, sizeof(sent));
+  pthread_mutex_init(&sent.mutex, NULL);
+  pthread_cond_init(&sent.cond, NULL);
+
+  requester_t requesters[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    memset(&requesters[i], 0, sizeof(requester_t));
+    requesters[i].httpwait = httpwait;
+    requesters[i].sent = &sent;
+    snprintf(requesters[i].url, sizeof(requesters[i].url), "https://%d.example/", i);
+    pthread_create(&requesters[i].thread, NULL, request_thread, &requesters[i]);
+  }
+
+  pthread_mutex_lock(&sent.mutex);
+  while (sent.cnt < THREADS) {
+    pthread_cond_wait(&sent.cond, &sent.mutex);
+  }
+  pthread_mutex_unlock(&sent.mutex);
+
+  // Answer in reverse order, one of them as a failed request
+  int answers = 0;
+  for (int i = THREADS - 1; i >= 0; i--) {
+    char* response = i == 0 ? NULL : strdup(sent.urls[i]);
+    answers += httpwait_answer(httpwait, sent.ids[i], response);
+  }
+  check("every answer taken", answers == THREADS);
+  check("second answer dropped", httpwait_answer(httpwait, sent.ids[1], strdup("again")) == 0);
+
+  int own = 1;
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(requesters[i].thread, NULL);
+    if (!requesters[i].answered) {
+      own = 0;
+    } else if (requesters[i].url == sent.urls[0]) {
+      own = own && requesters[i].response == NULL;
+    } else {
+      own = own && requesters[i].response && strcmp(requesters[i].response, requesters[i].url) == 0;
+    }
+    free(requesters[i].response);
+  }
+  check("every thread got its own answer", own);
+
+  pthread_cond_destroy(&sent.cond);
+  pthread_mutex_destroy(&sent.mutex);
+  httpwait_unref(httpwait);
+}
+
+static void test_timeout()
+{
+  httpwait_t* httpwait = httpwait_new(50);
+  sent_t sent;
+  memset(&sent, 0, sizeof(sent));
+  pthread_mutex_init(&sent.mutex, NULL);
+  pthread_cond_init(&sent.cond, NULL);
+
+  char* response = NULL;
+  uint64_t start = now_ms();
+  int answered = httpwait_request(httpwait, "https://slow.example/",
+                                  send_and_record, &sent, &response);
+  uint64_t waited = now_ms() - start;
+  check("unanswered request times out", !answered && response == NULL);
+  check("waited for the timeout", waited >= 50 && waited < 5000);
+  check("late answer dropped", httpwait_answer(httpwait, sent.ids[0], strdup("late")) == 0);
+
+  pthread_cond_destroy(&sent.cond);
+  pthread_mutex_destroy(&sent.mutex);
+  httpwait_unref(httpwait);
+}
+
+int main()
+{
+  test_ids();
+  test_concurrent();
+  test_timeout();
+  return failed;
+}
@@ -48,6 +48,129 @@ tape('invalid input to configure throws', t => {
   t.end()
 })
 
+tape('event queue options and stats', t => {
+  const dc = new DeltaChat({
+    eventQueueCapacity: 100,
+    eventQueueOverflow: ['coalesce', 'drop-oldest-log']
+  })
+  t.same(dc.getEventQueueStats(), {
+    capacity: 128,
+    depth: 0,
+    maxDepth: 0,
+    delivered: 0,
+    batches: 0,
+    dropped: 0,
+    coalesced: 0,
+    strings: { allocs: 0, reused: 0, mallocs: 0, bytes: 0 }
+  }, 'capacity rounded up, nothing dropped')
+  t.is(new DeltaChat().getEventQueueStats().capacity, 4096, 'default capacity')
+  t.same(dc.getEventStats(), {}, 'no event latencies yet')
+  t.throws(function () {
+    new DeltaChat({ eventQueueOverflow: 'drop-all' }) // eslint-disable-line no-new
+  }, /Unknown event queue overflow policy drop-all/, 'unknown policy throws')
+  t.end()
+})
+
+tape('event latencies only with eventStats', t => {
+  const withStats = new DeltaChat({ eventStats: true })
+  const withoutStats = new DeltaChat()
+  let infos = 0
+  withStats.on('DC_EVENT_INFO', () => infos++)
+  withoutStats.on('DC_EVENT_INFO', () => {})
+  withStats.open(tempy.directory(), err => {
+    t.error(err, 'no error during open')
+    withoutStats.open(tempy.directory(), err => {
+      t.error(err, 'no error during open')
+      // Opening logs info events, give the event loop time to deliver them
+      setTimeout(() => {
+        const stats = withStats.getEventStats()
+        const info = stats.DC_EVENT_INFO
+        t.ok(infos > 0, 'info events emitted')
+        t.is(info.queued.count, infos, 'every info event queued')
+        t.is(info.dispatch.count, infos, 'every info event dispatched')
+        t.ok(info.queued.p50 <= info.queued.max, 'median not above max')
+        t.ok(info.dispatch.p99 <= info.dispatch.max, 'p99 not above max')
+        t.same(withoutStats.getEventStats(), {}, 'nothing recorded without eventStats')
+        withStats.close()
+        withoutStats.close()
+        t.end()
+      }, 50)
+    })
+  })
+})
+
+tape('event mask follows listeners', t => {
+  const dc = new DeltaChat()
+  const onInfo = () => {}
+  dc.on('DC_EVENT_INFO', onInfo)
+  dc.on('ALL', onInfo)
+  dc.removeListener('ALL', onInfo)
+  t.is(dc.listenerCount('newListener'), 1, 'tracking new listeners')
+  t.is(dc.listenerCount('removeListener'), 1, 'tracking removed listeners')
+  dc.removeAllListeners()
+  dc.on('DC_EVENT_INFO', onInfo)
+  t.is(dc.listenerCount('DC_EVENT_INFO'), 1, 'listening after removeAllListeners()')
+  dc.close()
+  t.is(dc.listenerCount('newListener'), 1, 'tracking again after close()')
+  t.end()
+})
+
+tape('event mask keeps unwanted events out of the queue', t => {
+  const masked = new DeltaChat()
+  const listening = new DeltaChat()
+  let infos = 0
+  listening.on('DC_EVENT_INFO', () => infos++)
+  masked.open(tempy.directory(), err => {
+    t.error(err, 'no error during open')
+    listening.open(tempy.directory(), err => {
+      t.error(err, 'no error during open')
+      // Opening logs info events, give the event loop time to deliver them
+      setTimeout(() => {
+        const maskedStats = masked.getEventQueueStats()
+        t.is(maskedStats.delivered, 0, 'nothing queued without listeners')
+        t.is(maskedStats.dropped, 0, 'nothing dropped either')
+        t.is(maskedStats.strings.allocs, 0, 'no strings copied')
+        t.ok(infos > 0, 'info events emitted')
+        t.is(listening.getEventQueueStats().delivered, infos, 'only info events queued')
+        masked.close()
+        listening.close()
+        t.end()
+      }, 50)
+    })
+  })
+})
+
+tape('http cache configuration and stats', t => {
+  DeltaChat.configureHttpCache({ capacity: 10 })
+  DeltaChat.clearHttpCache()
+  t.same(DeltaChat.getHttpCacheStats(), {
+    capacity: 10,
+    entries: 0,
+    hits: 0,
+    negativeHits: 0,
+    diskHits: 0,
+    misses: 0,
+    evictions: 0
+  }, 'empty cache')
+  DeltaChat.configureHttpCache()
+  t.is(DeltaChat.getHttpCacheStats().capacity, 256, 'default capacity')
+  DeltaChat.configureHttpCache({ capacity: 0 })
+  t.end()
+})
+
+tape('StringTable', t => {
+  const table = new DeltaChat.StringTable({ DC_STR_NOMESSAGES: 'Nichts' })
+  t.is(table.get(c.DC_STR_NOMESSAGES), 'Nichts', 'loaded')
+  table.set(c.DC_STR_SELF, 'Ich')
+  t.is(table.get(c.DC_STR_SELF), 'Ich', 'set')
+  t.is(table.set({ DC_STR_SELF: 'Selbst', DC_STR_DRAFT: 'Entwurf' }), 2, 'merged')
+  t.is(table.get(c.DC_STR_NOMESSAGES), 'Nichts', 'kept when merging')
+  t.is(table.get(c.DC_STR_SELF), 'Selbst', 'replaced when merging')
+  table.clear()
+  t.is(table.get(c.DC_STR_SELF), null, 'cleared')
+  t.end()
+})
+
 tape('dc.getInfo()', t => {
   const dc = new DeltaChat()
   const info = dc.getInfo()
@@ -296,6 +419,120 @@ test('new message and Message methods', (t, dc) => {
   t.end()
 })
 
+test('bulk getters', (t, dc) => {
+  const contactId = dc.createContact('bulk', 'bulk@site.org')
+  const chatId = dc.createChatByContactId(contactId)
+  const msgId = dc.sendMessage(chatId, 'bulk message')
+  const getters = [
+    [ 'getMessages', msgId, dc.getMessage(msgId).toJson() ],
+    [ 'getContactsInfo', contactId, dc.getContact(contactId).toJson() ],
+    [ 'getChatsInfo', chatId, dc.getChat(chatId).toJson() ]
+  ]
+
+  Promise.all(getters.map(([ name, id, expected ]) => {
+    t.same(dc[name]([ id, 0xffffff ]), [ expected, null ], `${name} same as toJson()`)
+    t.same(dc[name](Uint32Array.of(id)), [ expected ], `${name} with a typed array`)
+    return new Promise(resolve => {
+      dc[name]([ id ], (err, result) => {
+        t.error(err, 'no error')
+        t.same(result, [ expected ], `${name} async`)
+        resolve()
+      })
+    }).then(() => dc.promises[name](Uint32Array.of(id, 0xffffff))).then(result => {
+      t.same(result, [ expected, null ], `${name} promise`)
+    })
+  })).then(() => t.end(), t.end)
+})
+
+test('bulk getters with repeated and colliding strings', (t, dc) => {
+  // More distinct names than the native string cache has slots, each
+  // one twice, so slots are reused and hit alternately
+  const contactIds = []
+  for (let i = 0; i < 1200; i++) {
+    contactIds.push(dc.createContact(`name ${i % 600}`, `intern${i}@site.org`))
+  }
+  const contacts = dc.getContactsInfo(contactIds)
+  t.ok(contacts.every((contact, i) => contact.name === `name ${i % 600}`), 'names')
+  t.ok(contacts.every((contact, i) => contact.address === `intern${i}@site.org`), 'addresses')
+  t.same(dc.getContactsInfo(contactIds), contacts, 'same when cached')
+  t.end()
+})
+
+test('bulk message operations with a typed array', (t, dc) => {
+  const chatId = dc.createChatByContactId(dc.createContact('star', 'star@site.org'))
+  const msgId = dc.sendMessage(chatId, 'starred message')
+  const ids = Uint32Array.of(msgId)
+  dc.starMessages(ids, true, err => {
+    t.error(err, 'no error')
+    t.same(dc.getStarredMessages(), [msgId], 'starred async')
+    t.end()
+  })
+  // the ids were copied, the work on the pool doesn't see this
+  ids[0] = 0
+})
+
+test('ids from other arrays', (t, dc) => {
+  const binding = require('../binding')
+  const chatId = dc.createChatByContactId(dc.createContact('ids', 'ids@site.org'))
+  const msgId = dc.sendMessage(chatId, 'message')
+  t.same(dc.getMessages(Int32Array.of(msgId)), dc.getMessages([msgId]), 'Int32Array')
+  t.same(dc.getMessages(Uint16Array.of(msgId)), dc.getMessages([msgId]), 'Uint16Array')
+
+  t.throws(() => binding.dcn_delete_msgs(dc.dcn_context, Float64Array.of(msgId)), TypeError, 'Float64Array')
+  t.throws(() => binding.dcn_get_msgs(dc.dcn_context, [msgId, 'x']), TypeError, 'string id')
+  t.throws(() => binding.dcn_delete_msgs_async(dc.dcn_context, [msgId, 'x'], () => {
+    t.fail('nothing queued')
+  }), TypeError, 'nothing queued for a string id')
+  t.throws(() => binding.dcn_get_msgs_async(dc.dcn_context, Float64Array.of(msgId), () => {
+    t.fail('nothing queued')
+  }), TypeError, 'nothing queued for a Float64Array')
+
+  dc.getMessages([msgId], (err, messages) => {
+    t.error(err, 'no error')
+    t.is(messages[0].id, msgId, 'message still there')
+    t.end()
+  })
+})
+
+test('message cursor', (t, dc) => {
+  const chatId = dc.createChatByContactId(dc.createContact('cursor', 'cursor@site.org'))
+  const msgIds = [1, 2, 3, 4, 5].map(i => dc.sendMessage(chatId, `message ${i}`))
+  dc.getChatMessagesCursor(chatId, (err, cursor) => {
+    t.error(err, 'no error')
+    t.is(cursor.getCount(), msgIds.length, 'correct count')
+    cursor.next(2, (err, messages, ids) => {
+      t.error(err, 'no error')
+      t.same(ids, msgIds.slice(0, 2), 'first window')
+      t.same(messages, dc.getMessages(ids), 'same as getMessages()')
+      cursor.next(2, (err, messages, ids) => {
+        t.error(err, 'no error')
+        t.same(ids, msgIds.slice(2, 4), 'second window')
+        t.is(cursor.seek(msgIds[4]), 4, 'seek to last message')
+        t.is(cursor.seek(0xffffff), -1, 'unknown message')
+        cursor.prev(10, (err, messages, ids) => {
+          t.error(err, 'no error')
+          t.same(ids, msgIds.slice(0, 4), 'window before last message')
+          t.end()
+        })
+      })
+    })
+  })
+})
+
+test('message cursor promise', (t, dc) => {
+  const chatId = dc.createChatByContactId(dc.createContact('cursor', 'cursor@site.org'))
+  const msgIds = [1, 2, 3].map(i => dc.sendMessage(chatId, `message ${i}`))
+  dc.getChatMessagesCursor(chatId).then(cursor => {
+    t.is(cursor.getCount(), msgIds.length, 'correct count')
+    return dc.promises.getChatMessagesCursor(chatId)
+  }).then(cursor => {
+    t.is(cursor.seek(msgIds[2]), 2, 'cursor from dc.promises')
+    return dc.getChatMessagesCursor(0xffffff)
+  }).then(cursor => {
+    t.is(cursor.getCount(), 0, 'unknown chat is empty')
+  }).then(() => t.end(), t.end)
+})
+
 test('Contact methods', (t, dc) => {
   const contactId = dc.createContact('First Last', 'first.last@site.org')
   let contact = dc.getContact(contactId)
@@ -353,6 +590,148 @@ test('adding and removing a contact from a chat', (t, dc) => {
   t.end()
 })
 
+test('database calls on the threadpool', (t, dc) => {
+  dc.createContact('Async', 'async@site.com', (err, contactId) => {
+    t.error(err, 'no error')
+    t.is(dc.lookupContactIdByAddr('async@site.com'), true, 'contact created')
+    dc.createUnverifiedGroupChat('async group', (err, chatId) => {
+      t.error(err, 'no error')
+      dc.addContactToChat(chatId, contactId, (err, added) => {
+        t.error(err, 'no error')
+        t.is(added, true, 'contact added')
+        dc.getChat(chatId, (err, chat) => {
+          t.error(err, 'no error')
+          t.is(chat.getName(), 'async group', 'chat is a Chat')
+          dc.getChatContacts(chatId, (err, contacts) => {
+            t.error(err, 'no error')
+            t.same(contacts, dc.getChatContacts(chatId), 'same as sync')
+            dc.getContact(0xffffff, (err, contact) => {
+              t.error(err, 'no error')
+              t.is(contact, null, 'missing contact is null')
+              dc.getConfig('addr', (err, addr) => {
+                t.error(err, 'no error')
+                t.is(addr, dc.getConfig('addr'), 'same config as sync')
+                t.end()
+              })
+            })
+          })
+        })
+      })
+    })
+  })
+})
+
+test('native async bindings with invalid arguments', (t, dc) => {
+  const binding = require('../binding')
+  const cb = () => t.fail('nothing queued')
+  t.throws(() => binding.dcn_get_chat_async(dc.dcn_context, 'abc', cb), TypeError, 'string for a number')
+  t.throws(() => binding.dcn_set_config_async(dc.dcn_context, 'addr', 1, cb), TypeError, 'number for a string')
+  dc.getConfig('addr', (err, addr) => {
+    t.error(err, 'no error')
+    t.is(addr, dc.getConfig('addr'), 'calls still work')
+    t.end()
+  })
+})
+
+test('promises from the native async bindings', (t, dc) => {
+  const contactId = dc.createContact('Promise', 'promise@site.com')
+  const chatId = dc.createChatByContactId(contactId)
+  Promise.all([
+    dc.promises.getChat(chatId),
+    dc.promises.getChatContacts(chatId),
+    dc.promises.lookupContactIdByAddr('promise@site.com'),
+    dc.promises.getContactsInfo([contactId])
+  ]).then(([chat, contacts, found, infos]) => {
+    t.is(chat.getId(), chatId, 'chat is a Chat')
+    t.same(contacts, [contactId], 'chat contacts')
+    t.is(found, true, 'contact found')
+    t.is(infos[0].address, 'promise@site.com', 'contact info')
+    return dc.promises.continueKeyTransfer(0xffffff, 'bad')
+  }).then(() => {
+    t.fail('bad setup code should reject')
+  }, err => {
+    t.ok(err instanceof Error, 'rejected with an error')
+  }).then(() => t.end(), t.end)
+})
+
+test('work pool stats', (t, dc) => {
+  const before = DeltaChat.getWorkPoolStats()
+  DeltaChat.configureWorkPool({ threads: 2 })
+  t.is(DeltaChat.getWorkPoolStats().threads, 2, 'thread limit')
+  const contactId = dc.createContact('Pool', 'pool@site.com')
+  Promise.all([
+    dc.promises.getContact(contactId),
+    dc.promises.lookupContactIdByAddr('pool@site.com')
+  ]).then(() => {
+    const stats = DeltaChat.getWorkPoolStats()
+    t.ok(stats.completed >= before.completed + 2, 'calls completed')
+    t.ok(stats.wait.count >= before.wait.count + 2, 'wait times recorded')
+    DeltaChat.configureWorkPool()
+    t.is(DeltaChat.getWorkPoolStats().threads, 4, 'default limit')
+  }).then(() => t.end(), t.end)
+})
+
+test('priority classes on the work pool', (t, dc) => {
+  t.throws(() => dc.withPriority('urgent'), /Unknown priority urgent/, 'unknown priority')
+  t.is(dc.withPriority('background'), dc.withPriority('background'), 'methods are cached')
+  const before = DeltaChat.getWorkPoolStats()
+  const other = new DeltaChat()
+
+  // getInfo() keeps the single thread busy while the other calls queue up.
+  // Results that are ready at once are handed back for dc before other, so
+  // the calls expected to run first are always made on dc.
+  const run = (calls) => {
+    const order = []
+    return Promise.all([ dc.promises.getInfo() ].concat(calls.map(([ name, fn ]) => {
+      return fn().then(() => order.push(name))
+    }))).then(() => order)
+  }
+  const background = ctx => [ 'background', () => ctx.withPriority('background').getBlockedCount() ]
+  const interactive = ctx => [ 'interactive', () => ctx.withPriority('interactive').getBlockedCount() ]
+
+  DeltaChat.configureWorkPool({ threads: 1 })
+  waitForWorkPool(1).then(() => {
+    return run([ background(other), background(other), interactive(dc) ])
+  }).then(order => {
+    t.same(order, [ 'interactive', 'background', 'background' ], 'interactive call went first')
+    return run([ background(dc), background(dc), interactive(dc) ])
+  }).then(order => {
+    t.same(order, [ 'interactive', 'background', 'background' ], 'interactive call of the same context went first')
+    DeltaChat.configureWorkPool({ threads: 1, aging: 0 })
+    return run([ background(dc), background(dc), interactive(other) ])
+  }).then(order => {
+    t.same(order, [ 'background', 'background', 'interactive' ], 'no aging keeps the order')
+    const stats = DeltaChat.getWorkPoolStats()
+    t.ok(stats.background.completed >= before.background.completed + 6, 'background calls')
+    t.ok(stats.interactive.completed >= before.interactive.completed + 3, 'interactive calls')
+    t.ok(stats.background.wait.count >= before.background.wait.count + 6, 'background wait times')
+    t.is(stats.aging, 0, 'aging')
+    DeltaChat.configureWorkPool()
+    t.is(DeltaChat.getWorkPoolStats().aging, 100, 'default aging')
+  }).then(() => t.end(), t.end)
+})
+
+test('exclusive calls on the work pool', (t, dc, cwd) => {
+  const missing = path.join(cwd, 'missing.bak')
+  const order = []
+  const call = (name, promise) => promise.then(() => order.push(name), () => order.push(name))
+
+  // Importing a backup is exclusive: calls queued before it still go
+  // first, even interactive ones, and calls queued after it wait for it
+  DeltaChat.configureWorkPool({ threads: 1 })
+  waitForWorkPool(1).then(() => {
+    return Promise.all([
+      dc.promises.getInfo(),
+      call('before', dc.promises.getBlockedCount()),
+      call('import', dc.promises.importExport(c.DC_IMEX_IMPORT_BACKUP, missing)),
+      call('after', dc.promises.getBlockedCount())
+    ])
+  }).then(() => {
+    t.same(order, [ 'before', 'import', 'after' ], 'started in order')
+    DeltaChat.configureWorkPool()
+  }).then(() => t.end(), t.end)
+})
+
 test('blocking contacts', (t, dc) => {
   let id = dc.createContact('badcontact', 'bad@site.com')
 
@@ -373,7 +752,16 @@ test('blocking contacts', (t, dc) => {
   t.end()
 })
 
-test('ChatList methods', (t, dc) => {
+test('blocked contacts as a typed array', { typedArrays: true }, (t, dc) => {
+  const id = dc.createContact('badcontact', 'bad@site.com')
+  dc.blockContact(id, true)
+  const blocked = dc.getBlockedContacts()
+  t.ok(blocked instanceof Uint32Array, 'typed array')
+  t.same(Array.from(blocked), [ id ])
+  t.end()
+})
+
+test('ChatList methods', (t, dc, cwd) => {
   const ids = [
     dc.createUnverifiedGroupChat('groupchat1'),
     dc.createUnverifiedGroupChat('groupchat11'),
@@ -407,16 +795,149 @@ test('ChatList methods', (t, dc) => {
   )
   dc.clearStringTable()
 
+  const file = path.join(cwd, 'strings.txt')
+  fs.writeFileSync(file, `# de\n${c.DC_STR_NEWGROUPDRAFT}=Neue Gruppe\n`)
+  t.is(dc.loadStringTableFile(file), 1, 'one string loaded from file')
+  dc.createUnverifiedGroupChat('groupchat2222')
+  t.is(
+    dc.getChatList(0, 'groupchat2222').getSummary(0).getText2(),
+    'Neue Gruppe',
+    'new group message from file'
+  )
+  t.is(dc.loadStringTable({ DC_STR_NEWGROUPDRAFT: text }), 1, 'one string loaded')
+  dc.clearStringTable()
+
+  const shared = new DeltaChat.StringTable({ DC_STR_NEWGROUPDRAFT: 'Shared' })
+  dc.setSharedStringTable(shared)
+  dc.createUnverifiedGroupChat('groupchat3333')
+  t.is(
+    dc.getChatList(0, 'groupchat3333').getSummary(0).getText2(),
+    'Shared',
+    'new group message from shared table'
+  )
+  dc.setSharedStringTable(null)
+  t.throws(() => dc.loadStringTable({ DC_STR_NOPE: '' }), /Unknown string DC_STR_NOPE/)
+  dc.clearStringTable()
+
   dc.archiveChat(ids[0], true)
   chatList = dc.getChatList(c.DC_GCL_ARCHIVED_ONLY, 'groupchat1')
   t.is(chatList.getCount(), 1, 'only one archived')
 
-  t.end()
+  chatList = dc.getChatList(0, 'groupchat1')
+  dc.getChatListSnapshot({ query: 'groupchat1', offset: 1, limit: 1 }, (err, snapshot) => {
+    t.error(err, 'no error')
+    t.is(snapshot.count, chatList.getCount(), 'count of whole list')
+    t.is(snapshot.rows, 1, 'limited rows')
+    t.is(snapshot.chatId[0], chatList.getChatId(1), 'chat id at offset')
+    const summary = chatList.getSummary(1)
+    t.is(snapshot.summaryText2[0], summary.getText2(), 'summary text2')
+    t.is(snapshot.summaryState[0], summary.getState(), 'summary state')
+    t.is(snapshot.name[0], dc.getChat(snapshot.chatId[0]).getName(), 'chat name')
+    t.end()
+  })
 })
 
-function test (desc, fn) {
+test('import/export on the threadpool', (t, dc, cwd) => {
+  const missing = path.join(cwd, 'missing', 'backup')
+  t.is(dc.importExport(c.DC_IMEX_EXPORT_BACKUP, missing), undefined, 'synchronous without callback')
+  dc.promises.importExport(c.DC_IMEX_EXPORT_BACKUP, missing).then(() => {
+    t.fail('export to a missing directory should fail')
+  }, err => {
+    t.ok(err instanceof Error, 'rejected with an error')
+    t.is(err.message, 'Import/export failed', 'failed')
+  }).then(() => {
+    dc.importExport(c.DC_IMEX_IMPORT_BACKUP, missing, '', { onProgress () {} }, err => {
+      t.ok(err instanceof Error, 'called back with an error')
+      t.is(dc.listenerCount('DC_EVENT_IMEX_PROGRESS'), 0, 'progress listener removed')
+      t.end()
+    })
+  })
+})
+
+test('import/export progress', (t, dc, cwd) => {
+  const blob = path.join(dc.getBlobdir(), 'blob.txt')
+  fs.writeFileSync(blob, Buffer.alloc(4096))
+  const progress = []
+  const onProgress = p => progress.push(p)
+  dc.importExport(c.DC_IMEX_EXPORT_BACKUP, cwd, '', { onProgress }, err => {
+    t.error(err, 'no error')
+    t.ok(progress.length > 0, 'progress reported')
+    const last = progress[progress.length - 1]
+    t.is(last.permille, 1000, 'done')
+    t.ok(last.seconds >= 0, 'seconds')
+    // The size is determined while the export runs
+    if (last.totalBytes !== null) {
+      t.ok(last.totalBytes > 4096, 'size includes the database and the blobs')
+      t.is(last.bytes, last.totalBytes, 'bytes at the end')
+    }
+    t.is(dc.listenerCount('DC_EVENT_IMEX_PROGRESS'), 0, 'progress listener removed')
+    t.end()
+  })
+})
+
+test('import/export cancel', (t, dc, cwd) => {
+  const missing = path.join(cwd, 'missing', 'backup')
+  // A stop before the export started does not turn its failure into a cancel
+  dc.stopOngoingProcess()
+  dc.promises.importExport(c.DC_IMEX_EXPORT_BACKUP, missing).then(() => {
+    t.fail('export to a missing directory should fail')
+  }, err => {
+    t.is(err.message, 'Import/export failed', 'failed, not cancelled')
+  }).then(() => {
+    const exported = dc.promises.importExport(c.DC_IMEX_EXPORT_BACKUP, cwd)
+    dc.stopOngoingProcess()
+    return exported.then(() => {
+      t.pass('finished before the stop reached core')
+    }, err => {
+      t.is(err.message, 'Import/export cancelled', 'cancelled')
+    })
+  }).then(() => t.end())
+})
+
+test('record and replay an event journal', (t, dc, cwd) => {
+  const file = path.join(cwd, 'events.journal')
+  dc.startEventJournal(file)
+  dc.createContact('journal', 'journal@site.org')
+  const stats = dc.stopEventJournal()
+  t.ok(stats.records > 0, 'events recorded')
+  t.is(stats.dropped, 0, 'nothing dropped')
+
+  let replayed = 0
+  dc.on('DC_EVENT_CONTACTS_CHANGED', () => replayed++)
+  dc.promises.replayEventJournal(file, { speed: 0 }).then(count => {
+    t.ok(count > 0, 'events replayed')
+    t.ok(replayed > 0, 'replayed events emitted before completion')
+    // a pace of a million times slower than recorded never gets far
+    const slow = dc.promises.replayEventJournal(file, { speed: 1e-6 })
+    dc.stopEventReplay()
+    return slow
+  }).then(count => {
+    t.is(count, 0, 'stopped replay')
+    return dc.promises.replayEventJournal(path.join(cwd, 'missing'))
+  }).then(() => {
+    t.fail('missing journal should fail')
+  }, err => {
+    t.ok(err instanceof Error, 'missing journal is an error')
+  }).then(() => t.end(), t.end)
+})
+
+function waitForWorkPool (threads) {
+  return new Promise(resolve => {
+    const poll = () => {
+      if (DeltaChat.getWorkPoolStats().started <= threads) return resolve()
+      setTimeout(poll, 10)
+    }
+    poll()
+  })
+}
+
+function test (desc, opts, fn) {
+  if (typeof opts === 'function') {
+    fn = opts
+    opts = {}
+  }
   tape(desc, t => {
-    const dc = new DeltaChat()
+    const dc = new DeltaChat(opts)
     const cwd = tempy.directory()
     const end = t.end.bind(t)
 
@@ -0,0 +1,119 @@
+/**
+ * Tests for src/histogram.c and src/eventstats.c
+ *
+ * Records known samples and checks the counts, percentiles and maxima that
+ * dc.getEventStats() reports. Run it with `npm run test-stats`, it exits
+ * with 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "../src/histogram.h"
+#include "../src/eventstats.h"
+
+static int failed = 0;
+
+static void check(const char* what, uint64_t actual, uint64_t expected)
+{
+  if (actual != expected) {
+    printf("not ok - %s: got %llu, expected %llu\n", what,
+           (unsigned long long)actual, (unsigned long long)expected);
+    failed = 1;
+  } else {
+    printf("ok - %s\n", what);
+  }
+}
+
+static void test_histogram_exact()
+{
+  // Values below 32 have a bucket of their own
+  histogram_t* histogram = histogram_new();
+  for (uint64_t value = 20; value >= 1; value--) {
+    histogram_record(histogram, value);
+  }
+  check("exact count", histogram_count(histogram), 20);
+  check("exact p50", histogram_percentile(histogram, 50.0), 10);
+  check("exact p99", histogram_percentile(histogram, 99.0), 20);
+  check("exact max", histogram_max(histogram), 20);
+
+  histogram_reset(histogram);
+  check("reset count", histogram_count(histogram), 0);
+  check("reset p50", histogram_percentile(histogram, 50.0), 0);
+  check("reset max", histogram_max(histogram), 0);
+  histogram_unref(histogram);
+}
+
+static void test_histogram_buckets()
+{
+  // 1000..1023 share a bucket, a percentile reports its upper end but
+  // never more than the maximum
+  histogram_t* histogram = histogram_new();
+  for (int i = 0; i < 3; i++) {
+    histogram_record(histogram, 1000);
+  }
+  histogram_record(histogram, 5000);
+  check("bucket count", histogram_count(histogram), 4);
+  check("bucket p50", histogram_percentile(histogram, 50.0), 1023);
+  check("bucket max", histogram_max(histogram), 5000);
+  check("bucket p99 capped", histogram_percentile(histogram, 99.0), 5000);
+
+  histogram_t* single = histogram_new();
+  histogram_record(single, 1000);
+  check("single p50 capped", histogram_percentile(single, 50.0), 1000);
+
+  histogram_copy(single, histogram);
+  check("copy count", histogram_count(single), 4);
+  check("copy max", histogram_max(single), 5000);
+  histogram_unref(single);
+
+  // Out of range values are clamped instead of overflowing the buckets
+  histogram_reset(histogram);
+  histogram_record(histogram, UINT64_MAX);
+  check("clamped count", histogram_count(histogram), 1);
+  check("clamped max", histogram_max(histogram), ((uint64_t)1 << 36) - 1);
+  histogram_unref(histogram);
+}
+
+static void test_eventstats()
+{
+  eventstats_t* eventstats = eventstats_new();
+  for (uint64_t usec = 1; usec <= 9; usec++) {
+    eventstats_record(eventstats, 2000, EVENTSTATS_QUEUED, usec);
+  }
+  eventstats_record(eventstats, 100, EVENTSTATS_DISPATCH, 7);
+  eventstats_record(eventstats, 2000, EVENTSTATS_DISPATCH, 3);
+  eventstats_record(eventstats, 2000, EVENTSTATS_STAGES, 3);
+
+  check("entries", eventstats_get_cnt(eventstats), 2);
+  check("first event", eventstats_get_event(eventstats, 0), 2000);
+  check("second event", eventstats_get_event(eventstats, 1), 100);
+
+  const histogram_t* queued = eventstats_get_histogram(eventstats, 0, EVENTSTATS_QUEUED);
+  check("queued count", histogram_count(queued), 9);
+  check("queued p50", histogram_percentile(queued, 50.0), 5);
+  check("queued max", histogram_max(queued), 9);
+
+  const histogram_t* dispatch = eventstats_get_histogram(eventstats, 0, EVENTSTATS_DISPATCH);
+  check("dispatch count, invalid stage ignored", histogram_count(dispatch), 1);
+  check("dispatch max", histogram_max(dispatch), 3);
+
+  const histogram_t* other = eventstats_get_histogram(eventstats, 1, EVENTSTATS_QUEUED);
+  check("other queued count", histogram_count(other), 0);
+  other = eventstats_get_histogram(eventstats, 1, EVENTSTATS_DISPATCH);
+  check("other dispatch p50", histogram_percentile(other, 50.0), 7);
+
+  check("missing entry", eventstats_get_histogram(eventstats, 2, EVENTSTATS_QUEUED) == NULL, 1);
+  eventstats_unref(eventstats);
+
+  // Without statistics the context has no eventstats at all
+  eventstats_record(NULL, 2000, EVENTSTATS_QUEUED, 1);
+  check("disabled entries", eventstats_get_cnt(NULL), 0);
+}
+
+int main()
+{
+  test_histogram_exact();
+  test_histogram_buckets();
+  test_eventstats();
+  return failed;
+}
@@ -0,0 +1,83 @@
+/**
+ * Tests for src/strpool.c
+ *
+ * Checks the copies and the counters of getEventQueueStats().strings: new
+ * slab blocks are allocations, only blocks given back by strpool_free() are
+ * reused. Run it with `npm run test-strpool`, it exits with 1 if a check
+ * fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/strpool.h"
+
+#define STRINGS 100
+
+static int failed = 0;
+
+static void check(const char* what, uint64_t actual, uint64_t expected)
+{
+  if (actual != expected) {
+    printf("not ok - %s: got %llu, expected %llu\n", what,
+           (unsigned long long)actual, (unsigned long long)expected);
+    failed = 1;
+  } else {
+    printf("ok - %s\n", what);
+  }
+}
+
+int main()
+{
+  strpool_t* strpool = strpool_new();
+  strpool_stats_t stats;
+  char* strings[STRINGS];
+
+  // Two slabs of the smallest class
+  for (int i = 0; i < STRINGS; i++) {
+    char str[16];
+    snprintf(str, sizeof(str), "string %d", i);
+    strings[i] = strpool_strdup(strpool, str);
+  }
+  int copied = 1;
+  for (int i = 0; i < STRINGS; i++) {
+    char str[16];
+    snprintf(str, sizeof(str), "string %d", i);
+    copied = copied && strcmp(strings[i], str) == 0;
+  }
+  check("copies intact", copied, 1);
+  strpool_get_stats(strpool, &stats);
+  check("fresh allocs", stats.allocs, STRINGS);
+  check("fresh blocks not reused", stats.reused, 0);
+  check("fresh mallocs", stats.mallocs, 2);
+
+  for (int i = 0; i < STRINGS; i++) {
+    strpool_free(strpool, strings[i]);
+  }
+  for (int i = 0; i < STRINGS / 2; i++) {
+    strings[i] = strpool_strdup(strpool, "again");
+  }
+  strpool_get_stats(strpool, &stats);
+  check("allocs after free", stats.allocs, STRINGS + STRINGS / 2);
+  check("given back blocks reused", stats.reused, STRINGS / 2);
+  check("no more mallocs", stats.mallocs, 2);
+
+  // Too large for any class, allocated on its own and never reused
+  char large[2048];
+  memset(large, 'x', sizeof(large) - 1);
+  large[sizeof(large) - 1] = 0;
+  char* copy = strpool_strdup(strpool, large);
+  check("large copy intact", strcmp(copy, large) == 0, 1);
+  strpool_free(strpool, copy);
+  copy = strpool_strdup(strpool, large);
+  strpool_free(strpool, copy);
+  strpool_get_stats(strpool, &stats);
+  check("large strings malloced", stats.mallocs, 4);
+  check("large strings not reused", stats.reused, STRINGS / 2);
+
+  for (int i = 0; i < STRINGS / 2; i++) {
+    strpool_free(strpool, strings[i]);
+  }
+  strpool_unref(strpool);
+  return failed;
+}